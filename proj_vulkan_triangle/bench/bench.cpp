@@ -0,0 +1,575 @@
+// Offscreen benchmark: fixed scenarios, each a warmup and timed iterations, results as JSON.
+// Runs without a display; on a machine without a GPU point the loader at a software ICD (see README).
+
+#define SDL_MAIN_HANDLED // no window, no SDL2main
+
+#include "app.hpp"
+#include "backends/imgui_impl_vulkan.h"
+#include "gpu_allocator.hpp"
+#include "headless.hpp"
+#include "imgui.h"
+#include "pipeline_cache.hpp"
+#include "vulkan_utils.hpp"
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <stdio.h>  // printf, fprintf
+#include <string>
+#include <string.h> // strcmp
+#include <vector>
+
+namespace {
+
+constexpr uint32_t bench_format_version = 2; // 2: iterations per scenario, failed scenarios carry an error
+
+const char* const scenario_names[] = { "startup", "empty_frame", "demo_window", "many_windows", "upload" };
+
+struct BenchOptions
+{
+  uint32_t width = 1280;
+  uint32_t height = 720;
+  uint32_t warmup = 30;
+  uint32_t iterations = 300;
+  // Startup builds and destroys the whole context per iteration
+  uint32_t startup_warmup = 1;
+  uint32_t startup_iterations = 5;
+  uint32_t windows = 64;
+  uint32_t upload_mb = 16; // per iteration, in 1 MB copies
+  std::string device;      // index or part of the name, as --device of the app
+  std::string scenario;    // run only this one
+  std::string out_path = "bench.json";
+};
+
+void
+print_usage(const char* exe)
+{
+  printf("usage: %s [--size WxH] [--warmup N] [--iterations N] [--startup-iterations N] [--windows N] [--upload-mb N] [--device index|name] [--scenario name] [--out file.json]\n", exe);
+  printf("scenarios:");
+  for (const char* name : scenario_names)
+    printf(" %s", name);
+  printf("\n");
+}
+
+bool
+parse_options(int argc, char** argv, BenchOptions& options)
+{
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (strcmp(arg, "--size") == 0 && has_value) {
+      if (sscanf(argv[++i], "%ux%u", &options.width, &options.height) != 2 || options.width == 0 || options.height == 0) {
+        fprintf(stderr, "Error invalid --size '%s', expected WxH\n", argv[i]);
+        return false;
+      }
+    } else if (strcmp(arg, "--warmup") == 0 && has_value)
+      options.warmup = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+    else if (strcmp(arg, "--iterations") == 0 && has_value)
+      options.iterations = std::max(1u, static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)));
+    else if (strcmp(arg, "--startup-iterations") == 0 && has_value)
+      options.startup_iterations = std::max(1u, static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)));
+    else if (strcmp(arg, "--windows") == 0 && has_value)
+      options.windows = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+    else if (strcmp(arg, "--upload-mb") == 0 && has_value)
+      options.upload_mb = std::max(1u, static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)));
+    else if (strcmp(arg, "--device") == 0 && has_value)
+      options.device = argv[++i];
+    else if (strcmp(arg, "--scenario") == 0 && has_value)
+      options.scenario = argv[++i];
+    else if (strcmp(arg, "--out") == 0 && has_value)
+      options.out_path = argv[++i];
+    else {
+      fprintf(stderr, "Error unknown argument '%s'\n", arg);
+      print_usage(argv[0]);
+      return false;
+    }
+  }
+  // Before any device setup
+  if (!options.scenario.empty() && std::none_of(std::begin(scenario_names), std::end(scenario_names), [&](const char* name) { return options.scenario == name; })) {
+    fprintf(stderr, "Error unknown scenario '%s'\n", options.scenario.c_str());
+    print_usage(argv[0]);
+    return false;
+  }
+  return true;
+}
+
+// Everything a headless frame needs, built and torn down as one so startup can be measured
+struct BenchContext
+{
+  VkInstance instance = VK_NULL_HANDLE;
+  VkAllocationCallbacks* allocator = nullptr;
+  VkDebugReportCallbackEXT reporter = VK_NULL_HANDLE;
+  VkSurfaceKHR surface = VK_NULL_HANDLE; // always null, offscreen
+  VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+  VkDevice device = VK_NULL_HANDLE;
+  std::optional<uint32_t> queue_family;
+  VkQueue queue = VK_NULL_HANDLE;
+  DeviceQueues queues;
+  VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
+  VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
+
+  ImGui_ImplVulkanH_Window wd;
+  std::vector<GpuImage> images;
+  GpuAllocator gpu;
+  UploadQueue uploads;
+  FrameScheduler scheduler;
+  DeletionQueue deletions;
+  JobSystem jobs;
+  CommandRecorder recorder;
+  DescriptorAllocator descriptors;
+  BindlessTable bindless;
+  bool has_bindless = false;
+  MeshRenderer meshes;
+  UiRenderer ui;
+  FrameTimings timings;
+  bool rebuild_swapchain = false; // never set headless
+};
+
+void
+setup_bench_context(BenchContext& ctx, const BenchOptions& options)
+{
+  const uint32_t frames_in_flight = 2;
+  const char* device_override = options.device.empty() ? getenv("VT_DEVICE") : options.device.c_str();
+  setup_vulkan({}, {}, ctx.instance, ctx.allocator, ctx.reporter, nullptr, ctx.surface, ctx.physical_device, ctx.device, ctx.queue_family, ctx.queue, ctx.queues, device_override, ctx.descriptor_pool);
+  const uint32_t queue_family = ctx.queue_family.value();
+
+  setup_gpu_allocator(ctx.gpu, ctx.physical_device, ctx.device, ctx.allocator);
+  setup_upload_queue(ctx.uploads, ctx.gpu, ctx.device, ctx.queues.transfer, ctx.queues.transfer_family, ctx.queue, queue_family, 32ull * 1024 * 1024, ctx.allocator);
+  setup_vulkan_headless(&ctx.wd, ctx.gpu, ctx.images, options.width, options.height, ctx.allocator, ctx.device, frames_in_flight);
+  setup_frame_scheduler(ctx.scheduler, ctx.device, queue_family, frames_in_flight, 0, ctx.allocator);
+  setup_job_system(ctx.jobs, 0);
+  setup_command_recorder(ctx.recorder, ctx.device, queue_family, ctx.jobs.thread_count, frames_in_flight, ctx.allocator);
+  const std::vector<DescriptorPoolRatio> descriptor_ratios = { { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4.0f },
+                                                               { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f },
+                                                               { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f } };
+  setup_descriptor_allocator(ctx.descriptors, ctx.device, frames_in_flight, descriptor_ratios, ctx.allocator);
+  ctx.has_bindless = setup_bindless_table(ctx.bindless, ctx.physical_device, ctx.device, ctx.deletions, ctx.allocator);
+
+  // Same results every run: no imgui.ini, no pipeline cache file, fixed time step (bench_frame)
+  IMGUI_CHECKVERSION();
+  ImGui::CreateContext();
+  ImGuiIO& io = ImGui::GetIO();
+  io.IniFilename = nullptr;
+  io.LogFilename = nullptr;
+  io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;
+  ImGui::StyleColorsDark();
+  setup_pipeline_cache(ctx.physical_device, ctx.device, "", ctx.allocator, ctx.pipeline_cache);
+
+  ImGui_ImplVulkan_InitInfo init_info = {};
+  init_info.Instance = ctx.instance;
+  init_info.PhysicalDevice = ctx.physical_device;
+  init_info.Device = ctx.device;
+  init_info.QueueFamily = queue_family;
+  init_info.Queue = ctx.queue;
+  init_info.PipelineCache = ctx.pipeline_cache;
+  init_info.DescriptorPool = ctx.descriptor_pool;
+  init_info.Subpass = 0;
+  init_info.MinImageCount = 2;
+  init_info.ImageCount = std::max(ctx.wd.ImageCount, frames_in_flight);
+  init_info.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
+  init_info.Allocator = ctx.allocator;
+  init_info.CheckVkResultFn = check_vk_result;
+  ImGui_ImplVulkan_Init(&init_info, ctx.wd.RenderPass);
+
+  // UI only: the mesh scene animates with wall-clock time
+  if (!setup_mesh_renderer(ctx.meshes, ctx.physical_device, ctx.device, ctx.gpu, ctx.uploads, ctx.descriptors, ctx.has_bindless ? &ctx.bindless : nullptr, ctx.wd.RenderPass, ctx.pipeline_cache, frames_in_flight, 0, 1, ctx.allocator) ||
+      !setup_ui_renderer(ctx.ui, ctx.device, ctx.gpu, ctx.deletions, ctx.wd.RenderPass, ctx.pipeline_cache, queue_family, frames_in_flight, ctx.allocator)) {
+    fprintf(stderr, "[bench] Renderer setup failed\n");
+    exit(EXIT_FAILURE);
+  }
+  upload_queue_submit_graphics(
+    ctx.uploads, [](VkCommandBuffer command_buffer) { ImGui_ImplVulkan_CreateFontsTexture(command_buffer); }, [] { ImGui_ImplVulkan_DestroyFontUploadObjects(); });
+  setup_frame_timings(ctx.timings, ctx.physical_device, ctx.device, queue_family, ctx.allocator);
+}
+
+void
+cleanup_bench_context(BenchContext& ctx)
+{
+  VkResult err = vkDeviceWaitIdle(ctx.device);
+  check_vk_result(err);
+  cleanup_frame_timings(ctx.timings, ctx.device, ctx.allocator);
+  cleanup_command_recorder(ctx.recorder);
+  cleanup_descriptor_allocator(ctx.descriptors);
+  if (ctx.has_bindless)
+    cleanup_bindless_table(ctx.bindless);
+  cleanup_job_system(ctx.jobs);
+  deletion_queue_flush(ctx.deletions);
+  cleanup_frame_scheduler(ctx.scheduler, ctx.device, ctx.allocator);
+  cleanup_mesh_renderer(ctx.meshes);
+  cleanup_ui_renderer(ctx.ui);
+  cleanup_upload_queue(ctx.uploads);
+  ImGui_ImplVulkan_Shutdown();
+  vkDestroyPipelineCache(ctx.device, ctx.pipeline_cache, ctx.allocator);
+  ImGui::DestroyContext();
+  cleanup_vulkan_headless(ctx.device, ctx.wd, ctx.gpu, ctx.images, ctx.allocator);
+  cleanup_gpu_allocator(ctx.gpu);
+  cleanup_vulkan(ctx.instance, ctx.allocator, ctx.reporter, ctx.device, ctx.descriptor_pool);
+}
+
+// Builds and submits one frame, returns its index in ctx.timings
+uint64_t
+bench_frame(BenchContext& ctx, const std::function<void()>& build)
+{
+  frame_timings_begin_frame(ctx.timings);
+  const uint64_t frame = ctx.timings.frame;
+  deletion_queue_collect(ctx.deletions, frame_scheduler_completed_value(ctx.scheduler, ctx.device));
+
+  ImGuiIO& io = ImGui::GetIO();
+  io.DisplaySize = ImVec2(static_cast<float>(ctx.wd.Width), static_cast<float>(ctx.wd.Height));
+  io.DeltaTime = 1.0f / 60.0f;
+  ImGui::NewFrame();
+  build();
+  ImGui::Render();
+
+  ctx.wd.ClearValue = {};
+  frame_render(&ctx.wd, ImGui::GetDrawData(), true, ctx.queue, ctx.device, ctx.scheduler, ctx.uploads, ctx.meshes, ctx.jobs, ctx.recorder, ctx.descriptors, &ctx.ui, nullptr, nullptr, ctx.timings, ctx.rebuild_swapchain);
+  return frame;
+}
+
+// Every submitted frame has finished
+void
+bench_wait(BenchContext& ctx)
+{
+  frame_scheduler_wait(ctx.scheduler, ctx.device, ctx.scheduler.frame_number);
+}
+
+double
+elapsed_ms(std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end)
+{
+  return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+struct BenchStats
+{
+  uint32_t samples = 0;
+  double min = 0.0;
+  double median = 0.0;
+  double p90 = 0.0;
+  double max = 0.0;
+  double mean = 0.0;
+  double stddev = 0.0;
+  double mad = 0.0; // median absolute deviation, the spread to compare between runs
+};
+
+// Nearest rank on sorted samples
+double
+percentile(const std::vector<double>& sorted, double p)
+{
+  const size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+  return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+BenchStats
+compute_stats(std::vector<double> samples)
+{
+  BenchStats stats;
+  if (samples.empty())
+    return stats;
+  std::sort(samples.begin(), samples.end());
+  stats.samples = static_cast<uint32_t>(samples.size());
+  stats.min = samples.front();
+  stats.max = samples.back();
+  stats.median = percentile(samples, 0.5);
+  stats.p90 = percentile(samples, 0.9);
+  double sum = 0.0;
+  for (double sample : samples)
+    sum += sample;
+  stats.mean = sum / samples.size();
+  double squares = 0.0;
+  for (double sample : samples)
+    squares += (sample - stats.mean) * (sample - stats.mean);
+  stats.stddev = std::sqrt(squares / samples.size());
+  for (double& sample : samples)
+    sample = std::abs(sample - stats.median);
+  std::sort(samples.begin(), samples.end());
+  stats.mad = percentile(samples, 0.5);
+  return stats;
+}
+
+struct ScenarioResult
+{
+  std::string name;
+  std::string error; // the scenario could not run, no stats
+  uint32_t warmup = 0;
+  uint32_t iterations = 0;
+  BenchStats cpu; // ms per iteration
+  BenchStats gpu; // ms of GPU work per frame, where timestamps are supported
+  double bytes_per_iteration = 0.0;
+};
+
+ScenarioResult
+run_frame_scenario(BenchContext& ctx, const BenchOptions& options, const char* name, const std::function<void()>& build)
+{
+  printf("[bench] %s\n", name);
+  for (uint32_t i = 0; i < options.warmup; i++)
+    bench_frame(ctx, build);
+
+  // Frame to frame: includes waiting for a free frame slot, so GPU-bound scenarios measure the GPU
+  std::vector<double> samples;
+  std::vector<uint64_t> frames;
+  samples.reserve(options.iterations);
+  frames.reserve(options.iterations);
+  auto previous = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < options.iterations; i++) {
+    frames.push_back(bench_frame(ctx, build));
+    const auto now = std::chrono::steady_clock::now();
+    samples.push_back(elapsed_ms(previous, now));
+    previous = now;
+  }
+  bench_wait(ctx);
+
+  // Timestamps of the frames still in the ring whose queries were read back
+  std::vector<double> gpu_samples;
+  for (uint64_t frame : frames) {
+    const FrameTimingRecord& record = ctx.timings.records[frame % frame_timings_history];
+    if (record.frame == frame && record.gpu_valid)
+      gpu_samples.push_back(record.gpu_ms);
+  }
+
+  ScenarioResult result;
+  result.name = name;
+  result.warmup = options.warmup;
+  result.iterations = options.iterations;
+  result.cpu = compute_stats(std::move(samples));
+  result.gpu = compute_stats(std::move(gpu_samples));
+  return result;
+}
+
+// Context creation through the first finished frame; the fonts are uploaded with it
+ScenarioResult
+run_startup_scenario(const BenchOptions& options)
+{
+  printf("[bench] startup\n");
+  std::vector<double> samples;
+  for (uint32_t i = 0; i < options.startup_warmup + options.startup_iterations; i++) {
+    auto ctx = std::make_unique<BenchContext>();
+    const auto begin = std::chrono::steady_clock::now();
+    setup_bench_context(*ctx, options);
+    bench_frame(*ctx, [] {});
+    bench_wait(*ctx);
+    const auto end = std::chrono::steady_clock::now();
+    if (i >= options.startup_warmup)
+      samples.push_back(elapsed_ms(begin, end));
+    cleanup_bench_context(*ctx);
+  }
+  ScenarioResult result;
+  result.name = "startup";
+  result.warmup = options.startup_warmup;
+  result.iterations = options.startup_iterations;
+  result.cpu = compute_stats(std::move(samples));
+  return result;
+}
+
+// Staging copies through the upload queue into a device-local buffer, each iteration waited for
+ScenarioResult
+run_upload_scenario(BenchContext& ctx, const BenchOptions& options)
+{
+  printf("[bench] upload\n");
+  const VkDeviceSize chunk = 1024 * 1024;
+  const VkDeviceSize bytes = options.upload_mb * chunk;
+  GpuBuffer buffer;
+  if (!gpu_create_buffer(ctx.gpu, bytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, buffer)) {
+    fprintf(stderr, "[bench] Failed to allocate %llu bytes for the upload scenario\n", (unsigned long long)bytes);
+    ScenarioResult result;
+    result.name = "upload";
+    result.error = "buffer allocation failed";
+    return result;
+  }
+  std::vector<uint8_t> data(chunk);
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = static_cast<uint8_t>(i * 31);
+
+  const auto upload = [&] {
+    uint64_t value = 0;
+    for (VkDeviceSize offset = 0; offset < bytes; offset += chunk)
+      value = upload_buffer(ctx.uploads, buffer.buffer, offset, data.data(), chunk, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    upload_queue_flush(ctx.uploads);
+    VkSemaphoreWaitInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    info.semaphoreCount = 1;
+    info.pSemaphores = &ctx.uploads.timeline;
+    info.pValues = &value;
+    VkResult err = vkWaitSemaphores(ctx.device, &info, UINT64_MAX);
+    check_vk_result(err);
+    upload_queue_collect(ctx.uploads);
+  };
+  // Every upload releases the buffer to the graphics family: an untimed frame records the matching
+  // acquires before the next iteration releases it again
+  const auto acquire = [&] {
+    bench_frame(ctx, [] {});
+    bench_wait(ctx);
+  };
+  for (uint32_t i = 0; i < options.warmup; i++) {
+    upload();
+    acquire();
+  }
+  std::vector<double> samples;
+  samples.reserve(options.iterations);
+  for (uint32_t i = 0; i < options.iterations; i++) {
+    const auto begin = std::chrono::steady_clock::now();
+    upload();
+    samples.push_back(elapsed_ms(begin, std::chrono::steady_clock::now()));
+    acquire();
+  }
+  gpu_destroy_buffer(ctx.gpu, buffer);
+
+  ScenarioResult result;
+  result.name = "upload";
+  result.warmup = options.warmup;
+  result.iterations = options.iterations;
+  result.cpu = compute_stats(std::move(samples));
+  result.bytes_per_iteration = static_cast<double>(bytes);
+  return result;
+}
+
+// Demo, metrics and style editor: many widgets, tables and text in a few large windows
+void
+build_demo_window()
+{
+  const ImVec2 size = ImGui::GetIO().DisplaySize;
+  ImGui::SetNextWindowPos(ImVec2(0.0f, 0.0f), ImGuiCond_Always);
+  ImGui::SetNextWindowSize(ImVec2(size.x * 0.5f, size.y), ImGuiCond_Always);
+  ImGui::ShowDemoWindow();
+  ImGui::SetNextWindowPos(ImVec2(size.x * 0.5f, 0.0f), ImGuiCond_Always);
+  ImGui::SetNextWindowSize(ImVec2(size.x * 0.5f, size.y * 0.5f), ImGuiCond_Always);
+  ImGui::ShowMetricsWindow();
+  ImGui::SetNextWindowPos(ImVec2(size.x * 0.5f, size.y * 0.5f), ImGuiCond_Always);
+  ImGui::SetNextWindowSize(ImVec2(size.x * 0.5f, size.y * 0.5f), ImGuiCond_Always);
+  ImGui::Begin("Style editor");
+  ImGui::ShowStyleEditor();
+  ImGui::End();
+}
+
+// A grid of small windows, one draw list each
+void
+build_many_windows(uint32_t count)
+{
+  const ImVec2 size = ImGui::GetIO().DisplaySize;
+  const uint32_t columns = std::max(1u, static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count)))));
+  const uint32_t rows = (count + columns - 1) / std::max(1u, columns);
+  const ImVec2 cell(size.x / columns, size.y / std::max(1u, rows));
+  const int frame = ImGui::GetFrameCount();
+  float values[64];
+  for (uint32_t i = 0; i < count; i++) {
+    char name[32];
+    snprintf(name, sizeof(name), "Window %u", i);
+    ImGui::SetNextWindowPos(ImVec2(cell.x * (i % columns), cell.y * (i / columns)), ImGuiCond_Always);
+    ImGui::SetNextWindowSize(cell, ImGuiCond_Always);
+    ImGui::Begin(name);
+    ImGui::Text("frame %d", frame);
+    for (int v = 0; v < IM_ARRAYSIZE(values); v++)
+      values[v] = std::sin((v + frame + i) * 0.2f);
+    ImGui::PlotLines("##values", values, IM_ARRAYSIZE(values), 0, nullptr, -1.0f, 1.0f, ImVec2(0.0f, 40.0f));
+    float progress = static_cast<float>((frame + i) % 100) / 100.0f;
+    ImGui::ProgressBar(progress);
+    ImGui::End();
+  }
+}
+
+void
+write_json_string(FILE* file, const char* s)
+{
+  fputc('"', file);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\')
+      fprintf(file, "\\%c", *s);
+    else if (static_cast<unsigned char>(*s) < 0x20)
+      fprintf(file, "\\u%04x", static_cast<unsigned char>(*s));
+    else
+      fputc(*s, file);
+  }
+  fputc('"', file);
+}
+
+void
+write_json_stats(FILE* file, const char* name, const BenchStats& stats)
+{
+  fprintf(file,
+          "      \"%s\": { \"samples\": %u, \"min\": %.4f, \"median\": %.4f, \"p90\": %.4f, \"max\": %.4f, \"mean\": %.4f, \"stddev\": %.4f, \"mad\": %.4f }",
+          name,
+          stats.samples,
+          stats.min,
+          stats.median,
+          stats.p90,
+          stats.max,
+          stats.mean,
+          stats.stddev,
+          stats.mad);
+}
+
+// Scenario order and keys are fixed, so results diff cleanly between versions
+bool
+write_json(const char* path, const BenchOptions& options, const VkPhysicalDeviceProperties& properties, const std::vector<ScenarioResult>& results)
+{
+  FILE* file = fopen(path, "w");
+  if (file == nullptr) {
+    fprintf(stderr, "[bench] Failed to open %s\n", path);
+    return false;
+  }
+  fprintf(file, "{\n  \"format\": %u,\n  \"device\": ", bench_format_version);
+  write_json_string(file, properties.deviceName);
+  fprintf(file, ",\n  \"vendor_id\": %u,\n  \"device_id\": %u,\n  \"driver_version\": %u,\n", properties.vendorID, properties.deviceID, properties.driverVersion);
+  fprintf(file, "  \"width\": %u,\n  \"height\": %u,\n  \"scenarios\": [\n", options.width, options.height);
+  for (size_t i = 0; i < results.size(); i++) {
+    const ScenarioResult& result = results[i];
+    fprintf(file, "    {\n      \"name\": ");
+    write_json_string(file, result.name.c_str());
+    if (!result.error.empty()) {
+      fprintf(file, ",\n      \"error\": ");
+      write_json_string(file, result.error.c_str());
+      fprintf(file, "\n    }%s\n", i + 1 < results.size() ? "," : "");
+      continue;
+    }
+    fprintf(file, ",\n      \"warmup\": %u,\n      \"iterations\": %u,\n      \"unit\": \"ms\",\n", result.warmup, result.iterations);
+    write_json_stats(file, "cpu", result.cpu);
+    if (result.gpu.samples > 0) {
+      fprintf(file, ",\n");
+      write_json_stats(file, "gpu", result.gpu);
+    }
+    if (result.bytes_per_iteration > 0.0 && result.cpu.median > 0.0)
+      fprintf(file, ",\n      \"bytes\": %.0f,\n      \"mb_per_s\": %.2f", result.bytes_per_iteration, result.bytes_per_iteration / (1024.0 * 1024.0) / (result.cpu.median / 1000.0));
+    fprintf(file, "\n    }%s\n", i + 1 < results.size() ? "," : "");
+  }
+  fprintf(file, "  ]\n}\n");
+  fclose(file);
+  printf("[bench] Results written to %s\n", path);
+  return true;
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+  BenchOptions options;
+  if (!parse_options(argc, argv, options))
+    return EXIT_FAILURE;
+  const auto selected = [&options](const char* name) { return options.scenario.empty() || options.scenario == name; };
+
+  std::vector<ScenarioResult> results;
+  if (selected("startup"))
+    results.push_back(run_startup_scenario(options));
+
+  auto ctx = std::make_unique<BenchContext>();
+  setup_bench_context(*ctx, options);
+  if (selected("empty_frame"))
+    results.push_back(run_frame_scenario(*ctx, options, "empty_frame", [] {}));
+  if (selected("demo_window"))
+    results.push_back(run_frame_scenario(*ctx, options, "demo_window", build_demo_window));
+  if (selected("many_windows"))
+    results.push_back(run_frame_scenario(*ctx, options, "many_windows", [&options] { build_many_windows(options.windows); }));
+  if (selected("upload"))
+    results.push_back(run_upload_scenario(*ctx, options));
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(ctx->physical_device, &properties);
+  const bool written = write_json(options.out_path.c_str(), options, properties, results);
+  cleanup_bench_context(*ctx);
+  // A failed scenario is in the JSON with its error, but the run is not a valid result
+  const bool failed = std::any_of(results.begin(), results.end(), [](const ScenarioResult& result) { return !result.error.empty(); });
+  return written && !failed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,126 @@
+// Frustum culling, LOD selection and stream compaction of visible instances.
+// Included by cull.comp and cull_subgroup.comp, the latter defines USE_SUBGROUPS; the *_bindless
+// variants define USE_BINDLESS and read every buffer from the bindless table.
+
+layout(local_size_x = 64) in;
+
+struct Instance
+{
+  vec4 transform; // xy position, z bounding radius, w angular velocity
+  vec4 color;
+};
+
+// VkDrawIndexedIndirectCommand
+struct DrawCommand
+{
+  uint index_count;
+  uint instance_count;
+  uint first_index;
+  int vertex_offset;
+  uint first_instance;
+};
+
+layout(push_constant) uniform PushConstants
+{
+  vec2 scale; // aspect correction
+  float time;
+  uint instance_base;
+  vec2 camera;
+  float zoom;
+  uint instance_count;
+  float extent; // min(width, height) in pixels
+  uint batch_size; // multiple of the workgroup size
+  // Bindless table indices, dynamically uniform
+  uint instances_index;
+  uint visible_index;
+  uint commands_index;
+}
+pc;
+
+#ifdef USE_BINDLESS
+// The table's storage buffer array (bindless_buffer_binding), one block type per resource
+layout(std430, set = 0, binding = 1) readonly buffer Instances
+{
+  Instance data[];
+}
+instance_buffers[];
+
+layout(std430, set = 0, binding = 1) writeonly buffer Visible
+{
+  uint data[];
+}
+visible_buffers[];
+
+layout(std430, set = 0, binding = 1) buffer Commands
+{
+  DrawCommand data[];
+}
+command_buffers[];
+
+#define instances instance_buffers[pc.instances_index].data
+#define visible visible_buffers[pc.visible_index].data
+#define commands command_buffers[pc.commands_index].data
+#else
+layout(std430, set = 0, binding = 0) readonly buffer Instances
+{
+  Instance instances[];
+};
+
+layout(std430, set = 0, binding = 1) writeonly buffer Visible
+{
+  uint visible[];
+};
+
+layout(std430, set = 0, binding = 2) buffer Commands
+{
+  DrawCommand commands[];
+};
+#endif
+
+const uint lod_count = 5;
+
+uint
+select_lod(float pixels)
+{
+  return pixels >= 32.0 ? 0 : pixels >= 12.0 ? 1 : pixels >= 5.0 ? 2 : pixels >= 2.0 ? 3 : 4;
+}
+
+void
+main()
+{
+  // No early return: every invocation takes part in the subgroup operations
+  uint index = gl_GlobalInvocationID.x;
+  // Uniform across the subgroup: workgroups never straddle two batches
+  uint first_command = (index / pc.batch_size) * lod_count;
+  bool keep = false;
+  uint lod = 0;
+  if (index < pc.instance_count) {
+    vec4 transform = instances[index].transform;
+    vec2 center = (transform.xy - pc.camera) * pc.zoom * pc.scale;
+    vec2 radius = transform.z * pc.zoom * pc.scale;
+    keep = all(lessThanEqual(abs(center) - radius, vec2(1.0)));
+    lod = select_lod(transform.z * pc.zoom * pc.extent * 0.5);
+  }
+
+#ifdef USE_SUBGROUPS
+  // One atomic per subgroup and LOD instead of one per visible instance
+  for (uint l = 0; l < lod_count; l++) {
+    bool take = keep && lod == l;
+    uvec4 ballot = subgroupBallot(take);
+    uint count = subgroupBallotBitCount(ballot);
+    if (count == 0)
+      continue;
+    uint base = 0;
+    if (subgroupElect())
+      base = atomicAdd(commands[first_command + l].instance_count, count);
+    base = subgroupBroadcastFirst(base);
+    if (take)
+      visible[(first_command + l) * pc.batch_size + base + subgroupBallotExclusiveBitCount(ballot)] = index;
+  }
+#else
+  if (keep) {
+    uint slot = atomicAdd(commands[first_command + lod].instance_count, 1);
+    visible[(first_command + lod) * pc.batch_size + slot] = index;
+  }
+#endif
+}
@@ -0,0 +1,69 @@
+// Instanced mesh vertex shader.
+// Included by mesh.vert and mesh_bindless.vert, the latter defines USE_BINDLESS.
+
+layout(location = 0) in vec2 in_position;
+
+struct Instance
+{
+  vec4 transform; // xy position, z bounding radius, w angular velocity
+  vec4 color;
+};
+
+layout(push_constant) uniform PushConstants
+{
+  vec2 scale; // aspect correction
+  float time;
+  uint instance_base; // only used when drawIndirectFirstInstance is unsupported
+  vec2 camera;
+  float zoom;
+  uint instance_count;
+  float extent;
+  uint batch_size;
+  // Bindless table indices, dynamically uniform
+  uint instances_index;
+  uint visible_index;
+  uint commands_index;
+}
+pc;
+
+#ifdef USE_BINDLESS
+// The table's storage buffer array (bindless_buffer_binding), one block type per resource
+layout(std430, set = 0, binding = 1) readonly buffer Instances
+{
+  Instance data[];
+}
+instance_buffers[];
+
+layout(std430, set = 0, binding = 1) readonly buffer Visible
+{
+  uint data[];
+}
+visible_buffers[];
+
+#define instances instance_buffers[pc.instances_index].data
+#define visible visible_buffers[pc.visible_index].data
+#else
+layout(std430, set = 0, binding = 0) readonly buffer Instances
+{
+  Instance instances[];
+};
+
+// Written by the cull pass, one region per (batch, LOD)
+layout(std430, set = 0, binding = 1) readonly buffer Visible
+{
+  uint visible[];
+};
+#endif
+
+layout(location = 0) out vec4 out_color;
+
+void
+main()
+{
+  // gl_InstanceIndex already includes the draw's firstInstance
+  Instance instance = instances[visible[pc.instance_base + gl_InstanceIndex]];
+  float angle = instance.transform.w * pc.time;
+  vec2 p = mat2(cos(angle), sin(angle), -sin(angle), cos(angle)) * in_position * instance.transform.z;
+  gl_Position = vec4((instance.transform.xy - pc.camera + p) * pc.zoom * pc.scale, 0.0, 1.0);
+  out_color = instance.color;
+}
@@ -0,0 +1,464 @@
+#include "app.hpp"
+
+#include "frame_pacing.hpp" // present_mode_name
+#include "imgui.h"
+#include "swapchain.hpp"
+#include "vulkan_utils.hpp"
+#include <SDL2/SDL_vulkan.h>
+
+#include <algorithm>
+#include <stdio.h>  // printf, fprintf
+#include <stdlib.h> // exit
+
+#ifdef _DEBUG
+static VKAPI_ATTR VkBool32 VKAPI_CALL
+debug_report(VkDebugReportFlagsEXT flags, VkDebugReportObjectTypeEXT objectType, uint64_t object, size_t location, int32_t messageCode, const char* pLayerPrefix, const char* pMessage, void* pUserData)
+{
+  (void)flags;
+  (void)object;
+  (void)location;
+  (void)messageCode;
+  (void)pUserData;
+  (void)pLayerPrefix; // Unused arguments
+  fprintf(stderr, "[vulkan] Debug report from ObjectType: %i\nMessage: %s\n\n", objectType, pMessage);
+  return VK_FALSE;
+}
+#endif // _DEBUG
+
+bool
+init_sdl2()
+{
+  if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_GAMECONTROLLER) != 0) {
+    printf("Error: %s\n", SDL_GetError());
+    return false;
+  }
+  printf("(init) sdl2 success\n");
+  return true;
+}
+
+SDL_Window*
+init_sdl2_window(const std::string& window, int32_t x, int32_t y)
+{
+  SDL_WindowFlags window_flags = (SDL_WindowFlags)(SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI);
+  return SDL_CreateWindow(window.c_str(), SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, x, y, window_flags);
+}
+
+void
+sdl2_handle_quit_event(SDL_Window* window, const SDL_Event& event, bool& running)
+{
+  if (event.type == SDL_QUIT)
+    running = false;
+
+  if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_CLOSE && event.window.windowID == SDL_GetWindowID(window))
+    running = false;
+
+  if (event.type == SDL_KEYDOWN) {
+    switch (event.key.keysym.sym) {
+      case SDLK_ESCAPE:
+        running = false;
+        break;
+    }
+  }
+}
+
+void
+setup_vulkan(const std::vector<const char*>& extensions,
+             const std::vector<const char*>& device_extensions,
+             // instance
+             VkInstance& instance,
+             VkAllocationCallbacks* allocator,
+             VkDebugReportCallbackEXT& reporter,
+             // surface, null window for offscreen rendering
+             SDL_Window* window,
+             VkSurfaceKHR& surface,
+             // device
+             VkPhysicalDevice& physical_device,
+             VkDevice& device,
+             std::optional<uint32_t>& queue_family,
+             VkQueue& queue,
+             DeviceQueues& queues,
+             const char* device_override,
+             VkDescriptorPool& descriptor_pool)
+{
+  VkResult err;
+
+  // Create vulkan instance
+  {
+    // 1.2 for timeline semaphores (VK_KHR_timeline_semaphore promoted to core)
+    VkApplicationInfo app_info{};
+    app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    app_info.pApplicationName = "proj_vulkan_triangle";
+    app_info.apiVersion = VK_API_VERSION_1_2;
+
+    VkInstanceCreateInfo create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    create_info.pApplicationInfo = &app_info;
+    create_info.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    create_info.ppEnabledExtensionNames = extensions.data();
+#ifdef _DEBUG
+    // Enabling validation layers
+    const char* layers[] = { "VK_LAYER_KHRONOS_validation" };
+    create_info.enabledLayerCount = 1;
+    create_info.ppEnabledLayerNames = layers;
+    // Enable debug report extension
+    // (we need additional storage, so we duplicate the user array to add our new extension to it)
+    std::vector<const char*> extensions_ext(extensions.size() + 1);
+    std::copy(extensions.begin(), extensions.end(), extensions_ext.begin());
+    extensions_ext[extensions.size()] = "VK_EXT_debug_report";
+    create_info.enabledExtensionCount = static_cast<uint32_t>(extensions_ext.size());
+    create_info.ppEnabledExtensionNames = extensions_ext.data();
+
+    // Create vulkan instance
+    err = vkCreateInstance(&create_info, allocator, &instance);
+    check_vk_result(err);
+
+    // Get the function pointer (required for any extensions)
+    auto vkCreateDebugReportCallbackEXT = (PFN_vkCreateDebugReportCallbackEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugReportCallbackEXT");
+    IM_ASSERT(vkCreateDebugReportCallbackEXT != NULL);
+
+    // Setup the debug report callback
+    VkDebugReportCallbackCreateInfoEXT debug_report_ci = {};
+    debug_report_ci.sType = VK_STRUCTURE_TYPE_DEBUG_REPORT_CALLBACK_CREATE_INFO_EXT;
+    debug_report_ci.flags = VK_DEBUG_REPORT_ERROR_BIT_EXT | VK_DEBUG_REPORT_WARNING_BIT_EXT | VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT;
+    debug_report_ci.pfnCallback = debug_report;
+    debug_report_ci.pUserData = NULL;
+    err = vkCreateDebugReportCallbackEXT(instance, &debug_report_ci, allocator, &reporter);
+    check_vk_result(err);
+#else
+    // Create Vulkan Instance without any debug feature
+    err = vkCreateInstance(&create_info, allocator, &instance);
+    check_vk_result(err);
+    IM_UNUSED(debug_report);
+#endif
+  }
+
+  // Window surface before the GPU, so devices that cannot present to it are skipped
+  surface = VK_NULL_HANDLE;
+  if (window && SDL_Vulkan_CreateSurface(window, instance, &surface) == 0) {
+    fprintf(stderr, "Error failed to create SDL_Vulkan surface: %s\n", SDL_GetError());
+    exit(-1);
+  }
+
+  // Select GPU: highest score, unless forced by --device / VT_DEVICE
+  physical_device = select_physical_device(instance, device_extensions, surface, device_override);
+
+  // Separate graphics, async compute and transfer queues where the hardware has them
+  select_queue_families(physical_device, surface, queues);
+  queue_family = queues.graphics_family;
+
+  // Create logical device
+  {
+    std::vector<VkDeviceQueueCreateInfo> queue_info;
+    device_queue_create_infos(queues, queue_info);
+    // Indirect draws: batch every mesh into one call when supported
+    VkPhysicalDeviceFeatures supported;
+    vkGetPhysicalDeviceFeatures(physical_device, &supported);
+    VkPhysicalDeviceFeatures features = {};
+    features.multiDrawIndirect = supported.multiDrawIndirect;
+    features.drawIndirectFirstInstance = supported.drawIndirectFirstInstance;
+    // Bindless storage buffers are indexed with push constants
+    features.shaderStorageBufferArrayDynamicIndexing = supported.shaderStorageBufferArrayDynamicIndexing;
+    // Descriptor indexing for the bindless table, when supported
+    VkPhysicalDeviceVulkan12Features supported12 = {};
+    supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 supported2 = {};
+    supported2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported2.pNext = &supported12;
+    vkGetPhysicalDeviceFeatures2(physical_device, &supported2);
+    VkPhysicalDeviceVulkan12Features features12 = {};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    features12.timelineSemaphore = VK_TRUE;
+    features12.runtimeDescriptorArray = supported12.runtimeDescriptorArray;
+    features12.descriptorBindingPartiallyBound = supported12.descriptorBindingPartiallyBound;
+    features12.descriptorBindingSampledImageUpdateAfterBind = supported12.descriptorBindingSampledImageUpdateAfterBind;
+    features12.descriptorBindingStorageBufferUpdateAfterBind = supported12.descriptorBindingStorageBufferUpdateAfterBind;
+    features12.shaderSampledImageArrayNonUniformIndexing = supported12.shaderSampledImageArrayNonUniformIndexing;
+    VkDeviceCreateInfo create_info = {};
+    create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    create_info.pNext = &features12;
+    create_info.pEnabledFeatures = &features;
+    create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_info.size());
+    create_info.pQueueCreateInfos = queue_info.data();
+    create_info.enabledExtensionCount = static_cast<uint32_t>(device_extensions.size());
+    create_info.ppEnabledExtensionNames = device_extensions.data();
+    err = vkCreateDevice(physical_device, &create_info, allocator, &device);
+    check_vk_result(err);
+    get_device_queues(device, queues);
+    queue = queues.graphics;
+  }
+
+  // Descriptor pool for ImGui's textures only: per-frame sets come from the DescriptorAllocator,
+  // long-lived resources from the BindlessTable
+  {
+    VkDescriptorPoolSize pool_sizes[] = { { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 16 } };
+    VkDescriptorPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+    pool_info.maxSets = 16;
+    pool_info.poolSizeCount = (uint32_t)IM_ARRAYSIZE(pool_sizes);
+    pool_info.pPoolSizes = pool_sizes;
+    err = vkCreateDescriptorPool(device, &pool_info, allocator, &descriptor_pool);
+    check_vk_result(err);
+  }
+}
+
+void
+setup_vulkan_window(ImGui_ImplVulkanH_Window* wd,
+                    VkSurfaceKHR surface,
+                    uint32_t width,
+                    uint32_t height,
+                    VkAllocationCallbacks* allocator,
+                    VkPhysicalDevice& physical_device,
+                    VkDevice& device,
+                    std::optional<uint32_t>& queue_family,
+                    VkPresentModeKHR present_mode,
+                    const int& min_image_count,
+                    DeletionQueue& deletions)
+{
+  wd->Surface = surface;
+
+  // Check for WSI support
+  VkBool32 res;
+  vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, queue_family.value(), wd->Surface, &res);
+  if (res != VK_TRUE) {
+    fprintf(stderr, "Error no WSI support on physical device 0\n");
+    exit(-1);
+  }
+
+  // Select Surface Format
+  const VkFormat image_format[] = { VK_FORMAT_B8G8R8A8_UNORM, VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_B8G8R8_UNORM, VK_FORMAT_R8G8B8_UNORM };
+  const VkColorSpaceKHR colour_space = VK_COLORSPACE_SRGB_NONLINEAR_KHR;
+  wd->SurfaceFormat = ImGui_ImplVulkanH_SelectSurfaceFormat(physical_device, wd->Surface, image_format, (size_t)IM_ARRAYSIZE(image_format), colour_space);
+
+  // Present mode, checked against the surface by setup_frame_pacing
+  wd->PresentMode = present_mode;
+  printf("[vulkan] Selected PresentMode = %s\n", present_mode_name(wd->PresentMode));
+
+  // Create SwapChain, RenderPass, Framebuffer, etc.
+  resize_vulkan_swapchain(wd, physical_device, device, width, height, min_image_count, allocator, deletions, 0);
+}
+
+void
+cleanup_vulkan(VkInstance& instance, VkAllocationCallbacks* allocator, VkDebugReportCallbackEXT& reporter, VkDevice& device, VkDescriptorPool& descriptor_pool)
+{
+  vkDestroyDescriptorPool(device, descriptor_pool, allocator);
+
+#ifdef _DEBUG
+  // Remove the debug report callback
+  auto vkDestroyDebugReportCallbackEXT = (PFN_vkDestroyDebugReportCallbackEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugReportCallbackEXT");
+  vkDestroyDebugReportCallbackEXT(instance, reporter, allocator);
+#endif // _DEBUG
+
+  vkDestroyDevice(device, allocator);
+  vkDestroyInstance(instance, allocator);
+}
+
+void
+cleanup_vulkan_window(VkInstance& instance, VkDevice& device, ImGui_ImplVulkanH_Window& main_window_data, VkAllocationCallbacks* allocator)
+{
+  // SDL_Vulkan_CreateSurface() creates the surface without allocation callbacks, so it must be destroyed without them
+  VkSurfaceKHR surface = main_window_data.Surface;
+  main_window_data.Surface = VK_NULL_HANDLE;
+  cleanup_vulkan_swapchain(device, main_window_data, allocator);
+  vkDestroySurfaceKHR(instance, surface, nullptr);
+}
+
+bool
+frame_render(ImGui_ImplVulkanH_Window* wd,
+             ImDrawData* draw_data,
+             bool draw_main,
+             VkQueue& queue,
+             VkDevice& device,
+             FrameScheduler& scheduler,
+             UploadQueue& uploads,
+             MeshRenderer& meshes,
+             JobSystem& jobs,
+             CommandRecorder& recorder,
+             DescriptorAllocator& descriptors,
+             UiRenderer* ui,
+             ViewportRenderer* viewports,
+             FrameStream* stream,
+             FrameTimings& timings,
+             bool& rebuild_swapchain)
+{
+  VkResult err;
+
+  // Wait for this frame slot's previous submission (frames_in_flight frames ago), not for the acquired image
+  FrameContext* fc = nullptr;
+  {
+    FrameTimingScope scope(timings, FrameStage::wait_gpu);
+    fc = &frame_scheduler_begin(scheduler, device);
+  }
+  // the previous use of this slot's queries has finished
+  frame_timings_collect_gpu(timings, device, scheduler.frame_slot);
+  command_recorder_begin_frame(recorder, scheduler.frame_slot);
+  descriptor_allocator_begin_frame(descriptors, scheduler.frame_slot);
+
+  // Headless targets have no swapchain: the offscreen image belongs to the frame slot
+  const bool headless = wd->Swapchain == VK_NULL_HANDLE;
+  if (headless)
+    wd->FrameIndex = scheduler.frame_slot;
+  else if (draw_main) {
+    err = vkAcquireNextImageKHR(device, wd->Swapchain, UINT64_MAX, fc->image_acquired, VK_NULL_HANDLE, &wd->FrameIndex);
+    if (err == VK_ERROR_OUT_OF_DATE_KHR) {
+      rebuild_swapchain = true;
+      draw_main = false;
+    }
+    // VK_SUBOPTIMAL_KHR still acquired an image (and will signal the semaphore), render it and let present report it
+    else if (err != VK_SUBOPTIMAL_KHR)
+      check_vk_result(err);
+  }
+  // Platform windows acquire theirs too and are drawn in the same submission, even with the main window minimized
+  const uint32_t viewport_count = viewports ? viewport_renderer_acquire(*viewports, scheduler.frame_slot) : 0;
+  if (!draw_main && viewport_count == 0)
+    return false;
+
+  VkCommandBuffer command_buffer = fc->command_buffer;
+
+  const double record_begin_ms = frame_timings_now_ms(timings);
+  {
+    VkCommandBufferBeginInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    info.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    err = vkBeginCommandBuffer(command_buffer, &info);
+    check_vk_result(err);
+  }
+  frame_timings_write_gpu_begin(timings, command_buffer, scheduler.frame_slot);
+
+  // Uploads recorded since the last frame go out now; this frame acquires whatever was flushed before
+  upload_queue_collect(uploads);
+  upload_queue_flush(uploads);
+  VkPipelineStageFlags upload_wait_stage = 0;
+  const uint64_t upload_wait_value = upload_queue_record_acquires(uploads, command_buffer, upload_wait_stage);
+
+  if (draw_main) {
+    ImGui_ImplVulkanH_Frame* fd = &wd->Frames[wd->FrameIndex];
+    // GPU culling and LOD selection, before the render pass that consumes its draw commands
+    mesh_renderer_cull(meshes, command_buffer, scheduler.frame_slot, wd->Width, wd->Height);
+    {
+      VkRenderPassBeginInfo info = {};
+      info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+      info.renderPass = wd->RenderPass;
+      info.framebuffer = fd->Framebuffer;
+      info.renderArea.extent.width = wd->Width;
+      info.renderArea.extent.height = wd->Height;
+      info.clearValueCount = 1;
+      info.pClearValues = &wd->ClearValue;
+      vkCmdBeginRenderPass(command_buffer, &info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    }
+
+    // The render pass is filled by secondaries: mesh batch ranges recorded on the job system,
+    // dear imgui on this thread meanwhile. Scene first, the UI draws on top.
+    VkCommandBufferInheritanceInfo inheritance = {};
+    inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance.renderPass = wd->RenderPass;
+    inheritance.subpass = 0;
+    inheritance.framebuffer = fd->Framebuffer;
+
+    const uint32_t mesh_tasks = meshes.instance_count > 0 ? std::min(meshes.batch_count, jobs.thread_count * 2) : 0;
+    recorder.secondaries.resize(mesh_tasks + 1);
+    const uint32_t frame_slot = scheduler.frame_slot;
+    const JobFunction record_meshes = [&](uint32_t task, uint32_t thread) {
+      const uint32_t first_batch = task * meshes.batch_count / mesh_tasks;
+      const uint32_t end_batch = (task + 1) * meshes.batch_count / mesh_tasks;
+      VkCommandBuffer secondary = command_recorder_begin(recorder, thread, frame_slot, inheritance);
+      mesh_renderer_draw(meshes, secondary, frame_slot, wd->Width, wd->Height, first_batch, end_batch - first_batch);
+      command_recorder_end(secondary);
+      recorder.secondaries[task] = secondary;
+    };
+    JobCounter counter;
+    job_system_run(jobs, mesh_tasks, record_meshes, counter);
+    if (ui)
+      recorder.secondaries[mesh_tasks] = ui_renderer_record(*ui, draw_data, frame_slot, inheritance, frame_scheduler_signal_value(scheduler));
+    else {
+      VkCommandBuffer secondary = command_recorder_begin(recorder, 0, frame_slot, inheritance);
+      ImGui_ImplVulkan_RenderDrawData(draw_data, secondary);
+      command_recorder_end(secondary);
+      recorder.secondaries[mesh_tasks] = secondary;
+    }
+    job_system_wait(jobs, counter);
+    vkCmdExecuteCommands(command_buffer, static_cast<uint32_t>(recorder.secondaries.size()), recorder.secondaries.data());
+
+    vkCmdEndRenderPass(command_buffer);
+
+    // Recording: copied into a readback buffer in this submission, written out once the timeline passes it
+    if (stream) {
+      const VkImageLayout layout = headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+      frame_stream_record(*stream, command_buffer, fd->Backbuffer, layout, wd->SurfaceFormat.format, wd->Width, wd->Height, frame_scheduler_signal_value(scheduler));
+    }
+  }
+  if (viewports)
+    viewport_renderer_record(*viewports, command_buffer, scheduler);
+
+  // Submit command buffer
+  frame_timings_write_gpu_end(timings, command_buffer, scheduler.frame_slot);
+  {
+    // Wait on the acquired images and on the upload timeline when this frame consumes uploads;
+    // signal render_complete for present and the timeline for pacing. Platform windows added theirs while recording.
+    SubmitSemaphores& submit = scheduler.submit;
+    if (draw_main && !headless) {
+      submit_semaphores_wait(submit, fc->image_acquired, 0, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+      submit_semaphores_signal(submit, scheduler.render_complete[wd->FrameIndex], 0);
+    }
+    if (upload_wait_value > 0)
+      submit_semaphores_wait(submit, uploads.timeline, upload_wait_value, upload_wait_stage);
+    submit_semaphores_signal(submit, scheduler.timeline, frame_scheduler_signal_value(scheduler));
+
+    VkTimelineSemaphoreSubmitInfo timeline_info = {};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.waitSemaphoreValueCount = static_cast<uint32_t>(submit.wait_values.size());
+    timeline_info.pWaitSemaphoreValues = submit.wait_values.data();
+    timeline_info.signalSemaphoreValueCount = static_cast<uint32_t>(submit.signal_values.size());
+    timeline_info.pSignalSemaphoreValues = submit.signal_values.data();
+
+    VkSubmitInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    info.pNext = &timeline_info;
+    info.waitSemaphoreCount = static_cast<uint32_t>(submit.wait.size());
+    info.pWaitSemaphores = submit.wait.data();
+    info.pWaitDstStageMask = submit.wait_stages.data();
+    info.commandBufferCount = 1;
+    info.pCommandBuffers = &command_buffer;
+    info.signalSemaphoreCount = static_cast<uint32_t>(submit.signal.size());
+    info.pSignalSemaphores = submit.signal.data();
+
+    err = vkEndCommandBuffer(command_buffer);
+    check_vk_result(err);
+    frame_timings_add_cpu(timings, FrameStage::record, record_begin_ms, frame_timings_now_ms(timings));
+
+    FrameTimingScope scope(timings, FrameStage::submit);
+    err = vkQueueSubmit(queue, 1, &info, VK_NULL_HANDLE);
+    check_vk_result(err);
+    frame_scheduler_end(scheduler);
+  }
+  return true;
+}
+
+void
+frame_present(ImGui_ImplVulkanH_Window* wd, bool draw_main, VkQueue& queue, FrameScheduler& scheduler, ViewportRenderer* viewports, FrameTimings& timings, bool& rebuild_swapchain)
+{
+  // Not acquired this frame: out of date, rebuilding or minimized
+  const bool present_main = draw_main && !rebuild_swapchain && wd->Swapchain != VK_NULL_HANDLE;
+  if (!present_main && !viewports)
+    return;
+  FrameTimingScope scope(timings, FrameStage::present);
+  VkSemaphore render_complete_semaphore = present_main ? scheduler.render_complete[wd->FrameIndex] : VK_NULL_HANDLE;
+  VkResult err;
+  if (viewports)
+    err = viewport_renderer_present(*viewports, queue, present_main ? wd->Swapchain : VK_NULL_HANDLE, wd->FrameIndex, render_complete_semaphore);
+  else {
+    VkPresentInfoKHR info = {};
+    info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    info.waitSemaphoreCount = 1;
+    info.pWaitSemaphores = &render_complete_semaphore;
+    info.swapchainCount = 1;
+    info.pSwapchains = &wd->Swapchain;
+    info.pImageIndices = &wd->FrameIndex;
+    err = vkQueuePresentKHR(queue, &info);
+  }
+  if (err == VK_ERROR_OUT_OF_DATE_KHR || err == VK_SUBOPTIMAL_KHR) {
+    rebuild_swapchain = true;
+    return;
+  }
+  check_vk_result(err);
+}
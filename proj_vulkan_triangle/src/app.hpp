@@ -0,0 +1,98 @@
+#pragma once
+
+#include "backends/imgui_impl_vulkan.h"
+#include "command_recorder.hpp"
+#include "deletion_queue.hpp"
+#include "descriptors.hpp"
+#include "device_select.hpp"
+#include "frame_scheduler.hpp"
+#include "frame_stream.hpp"
+#include "frame_timings.hpp"
+#include "job_system.hpp"
+#include "mesh_renderer.hpp"
+#include "ui_renderer.hpp"
+#include "upload_queue.hpp"
+#include "viewport_renderer.hpp"
+#include <SDL2/SDL.h>
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Window, device and per-frame rendering shared by the app (main.cpp) and the benchmark (bench/).
+
+bool
+init_sdl2();
+
+SDL_Window*
+init_sdl2_window(const std::string& window, int32_t x, int32_t y);
+
+void
+sdl2_handle_quit_event(SDL_Window* window, const SDL_Event& event, bool& running);
+
+// Instance (with validation in _DEBUG), the window surface, the best or forced GPU that can present to it,
+// its device and queues, and ImGui's descriptor pool.
+void
+setup_vulkan(const std::vector<const char*>& extensions,
+             const std::vector<const char*>& device_extensions,
+             // instance
+             VkInstance& instance,
+             VkAllocationCallbacks* allocator,
+             VkDebugReportCallbackEXT& reporter,
+             // surface, null window for offscreen rendering
+             SDL_Window* window,
+             VkSurfaceKHR& surface,
+             // device
+             VkPhysicalDevice& physical_device,
+             VkDevice& device,
+             std::optional<uint32_t>& queue_family,
+             VkQueue& queue,
+             DeviceQueues& queues,
+             const char* device_override,
+             VkDescriptorPool& descriptor_pool);
+
+void
+setup_vulkan_window(ImGui_ImplVulkanH_Window* wd,
+                    VkSurfaceKHR surface,
+                    uint32_t width,
+                    uint32_t height,
+                    VkAllocationCallbacks* allocator,
+                    VkPhysicalDevice& physical_device,
+                    VkDevice& device,
+                    std::optional<uint32_t>& queue_family,
+                    VkPresentModeKHR present_mode,
+                    const int& min_image_count,
+                    DeletionQueue& deletions);
+
+void
+cleanup_vulkan(VkInstance& instance, VkAllocationCallbacks* allocator, VkDebugReportCallbackEXT& reporter, VkDevice& device, VkDescriptorPool& descriptor_pool);
+
+void
+cleanup_vulkan_window(VkInstance& instance, VkDevice& device, ImGui_ImplVulkanH_Window& main_window_data, VkAllocationCallbacks* allocator);
+
+// Records and submits one frame: meshes and draw_data into wd (swapchain or headless targets), plus the
+// batched platform windows when viewports is set. ui null renders through the backend. stream null records nothing.
+// Returns false when nothing was submitted (main image out of date or not drawn, and no platform windows).
+bool
+frame_render(ImGui_ImplVulkanH_Window* wd,
+             ImDrawData* draw_data,
+             bool draw_main,
+             VkQueue& queue,
+             VkDevice& device,
+             FrameScheduler& scheduler,
+             UploadQueue& uploads,
+             MeshRenderer& meshes,
+             JobSystem& jobs,
+             CommandRecorder& recorder,
+             DescriptorAllocator& descriptors,
+             UiRenderer* ui,
+             ViewportRenderer* viewports,
+             FrameStream* stream,
+             FrameTimings& timings,
+             bool& rebuild_swapchain);
+
+// Presents what frame_render acquired, nothing for headless targets.
+void
+frame_present(ImGui_ImplVulkanH_Window* wd, bool draw_main, VkQueue& queue, FrameScheduler& scheduler, ViewportRenderer* viewports, FrameTimings& timings, bool& rebuild_swapchain);
@@ -0,0 +1,76 @@
+#include "command_recorder.hpp"
+
+#include "vulkan_utils.hpp"
+
+void
+setup_command_recorder(CommandRecorder& recorder, VkDevice device, uint32_t queue_family, uint32_t thread_count, uint32_t frames_in_flight, VkAllocationCallbacks* allocator)
+{
+  recorder.device = device;
+  recorder.allocator = allocator;
+  recorder.thread_count = thread_count;
+  recorder.frames_in_flight = frames_in_flight;
+  recorder.pools.resize(thread_count * frames_in_flight);
+  for (ThreadCommandPool& pool : recorder.pools) {
+    VkCommandPoolCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    info.queueFamilyIndex = queue_family;
+    VkResult err = vkCreateCommandPool(device, &info, allocator, &pool.pool);
+    check_vk_result(err);
+  }
+}
+
+void
+cleanup_command_recorder(CommandRecorder& recorder)
+{
+  for (ThreadCommandPool& pool : recorder.pools)
+    vkDestroyCommandPool(recorder.device, pool.pool, recorder.allocator);
+  recorder.pools.clear();
+}
+
+void
+command_recorder_begin_frame(CommandRecorder& recorder, uint32_t frame_slot)
+{
+  for (uint32_t thread = 0; thread < recorder.thread_count; thread++) {
+    ThreadCommandPool& pool = recorder.pools[frame_slot * recorder.thread_count + thread];
+    if (pool.used == 0)
+      continue;
+    VkResult err = vkResetCommandPool(recorder.device, pool.pool, 0);
+    check_vk_result(err);
+    pool.used = 0;
+  }
+}
+
+VkCommandBuffer
+command_recorder_begin(CommandRecorder& recorder, uint32_t thread, uint32_t frame_slot, const VkCommandBufferInheritanceInfo& inheritance)
+{
+  VkResult err;
+  ThreadCommandPool& pool = recorder.pools[frame_slot * recorder.thread_count + thread];
+  if (pool.used == pool.buffers.size()) {
+    VkCommandBufferAllocateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    info.commandPool = pool.pool;
+    info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    info.commandBufferCount = 1;
+    VkCommandBuffer command_buffer;
+    err = vkAllocateCommandBuffers(recorder.device, &info, &command_buffer);
+    check_vk_result(err);
+    pool.buffers.push_back(command_buffer);
+  }
+  VkCommandBuffer command_buffer = pool.buffers[pool.used++];
+
+  VkCommandBufferBeginInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+  info.pInheritanceInfo = &inheritance;
+  err = vkBeginCommandBuffer(command_buffer, &info);
+  check_vk_result(err);
+  return command_buffer;
+}
+
+void
+command_recorder_end(VkCommandBuffer command_buffer)
+{
+  VkResult err = vkEndCommandBuffer(command_buffer);
+  check_vk_result(err);
+}
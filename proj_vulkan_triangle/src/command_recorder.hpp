@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+// Secondary command buffers for parallel recording.
+// Every (thread, frame slot) pair owns a command pool, so threads never share a pool and a
+// frame's pools are reset as a unit once the scheduler has waited for that slot. Buffers are
+// allocated on first use and recycled by the reset.
+
+struct ThreadCommandPool
+{
+  VkCommandPool pool = VK_NULL_HANDLE;
+  std::vector<VkCommandBuffer> buffers;
+  uint32_t used = 0;
+};
+
+struct CommandRecorder
+{
+  VkDevice device = VK_NULL_HANDLE;
+  VkAllocationCallbacks* allocator = nullptr;
+  uint32_t thread_count = 0;
+  uint32_t frames_in_flight = 0;
+  std::vector<ThreadCommandPool> pools; // [frame_slot * thread_count + thread]
+  std::vector<VkCommandBuffer> secondaries; // recorded for the current frame, in execution order
+};
+
+void
+setup_command_recorder(CommandRecorder& recorder, VkDevice device, uint32_t queue_family, uint32_t thread_count, uint32_t frames_in_flight, VkAllocationCallbacks* allocator);
+
+void
+cleanup_command_recorder(CommandRecorder& recorder);
+
+// Resets every thread's pool for the slot. No thread may be recording into it.
+void
+command_recorder_begin_frame(CommandRecorder& recorder, uint32_t frame_slot);
+
+// Begins a secondary that continues the render pass described by inheritance.
+VkCommandBuffer
+command_recorder_begin(CommandRecorder& recorder, uint32_t thread, uint32_t frame_slot, const VkCommandBufferInheritanceInfo& inheritance);
+
+void
+command_recorder_end(VkCommandBuffer command_buffer);
@@ -0,0 +1,22 @@
+#include "deletion_queue.hpp"
+
+void
+deletion_queue_push(DeletionQueue& queue, uint64_t value, std::function<void()> destroy)
+{
+  queue.entries.push_back({ value, std::move(destroy) });
+}
+
+void
+deletion_queue_collect(DeletionQueue& queue, uint64_t completed_value)
+{
+  while (!queue.entries.empty() && queue.entries.front().value <= completed_value) {
+    queue.entries.front().destroy();
+    queue.entries.pop_front();
+  }
+}
+
+void
+deletion_queue_flush(DeletionQueue& queue)
+{
+  deletion_queue_collect(queue, UINT64_MAX);
+}
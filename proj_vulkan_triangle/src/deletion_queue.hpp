@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+// Deferred destruction of GPU objects.
+// Objects that in-flight frames may still use are pushed with the frame scheduler's timeline value
+// that guarantees they are idle; collect runs (and drops) every entry the timeline has reached.
+
+struct DeletionQueue
+{
+  struct Entry
+  {
+    uint64_t value = 0;
+    std::function<void()> destroy;
+  };
+  std::deque<Entry> entries; // values are pushed in non-decreasing order
+};
+
+void
+deletion_queue_push(DeletionQueue& queue, uint64_t value, std::function<void()> destroy);
+
+void
+deletion_queue_collect(DeletionQueue& queue, uint64_t completed_value);
+
+// Destroys everything, the device must be idle.
+void
+deletion_queue_flush(DeletionQueue& queue);
@@ -0,0 +1,272 @@
+#include "descriptors.hpp"
+
+#include "vulkan_utils.hpp"
+
+#include <algorithm>
+#include <stdio.h>
+
+namespace {
+
+VkDescriptorPool
+create_pool(DescriptorAllocator& descriptors)
+{
+  std::vector<VkDescriptorPoolSize> sizes;
+  for (const DescriptorPoolRatio& ratio : descriptors.ratios)
+    sizes.push_back({ ratio.type, std::max(1u, static_cast<uint32_t>(ratio.per_set * descriptors.sets_per_pool)) });
+  VkDescriptorPoolCreateInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  info.maxSets = descriptors.sets_per_pool;
+  info.poolSizeCount = static_cast<uint32_t>(sizes.size());
+  info.pPoolSizes = sizes.data();
+  VkDescriptorPool pool;
+  VkResult err = vkCreateDescriptorPool(descriptors.device, &info, descriptors.allocator, &pool);
+  check_vk_result(err);
+  descriptors.pool_count++;
+  descriptors.sets_per_pool = std::min(descriptors.sets_per_pool * 2, descriptors.max_sets_per_pool);
+  return pool;
+}
+
+VkDescriptorPool
+next_pool(DescriptorAllocator& descriptors, FrameDescriptorPools& frame)
+{
+  if (!frame.ready.empty()) {
+    VkDescriptorPool pool = frame.ready.back();
+    frame.ready.pop_back();
+    return pool;
+  }
+  return create_pool(descriptors);
+}
+
+uint32_t
+take_index(std::vector<uint32_t>& free_list, uint32_t& count, uint32_t capacity)
+{
+  if (!free_list.empty()) {
+    const uint32_t index = free_list.back();
+    free_list.pop_back();
+    return index;
+  }
+  return count < capacity ? count++ : bindless_invalid;
+}
+
+} // namespace
+
+void
+setup_descriptor_allocator(DescriptorAllocator& descriptors, VkDevice device, uint32_t frames_in_flight, const std::vector<DescriptorPoolRatio>& ratios, VkAllocationCallbacks* allocator)
+{
+  descriptors.device = device;
+  descriptors.allocator = allocator;
+  descriptors.ratios = ratios;
+  descriptors.frames_in_flight = frames_in_flight;
+  for (uint32_t i = 0; i < frames_in_flight; i++)
+    descriptors.frames[i].current = create_pool(descriptors);
+}
+
+void
+cleanup_descriptor_allocator(DescriptorAllocator& descriptors)
+{
+  for (uint32_t i = 0; i < descriptors.frames_in_flight; i++) {
+    FrameDescriptorPools& frame = descriptors.frames[i];
+    vkDestroyDescriptorPool(descriptors.device, frame.current, descriptors.allocator);
+    for (VkDescriptorPool pool : frame.full)
+      vkDestroyDescriptorPool(descriptors.device, pool, descriptors.allocator);
+    for (VkDescriptorPool pool : frame.ready)
+      vkDestroyDescriptorPool(descriptors.device, pool, descriptors.allocator);
+    frame = FrameDescriptorPools{};
+  }
+  descriptors.pool_count = 0;
+}
+
+void
+descriptor_allocator_begin_frame(DescriptorAllocator& descriptors, uint32_t frame_slot)
+{
+  FrameDescriptorPools& frame = descriptors.frames[frame_slot];
+  VkResult err = vkResetDescriptorPool(descriptors.device, frame.current, 0);
+  check_vk_result(err);
+  for (VkDescriptorPool pool : frame.full) {
+    err = vkResetDescriptorPool(descriptors.device, pool, 0);
+    check_vk_result(err);
+    frame.ready.push_back(pool);
+  }
+  frame.full.clear();
+  descriptors.sets_this_frame = 0;
+}
+
+VkDescriptorSet
+descriptor_allocator_allocate(DescriptorAllocator& descriptors, uint32_t frame_slot, VkDescriptorSetLayout layout)
+{
+  FrameDescriptorPools& frame = descriptors.frames[frame_slot];
+  VkDescriptorSetAllocateInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  info.descriptorPool = frame.current;
+  info.descriptorSetCount = 1;
+  info.pSetLayouts = &layout;
+  VkDescriptorSet set = VK_NULL_HANDLE;
+  VkResult err = vkAllocateDescriptorSets(descriptors.device, &info, &set);
+  if (err == VK_ERROR_OUT_OF_POOL_MEMORY || err == VK_ERROR_FRAGMENTED_POOL) {
+    // Chain a new pool, this one is reset with the rest of the frame
+    frame.full.push_back(frame.current);
+    frame.current = next_pool(descriptors, frame);
+    info.descriptorPool = frame.current;
+    err = vkAllocateDescriptorSets(descriptors.device, &info, &set);
+  }
+  check_vk_result(err);
+  descriptors.sets_this_frame++;
+  return set;
+}
+
+bool
+setup_bindless_table(BindlessTable& table, VkPhysicalDevice physical_device, VkDevice device, DeletionQueue& deletions, VkAllocationCallbacks* allocator)
+{
+  VkResult err;
+  table.device = device;
+  table.allocator = allocator;
+  table.deletions = &deletions;
+
+  // setup_vulkan enables these whenever the device supports them
+  VkPhysicalDeviceVulkan12Features features12 = {};
+  features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  VkPhysicalDeviceFeatures2 features = {};
+  features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features.pNext = &features12;
+  vkGetPhysicalDeviceFeatures2(physical_device, &features);
+  if (!features12.runtimeDescriptorArray || !features12.descriptorBindingPartiallyBound || !features12.descriptorBindingSampledImageUpdateAfterBind ||
+      !features12.descriptorBindingStorageBufferUpdateAfterBind || !features12.shaderSampledImageArrayNonUniformIndexing || !features.features.shaderStorageBufferArrayDynamicIndexing) {
+    printf("[vulkan] Descriptor indexing not supported, no bindless table\n");
+    return false;
+  }
+
+  VkPhysicalDeviceVulkan12Properties properties12 = {};
+  properties12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+  VkPhysicalDeviceProperties2 properties = {};
+  properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+  properties.pNext = &properties12;
+  vkGetPhysicalDeviceProperties2(physical_device, &properties);
+  // Combined image samplers count as both a sampled image and a sampler
+  table.texture_capacity = std::min({ 16384u,
+                                      properties12.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                                      properties12.maxDescriptorSetUpdateAfterBindSampledImages,
+                                      properties12.maxPerStageDescriptorUpdateAfterBindSamplers,
+                                      properties12.maxDescriptorSetUpdateAfterBindSamplers });
+  table.buffer_capacity = std::min({ 16384u, properties12.maxPerStageDescriptorUpdateAfterBindStorageBuffers, properties12.maxDescriptorSetUpdateAfterBindStorageBuffers });
+  // Both arrays are visible to every stage, and together count against one per-stage resource limit
+  const uint32_t max_resources = properties12.maxPerStageUpdateAfterBindResources;
+  if (table.texture_capacity + table.buffer_capacity > max_resources) {
+    table.buffer_capacity = std::min(table.buffer_capacity, max_resources / 2);
+    table.texture_capacity = std::min(table.texture_capacity, max_resources - table.buffer_capacity);
+  }
+
+  {
+    VkDescriptorSetLayoutBinding bindings[2] = {};
+    bindings[0].binding = bindless_texture_binding;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].descriptorCount = table.texture_capacity;
+    bindings[0].stageFlags = VK_SHADER_STAGE_ALL;
+    bindings[1].binding = bindless_buffer_binding;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[1].descriptorCount = table.buffer_capacity;
+    bindings[1].stageFlags = VK_SHADER_STAGE_ALL;
+    const VkDescriptorBindingFlags binding_flags[2] = {
+      VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+      VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+    };
+    VkDescriptorSetLayoutBindingFlagsCreateInfo flags_info = {};
+    flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    flags_info.bindingCount = 2;
+    flags_info.pBindingFlags = binding_flags;
+    VkDescriptorSetLayoutCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    info.pNext = &flags_info;
+    info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    info.bindingCount = 2;
+    info.pBindings = bindings;
+    err = vkCreateDescriptorSetLayout(device, &info, allocator, &table.layout);
+    check_vk_result(err);
+  }
+  {
+    const VkDescriptorPoolSize sizes[] = { { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, table.texture_capacity }, { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, table.buffer_capacity } };
+    VkDescriptorPoolCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    info.maxSets = 1;
+    info.poolSizeCount = 2;
+    info.pPoolSizes = sizes;
+    err = vkCreateDescriptorPool(device, &info, allocator, &table.pool);
+    check_vk_result(err);
+  }
+  {
+    VkDescriptorSetAllocateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    info.descriptorPool = table.pool;
+    info.descriptorSetCount = 1;
+    info.pSetLayouts = &table.layout;
+    err = vkAllocateDescriptorSets(device, &info, &table.set);
+    check_vk_result(err);
+  }
+  printf("[vulkan] Bindless table: %u textures, %u buffers\n", table.texture_capacity, table.buffer_capacity);
+  return true;
+}
+
+void
+cleanup_bindless_table(BindlessTable& table)
+{
+  vkDestroyDescriptorPool(table.device, table.pool, table.allocator);
+  vkDestroyDescriptorSetLayout(table.device, table.layout, table.allocator);
+  table.pool = VK_NULL_HANDLE;
+  table.layout = VK_NULL_HANDLE;
+  table.set = VK_NULL_HANDLE;
+  table.free_textures.clear();
+  table.free_buffers.clear();
+  table.texture_count = 0;
+  table.buffer_count = 0;
+}
+
+uint32_t
+bindless_add_texture(BindlessTable& table, VkImageView view, VkSampler sampler, VkImageLayout layout)
+{
+  const uint32_t index = take_index(table.free_textures, table.texture_count, table.texture_capacity);
+  if (index == bindless_invalid)
+    return index;
+  VkDescriptorImageInfo image_info = { sampler, view, layout };
+  VkWriteDescriptorSet write = {};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.dstSet = table.set;
+  write.dstBinding = bindless_texture_binding;
+  write.dstArrayElement = index;
+  write.descriptorCount = 1;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  write.pImageInfo = &image_info;
+  vkUpdateDescriptorSets(table.device, 1, &write, 0, NULL);
+  return index;
+}
+
+uint32_t
+bindless_add_buffer(BindlessTable& table, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+  const uint32_t index = take_index(table.free_buffers, table.buffer_count, table.buffer_capacity);
+  if (index == bindless_invalid)
+    return index;
+  VkDescriptorBufferInfo buffer_info = { buffer, offset, range };
+  VkWriteDescriptorSet write = {};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.dstSet = table.set;
+  write.dstBinding = bindless_buffer_binding;
+  write.dstArrayElement = index;
+  write.descriptorCount = 1;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  write.pBufferInfo = &buffer_info;
+  vkUpdateDescriptorSets(table.device, 1, &write, 0, NULL);
+  return index;
+}
+
+void
+bindless_remove_texture(BindlessTable& table, uint32_t index, uint64_t retire_value)
+{
+  // Partially bound: the stale descriptor stays until overwritten, it just must not be accessed
+  deletion_queue_push(*table.deletions, retire_value, [&table, index] { table.free_textures.push_back(index); });
+}
+
+void
+bindless_remove_buffer(BindlessTable& table, uint32_t index, uint64_t retire_value)
+{
+  deletion_queue_push(*table.deletions, retire_value, [&table, index] { table.free_buffers.push_back(index); });
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "deletion_queue.hpp"
+#include "frame_scheduler.hpp"
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Descriptor management.
+//
+// DescriptorAllocator: transient sets that live for one frame. Each frame slot owns a chain of
+// pools; a full pool is swapped for a new (larger) one, and when the slot comes around again
+// every pool is reset with one vkResetDescriptorPool call. Sets are never freed individually.
+//
+// BindlessTable: one long-lived set with large update-after-bind, partially bound arrays of
+// textures and storage buffers. Resources are registered once and addressed by index from
+// shaders, so per-material descriptor work disappears.
+
+struct DescriptorPoolRatio
+{
+  VkDescriptorType type;
+  float per_set; // descriptors of this type per set
+};
+
+struct FrameDescriptorPools
+{
+  VkDescriptorPool current = VK_NULL_HANDLE;
+  std::vector<VkDescriptorPool> full;  // handed out sets this frame
+  std::vector<VkDescriptorPool> ready; // reset, waiting to be used
+};
+
+struct DescriptorAllocator
+{
+  VkDevice device = VK_NULL_HANDLE;
+  VkAllocationCallbacks* allocator = nullptr;
+  std::vector<DescriptorPoolRatio> ratios;
+  uint32_t sets_per_pool = 64; // grows for every new pool, up to max_sets_per_pool
+  uint32_t max_sets_per_pool = 4096;
+  uint32_t frames_in_flight = 0;
+  std::array<FrameDescriptorPools, max_frames_in_flight> frames;
+
+  // stats
+  uint32_t pool_count = 0;
+  uint32_t sets_this_frame = 0;
+};
+
+void
+setup_descriptor_allocator(DescriptorAllocator& descriptors, VkDevice device, uint32_t frames_in_flight, const std::vector<DescriptorPoolRatio>& ratios, VkAllocationCallbacks* allocator);
+
+void
+cleanup_descriptor_allocator(DescriptorAllocator& descriptors);
+
+// The slot's previous frame must have completed.
+void
+descriptor_allocator_begin_frame(DescriptorAllocator& descriptors, uint32_t frame_slot);
+
+VkDescriptorSet
+descriptor_allocator_allocate(DescriptorAllocator& descriptors, uint32_t frame_slot, VkDescriptorSetLayout layout);
+
+constexpr uint32_t bindless_texture_binding = 0;
+constexpr uint32_t bindless_buffer_binding = 1;
+constexpr uint32_t bindless_invalid = UINT32_MAX;
+
+struct BindlessTable
+{
+  VkDevice device = VK_NULL_HANDLE;
+  VkAllocationCallbacks* allocator = nullptr;
+  DeletionQueue* deletions = nullptr; // releases removed indices once no frame can index them
+  VkDescriptorPool pool = VK_NULL_HANDLE;
+  VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+  VkDescriptorSet set = VK_NULL_HANDLE;
+
+  uint32_t texture_capacity = 0;
+  uint32_t buffer_capacity = 0;
+  uint32_t texture_count = 0; // high-water mark
+  uint32_t buffer_count = 0;
+  std::vector<uint32_t> free_textures;
+  std::vector<uint32_t> free_buffers;
+};
+
+// Returns false when the device lacks descriptor indexing; the table is then unusable.
+bool
+setup_bindless_table(BindlessTable& table, VkPhysicalDevice physical_device, VkDevice device, DeletionQueue& deletions, VkAllocationCallbacks* allocator);
+
+void
+cleanup_bindless_table(BindlessTable& table);
+
+// Returns the array index, bindless_invalid when full.
+uint32_t
+bindless_add_texture(BindlessTable& table, VkImageView view, VkSampler sampler, VkImageLayout layout);
+
+uint32_t
+bindless_add_buffer(BindlessTable& table, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+
+// Frames in flight may still index the slot (update-after-bind), so it is only handed out again once
+// the timeline reaches retire_value: frame_scheduler_signal_value of the last frame that used it.
+void
+bindless_remove_texture(BindlessTable& table, uint32_t index, uint64_t retire_value);
+
+void
+bindless_remove_buffer(BindlessTable& table, uint32_t index, uint64_t retire_value);
@@ -0,0 +1,292 @@
+#include "device_select.hpp"
+
+#include <algorithm>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+// Highest first: graphics, compute, transfer
+const float queue_priorities[] = { 1.0f, 0.75f, 0.5f };
+
+bool
+contains_ignore_case(const char* haystack, const char* needle)
+{
+  const size_t n = strlen(needle);
+  for (const char* h = haystack; *h; h++) {
+    size_t i = 0;
+    while (i < n && h[i] && tolower((unsigned char)h[i]) == tolower((unsigned char)needle[i]))
+      i++;
+    if (i == n)
+      return true;
+  }
+  return n == 0;
+}
+
+const char*
+device_type_name(VkPhysicalDeviceType type)
+{
+  switch (type) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+      return "discrete";
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+      return "integrated";
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+      return "virtual";
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+      return "cpu";
+    default:
+      return "other";
+  }
+}
+
+} // namespace
+
+DeviceCandidate
+score_physical_device(VkPhysicalDevice device, const std::vector<const char*>& required_extensions, VkSurfaceKHR surface)
+{
+  DeviceCandidate candidate;
+  candidate.device = device;
+  vkGetPhysicalDeviceProperties(device, &candidate.properties);
+  const VkPhysicalDeviceProperties& properties = candidate.properties;
+
+  // Required
+  if (properties.apiVersion < VK_API_VERSION_1_2) {
+    candidate.rejected = "Vulkan 1.2 not supported";
+    return candidate;
+  }
+  VkPhysicalDeviceVulkan12Features features12 = {};
+  features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  VkPhysicalDeviceFeatures2 features = {};
+  features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features.pNext = &features12;
+  vkGetPhysicalDeviceFeatures2(device, &features);
+  if (!features12.timelineSemaphore) {
+    candidate.rejected = "no timeline semaphores";
+    return candidate;
+  }
+
+  uint32_t extension_count = 0;
+  vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, nullptr);
+  std::vector<VkExtensionProperties> extensions(extension_count);
+  vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, extensions.data());
+  for (const char* required : required_extensions) {
+    const bool found = std::any_of(extensions.begin(), extensions.end(), [&](const VkExtensionProperties& e) { return strcmp(e.extensionName, required) == 0; });
+    if (!found) {
+      candidate.rejected = std::string("missing ") + required;
+      return candidate;
+    }
+  }
+
+  DeviceQueues queues;
+  select_queue_families(device, surface, queues);
+  if (queues.graphics_family == UINT32_MAX) {
+    candidate.rejected = surface != VK_NULL_HANDLE ? "no graphics queue that can present to the window" : "no graphics queue";
+    return candidate;
+  }
+
+  // Preferences
+  int64_t score = 0;
+  switch (properties.deviceType) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+      score += 10000;
+      break;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+      score += 5000;
+      break;
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+      score += 2000;
+      break;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+      score += 500;
+      break;
+    default:
+      break;
+  }
+
+  // Largest device-local heap, 1 point per 64 MiB
+  VkPhysicalDeviceMemoryProperties memory;
+  vkGetPhysicalDeviceMemoryProperties(device, &memory);
+  VkDeviceSize device_local = 0;
+  for (uint32_t i = 0; i < memory.memoryHeapCount; i++)
+    if (memory.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+      device_local = std::max(device_local, memory.memoryHeaps[i].size);
+  score += static_cast<int64_t>(device_local >> 26);
+
+  score += properties.limits.maxImageDimension2D / 1024;
+  score += properties.limits.maxComputeWorkGroupInvocations / 256;
+
+  if (features.features.multiDrawIndirect)
+    score += 200;
+  if (features.features.drawIndirectFirstInstance)
+    score += 200;
+  if (queues.compute_family != queues.graphics_family)
+    score += 100;
+  if (queues.transfer_family != queues.graphics_family && queues.transfer_family != queues.compute_family)
+    score += 100;
+
+  candidate.score = score;
+  return candidate;
+}
+
+VkPhysicalDevice
+select_physical_device(VkInstance instance, const std::vector<const char*>& required_extensions, VkSurfaceKHR surface, const char* override_name)
+{
+  uint32_t device_count = 0;
+  VkResult err = vkEnumeratePhysicalDevices(instance, &device_count, nullptr);
+  if (err != VK_SUCCESS || device_count == 0) {
+    fprintf(stderr, "Error no Vulkan devices found\n");
+    exit(-1);
+  }
+  std::vector<VkPhysicalDevice> devices(device_count);
+  vkEnumeratePhysicalDevices(instance, &device_count, devices.data());
+
+  std::vector<DeviceCandidate> candidates;
+  for (VkPhysicalDevice device : devices)
+    candidates.push_back(score_physical_device(device, required_extensions, surface));
+
+  for (uint32_t i = 0; i < candidates.size(); i++) {
+    const DeviceCandidate& c = candidates[i];
+    if (c.score >= 0)
+      printf("[vulkan] GPU %u: %s (%s) score %lld\n", i, c.properties.deviceName, device_type_name(c.properties.deviceType), (long long)c.score);
+    else
+      printf("[vulkan] GPU %u: %s (%s) unusable: %s\n", i, c.properties.deviceName, device_type_name(c.properties.deviceType), c.rejected.c_str());
+  }
+
+  const DeviceCandidate* selected = nullptr;
+  if (override_name && override_name[0]) {
+    // An index, or part of the device name
+    char* end = nullptr;
+    const unsigned long index = strtoul(override_name, &end, 10);
+    for (uint32_t i = 0; i < candidates.size() && !selected; i++) {
+      const bool match = *end == '\0' ? index == i : contains_ignore_case(candidates[i].properties.deviceName, override_name);
+      if (match)
+        selected = &candidates[i];
+    }
+    if (!selected) {
+      fprintf(stderr, "Error no GPU matches '%s'\n", override_name);
+      exit(-1);
+    }
+    if (selected->score < 0) {
+      fprintf(stderr, "Error GPU '%s' cannot be used: %s\n", selected->properties.deviceName, selected->rejected.c_str());
+      exit(-1);
+    }
+  } else {
+    for (const DeviceCandidate& c : candidates)
+      if (c.score >= 0 && (!selected || c.score > selected->score))
+        selected = &c;
+    if (!selected) {
+      fprintf(stderr, "Error no usable GPU\n");
+      exit(-1);
+    }
+  }
+  printf("[vulkan] Selected GPU = %s\n", selected->properties.deviceName);
+  return selected->device;
+}
+
+void
+select_queue_families(VkPhysicalDevice physical_device, VkSurfaceKHR surface, DeviceQueues& queues)
+{
+  uint32_t count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, NULL);
+  std::vector<VkQueueFamilyProperties> families(count);
+  vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, families.data());
+
+  queues = DeviceQueues{};
+  std::vector<uint32_t> taken(count, 0);
+  auto take = [&](uint32_t family, uint32_t& index) {
+    if (taken[family] >= families[family].queueCount)
+      return false;
+    index = taken[family]++;
+    return true;
+  };
+
+  // Presents are submitted to the graphics queue, so with a window it must be able to present
+  std::vector<VkBool32> presents(count, VK_TRUE);
+  if (surface != VK_NULL_HANDLE)
+    for (uint32_t i = 0; i < count; i++)
+      if (vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, i, surface, &presents[i]) != VK_SUCCESS)
+        presents[i] = VK_FALSE;
+
+  // Graphics, preferably a family that can also do compute
+  for (uint32_t i = 0; i < count && queues.graphics_family == UINT32_MAX; i++)
+    if (presents[i] && (families[i].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))
+      queues.graphics_family = i;
+  for (uint32_t i = 0; i < count && queues.graphics_family == UINT32_MAX; i++)
+    if (presents[i] && (families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT))
+      queues.graphics_family = i;
+  if (queues.graphics_family == UINT32_MAX)
+    return;
+  take(queues.graphics_family, queues.graphics_index);
+
+  // Async compute: a compute family without graphics, else a second graphics queue, else share
+  queues.compute_family = queues.graphics_family;
+  queues.compute_index = queues.graphics_index;
+  bool found = false;
+  for (uint32_t i = 0; i < count && !found; i++) {
+    const VkQueueFlags flags = families[i].queueFlags;
+    if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT) && take(i, queues.compute_index)) {
+      queues.compute_family = i;
+      found = true;
+    }
+  }
+  if (!found && take(queues.graphics_family, queues.compute_index))
+    found = true;
+
+  // Transfer: a transfer-only family (DMA engine), else another queue of the compute or graphics family, else share
+  queues.transfer_family = queues.graphics_family;
+  queues.transfer_index = queues.graphics_index;
+  found = false;
+  for (uint32_t i = 0; i < count && !found; i++) {
+    const VkQueueFlags flags = families[i].queueFlags;
+    if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) && take(i, queues.transfer_index)) {
+      queues.transfer_family = i;
+      found = true;
+    }
+  }
+  if (!found && queues.compute_family != queues.graphics_family && take(queues.compute_family, queues.transfer_index)) {
+    queues.transfer_family = queues.compute_family;
+    found = true;
+  }
+  if (!found)
+    take(queues.graphics_family, queues.transfer_index);
+}
+
+void
+device_queue_create_infos(const DeviceQueues& queues, std::vector<VkDeviceQueueCreateInfo>& infos)
+{
+  infos.clear();
+  const uint32_t families[] = { queues.graphics_family, queues.compute_family, queues.transfer_family };
+  const uint32_t indices[] = { queues.graphics_index, queues.compute_index, queues.transfer_index };
+  for (uint32_t i = 0; i < 3; i++) {
+    auto it = std::find_if(infos.begin(), infos.end(), [&](const VkDeviceQueueCreateInfo& info) { return info.queueFamilyIndex == families[i]; });
+    if (it == infos.end()) {
+      VkDeviceQueueCreateInfo info = {};
+      info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+      info.queueFamilyIndex = families[i];
+      info.pQueuePriorities = queue_priorities;
+      infos.push_back(info);
+      it = infos.end() - 1;
+    }
+    it->queueCount = std::max(it->queueCount, indices[i] + 1);
+  }
+}
+
+void
+get_device_queues(VkDevice device, DeviceQueues& queues)
+{
+  vkGetDeviceQueue(device, queues.graphics_family, queues.graphics_index, &queues.graphics);
+  vkGetDeviceQueue(device, queues.compute_family, queues.compute_index, &queues.compute);
+  vkGetDeviceQueue(device, queues.transfer_family, queues.transfer_index, &queues.transfer);
+  printf("[vulkan] Queues: graphics %u.%u, compute %u.%u%s, transfer %u.%u%s\n",
+         queues.graphics_family,
+         queues.graphics_index,
+         queues.compute_family,
+         queues.compute_index,
+         queues.compute == queues.graphics ? " (shared)" : "",
+         queues.transfer_family,
+         queues.transfer_index,
+         queues.transfer == queues.graphics || queues.transfer == queues.compute ? " (shared)" : "");
+}
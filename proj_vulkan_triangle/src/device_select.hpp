@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Physical device and queue selection.
+// Every device is scored on type, device-local memory, a few limits and the optional features we
+// use; devices missing something required score -1, including a graphics queue that can present
+// to the window surface when there is one. VT_DEVICE or --device (index or part of the
+// name) forces a device. Queues: graphics, async compute and transfer come from separate families
+// when the hardware has them, then from extra queues of an already used family, and only then
+// share a queue.
+
+struct DeviceCandidate
+{
+  VkPhysicalDevice device = VK_NULL_HANDLE;
+  VkPhysicalDeviceProperties properties = {};
+  int64_t score = -1;
+  std::string rejected; // why a device scored -1
+};
+
+struct DeviceQueues
+{
+  uint32_t graphics_family = UINT32_MAX;
+  uint32_t graphics_index = 0;
+  VkQueue graphics = VK_NULL_HANDLE;
+
+  uint32_t compute_family = UINT32_MAX;
+  uint32_t compute_index = 0;
+  VkQueue compute = VK_NULL_HANDLE;
+
+  uint32_t transfer_family = UINT32_MAX;
+  uint32_t transfer_index = 0;
+  VkQueue transfer = VK_NULL_HANDLE;
+};
+
+// surface is VK_NULL_HANDLE when rendering offscreen.
+DeviceCandidate
+score_physical_device(VkPhysicalDevice device, const std::vector<const char*>& required_extensions, VkSurfaceKHR surface);
+
+// override_name may be null/empty. Exits if no usable device is found.
+VkPhysicalDevice
+select_physical_device(VkInstance instance, const std::vector<const char*>& required_extensions, VkSurfaceKHR surface, const char* override_name);
+
+// With a surface, only families that can present to it are used for graphics (presents go through the graphics queue).
+void
+select_queue_families(VkPhysicalDevice physical_device, VkSurfaceKHR surface, DeviceQueues& queues);
+
+// Fills create infos for every family in use. Valid while queues is unchanged.
+void
+device_queue_create_infos(const DeviceQueues& queues, std::vector<VkDeviceQueueCreateInfo>& infos);
+
+// After vkCreateDevice
+void
+get_device_queues(VkDevice device, DeviceQueues& queues);
@@ -0,0 +1,453 @@
+#include "frame_capture.hpp"
+
+#include "redraw.hpp" // hash_draw_list
+
+#include <algorithm>
+#include <string.h> // memcpy, memcmp
+#include <utility>  // swap
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr char capture_magic[8] = { 'V', 'T', 'C', 'A', 'P', 'T', 'U', 'R' };
+constexpr uint32_t frame_magic = 0x454D5246; // "FRME"
+
+enum ListKind : uint32_t
+{
+  list_full = 0,
+  list_reference = 1,
+};
+
+struct CaptureHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t vertex_size;
+  uint32_t index_size;
+  uint32_t frame_count;
+};
+
+struct FrameRecord
+{
+  uint32_t magic;
+  uint32_t list_count;
+  uint64_t bytes; // this record and its lists
+  float display_pos[2];
+  float display_size[2];
+  float framebuffer_scale[2];
+  float clear_color[4];
+};
+
+struct ListRecord
+{
+  uint32_t kind;
+  uint32_t command_count;
+  uint64_t reference; // list_reference: file offset of the full ListRecord
+  uint32_t vertex_count;
+  uint32_t index_count;
+};
+
+struct CommandRecord
+{
+  float clip_rect[4];
+  uint64_t texture;
+  uint32_t vertex_offset;
+  uint32_t index_offset;
+  uint32_t element_count;
+  uint32_t padding;
+};
+
+static_assert(sizeof(CaptureHeader) % 8 == 0 && sizeof(FrameRecord) % 8 == 0 && sizeof(ListRecord) % 8 == 0 && sizeof(CommandRecord) % 8 == 0);
+
+uint64_t
+align8(uint64_t bytes)
+{
+  return (bytes + 7) & ~7ull;
+}
+
+void
+append(std::vector<uint8_t>& out, const void* data, size_t bytes)
+{
+  const uint8_t* begin = static_cast<const uint8_t*>(data);
+  out.insert(out.end(), begin, begin + bytes);
+  out.resize(align8(out.size()), 0);
+}
+
+// A full ListRecord followed by its commands, vertices and indices
+void
+serialize_list(std::vector<uint8_t>& out, const ImDrawList* list)
+{
+  ListRecord record = {};
+  record.kind = list_full;
+  record.vertex_count = static_cast<uint32_t>(list->VtxBuffer.Size);
+  record.index_count = static_cast<uint32_t>(list->IdxBuffer.Size);
+  for (const ImDrawCmd& cmd : list->CmdBuffer)
+    record.command_count += cmd.UserCallback == nullptr ? 1 : 0;
+  append(out, &record, sizeof(record));
+  for (const ImDrawCmd& cmd : list->CmdBuffer) {
+    if (cmd.UserCallback != nullptr)
+      continue;
+    CommandRecord command = {};
+    memcpy(command.clip_rect, &cmd.ClipRect, sizeof(command.clip_rect));
+    command.texture = (uint64_t)(uintptr_t)cmd.TextureId;
+    command.vertex_offset = cmd.VtxOffset;
+    command.index_offset = cmd.IdxOffset;
+    command.element_count = cmd.ElemCount;
+    append(out, &command, sizeof(command));
+  }
+  append(out, list->VtxBuffer.Data, list->VtxBuffer.size_in_bytes());
+  append(out, list->IdxBuffer.Data, list->IdxBuffer.size_in_bytes());
+}
+
+// Commands, vertices and indices following a full ListRecord
+uint64_t
+payload_bytes(const ListRecord& record)
+{
+  return record.command_count * sizeof(CommandRecord) + align8(record.vertex_count * sizeof(ImDrawVert)) + align8(record.index_count * sizeof(ImDrawIdx));
+}
+
+bool
+map_file(FrameReplay& replay, const char* path)
+{
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+  LARGE_INTEGER size;
+  GetFileSizeEx(file, &size);
+  HANDLE mapping = size.QuadPart > 0 ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+  const void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+  if (data == NULL) {
+    if (mapping)
+      CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+  replay.file = file;
+  replay.mapping = mapping;
+  replay.size = static_cast<uint64_t>(size.QuadPart);
+#else
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  void* data = fstat(fd, &st) == 0 && st.st_size > 0 ? mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  close(fd); // the mapping keeps the file
+  if (data == MAP_FAILED)
+    return false;
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+  replay.size = static_cast<uint64_t>(st.st_size);
+#endif
+  replay.data = static_cast<const uint8_t*>(data);
+  return true;
+}
+
+void
+unmap_file(FrameReplay& replay)
+{
+  if (replay.data == nullptr)
+    return;
+#ifdef _WIN32
+  UnmapViewOfFile(replay.data);
+  CloseHandle(replay.mapping);
+  CloseHandle(replay.file);
+#else
+  munmap(const_cast<uint8_t*>(replay.data), replay.size);
+#endif
+  replay.data = nullptr;
+  replay.mapping = nullptr;
+  replay.file = nullptr;
+  replay.size = 0;
+}
+
+// Fills list from the full record at offset: commands are copied, vertices and indices point into the mapping
+bool
+decode_list(FrameReplay& replay, uint64_t offset, ImTextureID texture, ImDrawList* list)
+{
+  ListRecord record;
+  if (offset + sizeof(record) > replay.size)
+    return false;
+  memcpy(&record, replay.data + offset, sizeof(record));
+  if (record.kind != list_full || offset + sizeof(record) + payload_bytes(record) > replay.size)
+    return false;
+
+  const uint8_t* p = replay.data + offset + sizeof(record);
+  list->CmdBuffer.resize(record.command_count);
+  for (uint32_t i = 0; i < record.command_count; i++) {
+    CommandRecord command;
+    memcpy(&command, p + i * sizeof(command), sizeof(command));
+    ImDrawCmd& cmd = list->CmdBuffer[i];
+    cmd = ImDrawCmd();
+    cmd.ClipRect = ImVec4(command.clip_rect[0], command.clip_rect[1], command.clip_rect[2], command.clip_rect[3]);
+    cmd.TextureId = texture;
+    cmd.VtxOffset = command.vertex_offset;
+    cmd.IdxOffset = command.index_offset;
+    cmd.ElemCount = command.element_count;
+  }
+  p += record.command_count * sizeof(CommandRecord);
+
+  // Borrowed from the read-only mapping; renderers only read draw lists, close_frame_replay detaches them
+  list->VtxBuffer.Data = reinterpret_cast<ImDrawVert*>(const_cast<uint8_t*>(p));
+  list->VtxBuffer.Size = list->VtxBuffer.Capacity = static_cast<int>(record.vertex_count);
+  p += align8(record.vertex_count * sizeof(ImDrawVert));
+  list->IdxBuffer.Data = reinterpret_cast<ImDrawIdx*>(const_cast<uint8_t*>(p));
+  list->IdxBuffer.Size = list->IdxBuffer.Capacity = static_cast<int>(record.index_count);
+  return true;
+}
+
+// Stops the capture on a short write, a truncated stream is still replayable up to its last whole frame
+bool
+write_capture(FrameCapture& capture, const void* data, size_t bytes)
+{
+  if (fwrite(data, 1, bytes, capture.file) == bytes)
+    return true;
+  fprintf(stderr, "[capture] Failed to write %zu bytes after frame %u, capture stopped\n", bytes, capture.frame_count);
+  fclose(capture.file);
+  capture.file = nullptr;
+  return false;
+}
+
+// Whole frame records from the first one on: the header only gets its count on close,
+// a capture whose process died replays every frame that made it to disk
+uint32_t
+count_frames(const FrameReplay& replay)
+{
+  uint32_t count = 0;
+  uint64_t offset = replay.offset;
+  FrameRecord frame;
+  while (offset + sizeof(frame) <= replay.size) {
+    memcpy(&frame, replay.data + offset, sizeof(frame));
+    if (frame.magic != frame_magic || frame.bytes < sizeof(frame) || offset + frame.bytes > replay.size)
+      break;
+    offset += frame.bytes;
+    count++;
+  }
+  return count;
+}
+
+} // namespace
+
+bool
+open_frame_capture(FrameCapture& capture, const char* path)
+{
+  capture.file = fopen(path, "wb");
+  if (capture.file == nullptr) {
+    fprintf(stderr, "[capture] Failed to open %s\n", path);
+    return false;
+  }
+  // Written again with the frame count on close
+  CaptureHeader header = {};
+  memcpy(header.magic, capture_magic, sizeof(header.magic));
+  header.version = frame_capture_version;
+  header.vertex_size = sizeof(ImDrawVert);
+  header.index_size = sizeof(ImDrawIdx);
+  if (!write_capture(capture, &header, sizeof(header)))
+    return false;
+  capture.offset = sizeof(header);
+  capture.frame_count = 0;
+  capture.previous.clear();
+  capture.current.clear();
+  capture.previous_bytes.clear();
+  capture.current_bytes.clear();
+  return true;
+}
+
+void
+close_frame_capture(FrameCapture& capture)
+{
+  if (capture.file == nullptr)
+    return;
+  CaptureHeader header = {};
+  memcpy(header.magic, capture_magic, sizeof(header.magic));
+  header.version = frame_capture_version;
+  header.vertex_size = sizeof(ImDrawVert);
+  header.index_size = sizeof(ImDrawIdx);
+  header.frame_count = capture.frame_count;
+  fseek(capture.file, 0, SEEK_SET);
+  if (!write_capture(capture, &header, sizeof(header)))
+    return;
+  fclose(capture.file);
+  capture.file = nullptr;
+  printf("[capture] %u frames, %.2f MB: %llu lists written, %llu referenced\n",
+         capture.frame_count,
+         capture.offset / (1024.0 * 1024.0),
+         (unsigned long long)capture.full_lists,
+         (unsigned long long)capture.referenced_lists);
+}
+
+void
+frame_capture_write(FrameCapture& capture, const ImDrawData* draw_data, const VkClearValue& clear_value)
+{
+  if (capture.file == nullptr)
+    return;
+  std::vector<uint8_t>& out = capture.scratch;
+  out.clear();
+
+  FrameRecord frame = {};
+  frame.magic = frame_magic;
+  frame.list_count = static_cast<uint32_t>(draw_data->CmdListsCount);
+  frame.display_pos[0] = draw_data->DisplayPos.x;
+  frame.display_pos[1] = draw_data->DisplayPos.y;
+  frame.display_size[0] = draw_data->DisplaySize.x;
+  frame.display_size[1] = draw_data->DisplaySize.y;
+  frame.framebuffer_scale[0] = draw_data->FramebufferScale.x;
+  frame.framebuffer_scale[1] = draw_data->FramebufferScale.y;
+  memcpy(frame.clear_color, clear_value.color.float32, sizeof(frame.clear_color));
+  append(out, &frame, sizeof(frame));
+
+  capture.current.clear();
+  capture.current_bytes.clear();
+  for (int i = 0; i < draw_data->CmdListsCount; i++) {
+    const ImDrawList* list = draw_data->CmdLists[i];
+    FrameCapture::List entry;
+    entry.hash = hash_draw_list(list);
+    entry.begin = capture.current_bytes.size();
+    serialize_list(capture.current_bytes, list);
+    entry.size = capture.current_bytes.size() - entry.begin;
+
+    // The hash only finds the candidate: a collision must not replay another list's geometry
+    const uint8_t* bytes = capture.current_bytes.data() + entry.begin;
+    const auto previous = std::find_if(capture.previous.begin(), capture.previous.end(), [&](const FrameCapture::List& p) {
+      return p.hash == entry.hash && p.size == entry.size && memcmp(capture.previous_bytes.data() + p.begin, bytes, entry.size) == 0;
+    });
+    if (previous != capture.previous.end()) {
+      ListRecord record;
+      memcpy(&record, bytes, sizeof(record));
+      record.kind = list_reference;
+      record.reference = previous->offset;
+      append(out, &record, sizeof(record));
+      entry.offset = previous->offset;
+      capture.referenced_lists++;
+    } else {
+      entry.offset = capture.offset + out.size();
+      out.insert(out.end(), bytes, bytes + entry.size);
+      capture.full_lists++;
+    }
+    capture.current.push_back(entry);
+  }
+
+  frame.bytes = out.size();
+  memcpy(out.data(), &frame, sizeof(frame));
+  if (!write_capture(capture, out.data(), out.size()))
+    return;
+  capture.offset += out.size();
+  capture.frame_count++;
+  std::swap(capture.previous, capture.current);
+  std::swap(capture.previous_bytes, capture.current_bytes);
+}
+
+bool
+open_frame_replay(FrameReplay& replay, const char* path)
+{
+  if (!map_file(replay, path)) {
+    fprintf(stderr, "[replay] Failed to map %s\n", path);
+    return false;
+  }
+  CaptureHeader header = {};
+  if (replay.size >= sizeof(header))
+    memcpy(&header, replay.data, sizeof(header));
+  if (memcmp(header.magic, capture_magic, sizeof(header.magic)) != 0 || header.version != frame_capture_version) {
+    fprintf(stderr, "[replay] %s is not a version %u capture\n", path, frame_capture_version);
+    unmap_file(replay);
+    return false;
+  }
+  if (header.vertex_size != sizeof(ImDrawVert) || header.index_size != sizeof(ImDrawIdx)) {
+    fprintf(stderr, "[replay] %s was captured with %u byte vertices and %u byte indices\n", path, header.vertex_size, header.index_size);
+    unmap_file(replay);
+    return false;
+  }
+  replay.offset = sizeof(header);
+  replay.frame_count = header.frame_count;
+  replay.frame = 0;
+  const uint32_t frames = count_frames(replay);
+  if (frames > replay.frame_count) {
+    printf("[replay] %s was not closed, replaying the %u frames on disk\n", path, frames);
+    replay.frame_count = frames;
+  }
+
+  FrameRecord first = {};
+  if (replay.frame_count > 0 && replay.offset + sizeof(first) <= replay.size) {
+    memcpy(&first, replay.data + replay.offset, sizeof(first));
+    replay.width = static_cast<uint32_t>(first.display_size[0] * first.framebuffer_scale[0]);
+    replay.height = static_cast<uint32_t>(first.display_size[1] * first.framebuffer_scale[1]);
+  }
+  printf("[replay] %s: %u frames, %u x %u, %.2f MB\n", path, replay.frame_count, replay.width, replay.height, replay.size / (1024.0 * 1024.0));
+  return true;
+}
+
+void
+close_frame_replay(FrameReplay& replay)
+{
+  for (ImDrawList* list : replay.lists) {
+    // Detach the mapped buffers before the list frees them
+    list->VtxBuffer.Data = nullptr;
+    list->VtxBuffer.Size = list->VtxBuffer.Capacity = 0;
+    list->IdxBuffer.Data = nullptr;
+    list->IdxBuffer.Size = list->IdxBuffer.Capacity = 0;
+    IM_DELETE(list);
+  }
+  replay.lists.clear();
+  replay.draw_data = ImDrawData();
+  unmap_file(replay);
+}
+
+bool
+frame_replay_next(FrameReplay& replay)
+{
+  FrameRecord frame;
+  if (replay.frame >= replay.frame_count || replay.offset + sizeof(frame) > replay.size)
+    return false;
+  memcpy(&frame, replay.data + replay.offset, sizeof(frame));
+  if (frame.magic != frame_magic || replay.offset + frame.bytes > replay.size) {
+    fprintf(stderr, "[replay] Corrupt frame %u\n", replay.frame);
+    return false;
+  }
+
+  while (replay.lists.size() < frame.list_count)
+    replay.lists.push_back(IM_NEW(ImDrawList)(ImGui::GetDrawListSharedData()));
+  const ImTextureID texture = ImGui::GetIO().Fonts->TexID;
+  int total_vertices = 0;
+  int total_indices = 0;
+  const uint64_t frame_end = replay.offset + frame.bytes;
+  uint64_t cursor = replay.offset + sizeof(frame);
+  for (uint32_t i = 0; i < frame.list_count; i++) {
+    ListRecord record = {};
+    if (cursor + sizeof(record) <= frame_end)
+      memcpy(&record, replay.data + cursor, sizeof(record));
+    // References only point back, to a full record
+    const uint64_t full = record.kind == list_reference ? record.reference : cursor;
+    if (cursor + sizeof(record) > frame_end || full > cursor || !decode_list(replay, full, texture, replay.lists[i])) {
+      fprintf(stderr, "[replay] Corrupt list %u in frame %u\n", i, replay.frame);
+      return false;
+    }
+    cursor += sizeof(record) + (record.kind == list_full ? payload_bytes(record) : 0);
+    total_vertices += replay.lists[i]->VtxBuffer.Size;
+    total_indices += replay.lists[i]->IdxBuffer.Size;
+  }
+
+  ImDrawData& draw_data = replay.draw_data;
+  draw_data = ImDrawData();
+  draw_data.Valid = true;
+  draw_data.CmdLists = replay.lists.data();
+  draw_data.CmdListsCount = static_cast<int>(frame.list_count);
+  draw_data.TotalVtxCount = total_vertices;
+  draw_data.TotalIdxCount = total_indices;
+  draw_data.DisplayPos = ImVec2(frame.display_pos[0], frame.display_pos[1]);
+  draw_data.DisplaySize = ImVec2(frame.display_size[0], frame.display_size[1]);
+  draw_data.FramebufferScale = ImVec2(frame.framebuffer_scale[0], frame.framebuffer_scale[1]);
+  draw_data.OwnerViewport = ImGui::GetMainViewport();
+  memcpy(replay.clear_value.color.float32, frame.clear_color, sizeof(frame.clear_color));
+
+  replay.offset += frame.bytes;
+  replay.frame++;
+  return true;
+}
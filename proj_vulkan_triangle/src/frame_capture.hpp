@@ -0,0 +1,91 @@
+#pragma once
+
+#include "imgui.h"
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <stdio.h>
+#include <vector>
+
+// Frame capture and replay: a binary stream of ImDrawData for reproducible benchmarks.
+//
+// Layout (little endian, every record 8-byte aligned):
+//   CaptureHeader
+//   per frame: FrameRecord, then per draw list a ListRecord followed, for full lists, by
+//              CommandRecord[command_count], the vertices and the indices
+// A list identical to one of the previous frame's (same hash, then compared byte for byte) is written
+// as a reference to that earlier full record instead (delta encoding: a static UI costs a few bytes
+// per list and frame).
+// References are absolute file offsets, so a reader can map the file and point straight into it.
+// The header's frame count is only written on close: replay counts the whole frame records on disk when
+// the capturing process did not get there. A failed write stops the capture.
+//
+// Texture IDs are recorded, but they are descriptor sets of the capturing process: replay binds its
+// font atlas, the only texture this app creates, for all of them. Draw callbacks are dropped.
+
+constexpr uint32_t frame_capture_version = 1;
+
+struct FrameCapture
+{
+  FILE* file = nullptr;
+  uint64_t offset = 0; // bytes written
+  uint32_t frame_count = 0;
+  std::vector<uint8_t> scratch; // the frame being serialized
+
+  // Lists of the previous and current frame: their full records (serialized even when referenced)
+  // and where in the file that record was written
+  struct List
+  {
+    uint64_t hash = 0;
+    uint64_t offset = 0; // file offset of the full ListRecord
+    size_t begin = 0;    // its bytes in previous_bytes / current_bytes
+    size_t size = 0;
+  };
+  std::vector<List> previous;
+  std::vector<List> current;
+  std::vector<uint8_t> previous_bytes;
+  std::vector<uint8_t> current_bytes;
+
+  uint64_t full_lists = 0;
+  uint64_t referenced_lists = 0;
+};
+
+bool
+open_frame_capture(FrameCapture& capture, const char* path);
+
+// Prints what was written.
+void
+close_frame_capture(FrameCapture& capture);
+
+void
+frame_capture_write(FrameCapture& capture, const ImDrawData* draw_data, const VkClearValue& clear_value);
+
+struct FrameReplay
+{
+  // read-only mapping of the whole file
+  const uint8_t* data = nullptr;
+  uint64_t size = 0;
+  void* mapping = nullptr; // platform handles
+  void* file = nullptr;
+
+  uint64_t offset = 0; // next frame record
+  uint32_t frame_count = 0;
+  uint32_t frame = 0; // frames replayed
+  uint32_t width = 0; // framebuffer size of the first frame
+  uint32_t height = 0;
+
+  // Current frame. Vertex and index buffers point into the mapping, commands are decoded.
+  ImDrawData draw_data;
+  std::vector<ImDrawList*> lists;
+  VkClearValue clear_value = {};
+};
+
+bool
+open_frame_replay(FrameReplay& replay, const char* path);
+
+void
+close_frame_replay(FrameReplay& replay);
+
+// Decodes the next frame into replay.draw_data, false at the end of the stream. Needs the ImGui context.
+bool
+frame_replay_next(FrameReplay& replay);
@@ -0,0 +1,156 @@
+#include "frame_pacing.hpp"
+
+#include "imgui.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+namespace {
+
+using pacing_clock = std::chrono::steady_clock;
+
+float
+elapsed_ms(pacing_clock::time_point begin, pacing_clock::time_point end)
+{
+  return std::chrono::duration<float, std::milli>(end - begin).count();
+}
+
+// Sleeps are only as precise as the OS timer, so stop sleeping sleep_overshoot_ms early and spin
+void
+wait_until(FramePacing& pacing, pacing_clock::time_point deadline)
+{
+  const auto begin = pacing_clock::now();
+  for (;;) {
+    const auto now = pacing_clock::now();
+    const float remaining_ms = elapsed_ms(now, deadline);
+    const float sleep_ms = remaining_ms - pacing.sleep_overshoot_ms;
+    if (sleep_ms < 0.5f)
+      break;
+    std::this_thread::sleep_for(std::chrono::duration<float, std::milli>(sleep_ms));
+    const float overshoot_ms = elapsed_ms(now, pacing_clock::now()) - sleep_ms;
+    if (overshoot_ms > pacing.sleep_overshoot_ms)
+      pacing.sleep_overshoot_ms = overshoot_ms;
+    else
+      pacing.sleep_overshoot_ms = std::max(0.25f, pacing.sleep_overshoot_ms * 0.99f + overshoot_ms * 0.01f);
+  }
+  const auto spin_begin = pacing_clock::now();
+  while (pacing_clock::now() < deadline) {
+  }
+  const auto end = pacing_clock::now();
+  pacing.slept_ms = elapsed_ms(begin, spin_begin);
+  pacing.spun_ms = elapsed_ms(spin_begin, end);
+}
+
+const VkPresentModeKHR present_modes[] = { VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR };
+
+} // namespace
+
+const char*
+present_mode_name(VkPresentModeKHR mode)
+{
+  switch (mode) {
+    case VK_PRESENT_MODE_FIFO_KHR:
+      return "fifo";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+      return "fifo_relaxed";
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+      return "mailbox";
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+      return "immediate";
+    default:
+      return "other";
+  }
+}
+
+bool
+parse_present_mode(const char* name, VkPresentModeKHR& mode)
+{
+  for (VkPresentModeKHR candidate : present_modes) {
+    if (strcmp(name, present_mode_name(candidate)) == 0) {
+      mode = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+void
+setup_frame_pacing(FramePacing& pacing, VkPhysicalDevice physical_device, VkSurfaceKHR surface, VkPresentModeKHR present_mode, float fps_limit, bool low_latency)
+{
+  pacing.supported.clear();
+  if (surface != VK_NULL_HANDLE) {
+    uint32_t count = 0;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &count, nullptr);
+    pacing.supported.resize(count);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &count, pacing.supported.data());
+  }
+  // FIFO is always available
+  const bool supported = present_mode == VK_PRESENT_MODE_FIFO_KHR || std::find(pacing.supported.begin(), pacing.supported.end(), present_mode) != pacing.supported.end();
+  if (!supported)
+    printf("[pacing] present mode %s not supported, using fifo\n", present_mode_name(present_mode));
+  pacing.present_mode = supported ? present_mode : VK_PRESENT_MODE_FIFO_KHR;
+  pacing.fps_limit = fps_limit;
+  pacing.low_latency = low_latency;
+  pacing.deadline = pacing_clock::now();
+}
+
+void
+frame_pacing_wait(FramePacing& pacing, const FrameScheduler& scheduler, VkDevice device)
+{
+  pacing.slept_ms = 0.0f;
+  pacing.spun_ms = 0.0f;
+  pacing.gpu_drain_ms = 0.0f;
+  pacing.late_ms = 0.0f;
+
+  if (pacing.low_latency) {
+    // Drain the queue: the frame about to be built is the next one the GPU works on
+    const auto begin = pacing_clock::now();
+    frame_scheduler_wait(scheduler, device, scheduler.frame_number);
+    pacing.gpu_drain_ms = elapsed_ms(begin, pacing_clock::now());
+  }
+
+  const auto now = pacing_clock::now();
+  if (pacing.fps_limit <= 0.0f) {
+    pacing.deadline = now;
+    return;
+  }
+  const auto period = std::chrono::duration_cast<pacing_clock::duration>(std::chrono::duration<double>(1.0 / pacing.fps_limit));
+  pacing.deadline += period;
+  if (pacing.deadline <= now) {
+    pacing.late_ms = elapsed_ms(pacing.deadline, now);
+    // More than a frame behind (hitch, limit raised): restart the cadence instead of rushing to catch up
+    if (now - pacing.deadline > period)
+      pacing.deadline = now;
+    return;
+  }
+  wait_until(pacing, pacing.deadline);
+}
+
+bool
+frame_pacing_draw_settings(FramePacing& pacing, bool* open)
+{
+  if (!ImGui::Begin("Frame pacing", open)) {
+    ImGui::End();
+    return false;
+  }
+  bool changed = false;
+  if (ImGui::BeginCombo("present mode", present_mode_name(pacing.present_mode))) {
+    for (VkPresentModeKHR mode : present_modes) {
+      const bool supported = mode == VK_PRESENT_MODE_FIFO_KHR || std::find(pacing.supported.begin(), pacing.supported.end(), mode) != pacing.supported.end();
+      if (ImGui::Selectable(present_mode_name(mode), mode == pacing.present_mode, supported ? 0 : ImGuiSelectableFlags_Disabled) && mode != pacing.present_mode) {
+        pacing.present_mode = mode;
+        changed = true;
+      }
+    }
+    ImGui::EndCombo();
+  }
+  ImGui::SliderFloat("fps limit", &pacing.fps_limit, 0.0f, 500.0f, pacing.fps_limit > 0.0f ? "%.0f" : "unlimited");
+  if (pacing.low_latency_available)
+    ImGui::Checkbox("low latency", &pacing.low_latency);
+  ImGui::Text("slept %.2f ms, spun %.2f ms (sleep overshoot %.2f ms)", pacing.slept_ms, pacing.spun_ms, pacing.sleep_overshoot_ms);
+  ImGui::Text("gpu drain %.2f ms, late %.2f ms", pacing.gpu_drain_ms, pacing.late_ms);
+  ImGui::End();
+  return changed;
+}
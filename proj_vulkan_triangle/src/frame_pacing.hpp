@@ -0,0 +1,54 @@
+#pragma once
+
+#include "frame_scheduler.hpp"
+#include <vulkan/vulkan.h>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Frame pacing: the swapchain present mode (switchable at runtime), an optional frame rate limit
+// and a low-latency mode.
+//
+// The limiter waits at the top of the main loop, before input is sampled. It sleeps until shortly
+// before the deadline and spins the rest, the spin margin follows the measured sleep overshoot.
+// Low latency additionally waits for every submitted frame to finish first, so the CPU never
+// queues frames ahead of the GPU and input is read as late as possible.
+
+struct FramePacing
+{
+  VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
+  std::vector<VkPresentModeKHR> supported; // by the surface, empty when headless
+  float fps_limit = 0.0f;                  // 0 = unlimited
+  bool low_latency = false;
+  bool low_latency_available = true; // not with a render thread, the UI thread never waits on the GPU
+
+  std::chrono::steady_clock::time_point deadline;
+  float sleep_overshoot_ms = 1.0f; // how late sleeps wake up, tracked with a fast rise / slow decay
+
+  // last frame
+  float slept_ms = 0.0f;
+  float spun_ms = 0.0f;
+  float gpu_drain_ms = 0.0f;
+  float late_ms = 0.0f; // past the deadline when the wait began
+};
+
+const char*
+present_mode_name(VkPresentModeKHR mode);
+
+// Parses fifo / mailbox / immediate / fifo_relaxed.
+bool
+parse_present_mode(const char* name, VkPresentModeKHR& mode);
+
+// Queries the modes the surface supports (none when surface is VK_NULL_HANDLE) and falls back to
+// FIFO if the requested one is not among them.
+void
+setup_frame_pacing(FramePacing& pacing, VkPhysicalDevice physical_device, VkSurfaceKHR surface, VkPresentModeKHR present_mode, float fps_limit, bool low_latency);
+
+// Call at the top of the main loop, before polling input.
+void
+frame_pacing_wait(FramePacing& pacing, const FrameScheduler& scheduler, VkDevice device);
+
+// Returns true when the present mode was changed and the swapchain must be rebuilt.
+bool
+frame_pacing_draw_settings(FramePacing& pacing, bool* open);
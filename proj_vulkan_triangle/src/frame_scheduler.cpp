@@ -0,0 +1,172 @@
+#include "frame_scheduler.hpp"
+
+#include "vulkan_utils.hpp"
+
+#include <algorithm>
+
+namespace {
+
+void
+create_render_complete(FrameScheduler& scheduler, VkDevice device, uint32_t image_count, VkAllocationCallbacks* allocator)
+{
+  scheduler.render_complete.assign(image_count, VK_NULL_HANDLE);
+  VkSemaphoreCreateInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  for (VkSemaphore& semaphore : scheduler.render_complete) {
+    VkResult err = vkCreateSemaphore(device, &info, allocator, &semaphore);
+    check_vk_result(err);
+  }
+}
+
+} // namespace
+
+void
+setup_frame_scheduler(FrameScheduler& scheduler, VkDevice device, uint32_t queue_family, uint32_t frames_in_flight, uint32_t image_count, VkAllocationCallbacks* allocator)
+{
+  VkResult err;
+  scheduler.frames_in_flight = std::clamp(frames_in_flight, 1u, max_frames_in_flight);
+  scheduler.frame_slot = 0;
+  scheduler.frame_number = 0;
+
+  {
+    VkSemaphoreTypeCreateInfo type_info = {};
+    type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_info.initialValue = 0;
+    VkSemaphoreCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    info.pNext = &type_info;
+    err = vkCreateSemaphore(device, &info, allocator, &scheduler.timeline);
+    check_vk_result(err);
+  }
+
+  for (uint32_t i = 0; i < scheduler.frames_in_flight; i++) {
+    FrameContext& fc = scheduler.frames[i];
+    {
+      VkCommandPoolCreateInfo info = {};
+      info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+      info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+      info.queueFamilyIndex = queue_family;
+      err = vkCreateCommandPool(device, &info, allocator, &fc.command_pool);
+      check_vk_result(err);
+    }
+    {
+      VkCommandBufferAllocateInfo info = {};
+      info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+      info.commandPool = fc.command_pool;
+      info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+      info.commandBufferCount = 1;
+      err = vkAllocateCommandBuffers(device, &info, &fc.command_buffer);
+      check_vk_result(err);
+    }
+    {
+      VkSemaphoreCreateInfo info = {};
+      info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+      err = vkCreateSemaphore(device, &info, allocator, &fc.image_acquired);
+      check_vk_result(err);
+    }
+    fc.timeline_value = 0;
+  }
+
+  create_render_complete(scheduler, device, image_count, allocator);
+}
+
+void
+cleanup_frame_scheduler(FrameScheduler& scheduler, VkDevice device, VkAllocationCallbacks* allocator)
+{
+  for (uint32_t i = 0; i < scheduler.frames_in_flight; i++) {
+    FrameContext& fc = scheduler.frames[i];
+    vkDestroySemaphore(device, fc.image_acquired, allocator);
+    vkFreeCommandBuffers(device, fc.command_pool, 1, &fc.command_buffer);
+    vkDestroyCommandPool(device, fc.command_pool, allocator);
+    fc = FrameContext{};
+  }
+  for (VkSemaphore semaphore : scheduler.render_complete)
+    vkDestroySemaphore(device, semaphore, allocator);
+  scheduler.render_complete.clear();
+  vkDestroySemaphore(device, scheduler.timeline, allocator);
+  scheduler.timeline = VK_NULL_HANDLE;
+}
+
+void
+frame_scheduler_resize_images(FrameScheduler& scheduler, VkDevice device, uint32_t image_count, VkAllocationCallbacks* allocator, DeletionQueue& deletions, uint64_t retire_value)
+{
+  std::vector<VkSemaphore> retired = std::move(scheduler.render_complete);
+  deletion_queue_push(deletions, retire_value, [device, allocator, retired] {
+    for (VkSemaphore semaphore : retired)
+      vkDestroySemaphore(device, semaphore, allocator);
+  });
+  create_render_complete(scheduler, device, image_count, allocator);
+}
+
+FrameContext&
+frame_scheduler_begin(FrameScheduler& scheduler, VkDevice device)
+{
+  scheduler.frame_slot = static_cast<uint32_t>(scheduler.frame_number % scheduler.frames_in_flight);
+  FrameContext& fc = scheduler.frames[scheduler.frame_slot];
+
+  // Only blocks when the GPU is more than frames_in_flight frames behind
+  frame_scheduler_wait(scheduler, device, fc.timeline_value);
+
+  VkResult err = vkResetCommandPool(device, fc.command_pool, 0);
+  check_vk_result(err);
+
+  SubmitSemaphores& submit = scheduler.submit;
+  submit.wait.clear();
+  submit.wait_values.clear();
+  submit.wait_stages.clear();
+  submit.signal.clear();
+  submit.signal_values.clear();
+  return fc;
+}
+
+uint64_t
+frame_scheduler_signal_value(const FrameScheduler& scheduler)
+{
+  return scheduler.frame_number + 1;
+}
+
+void
+frame_scheduler_end(FrameScheduler& scheduler)
+{
+  scheduler.frames[scheduler.frame_slot].timeline_value = frame_scheduler_signal_value(scheduler);
+  scheduler.frame_number++;
+}
+
+uint64_t
+frame_scheduler_completed_value(const FrameScheduler& scheduler, VkDevice device)
+{
+  uint64_t value = 0;
+  VkResult err = vkGetSemaphoreCounterValue(device, scheduler.timeline, &value);
+  check_vk_result(err);
+  return value;
+}
+
+void
+frame_scheduler_wait(const FrameScheduler& scheduler, VkDevice device, uint64_t value)
+{
+  if (value == 0)
+    return;
+  VkSemaphoreWaitInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  info.semaphoreCount = 1;
+  info.pSemaphores = &scheduler.timeline;
+  info.pValues = &value;
+  VkResult err = vkWaitSemaphores(device, &info, UINT64_MAX);
+  check_vk_result(err);
+}
+
+void
+submit_semaphores_wait(SubmitSemaphores& submit, VkSemaphore semaphore, uint64_t value, VkPipelineStageFlags stage)
+{
+  submit.wait.push_back(semaphore);
+  submit.wait_values.push_back(value);
+  submit.wait_stages.push_back(stage);
+}
+
+void
+submit_semaphores_signal(SubmitSemaphores& submit, VkSemaphore semaphore, uint64_t value)
+{
+  submit.signal.push_back(semaphore);
+  submit.signal_values.push_back(value);
+}
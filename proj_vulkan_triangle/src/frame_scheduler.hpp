@@ -0,0 +1,84 @@
+#pragma once
+
+#include "deletion_queue.hpp"
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// N frames in flight, independent of the swapchain image count.
+// Each frame slot owns its command pool and acquire semaphore. CPU/GPU pacing uses one
+// timeline semaphore: submitting frame n signals n + 1, and a slot is reused once the
+// timeline has reached the value its last submission signalled.
+
+constexpr uint32_t max_frames_in_flight = 8;
+
+struct FrameContext
+{
+  VkCommandPool command_pool = VK_NULL_HANDLE;
+  VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+  VkSemaphore image_acquired = VK_NULL_HANDLE;
+  uint64_t timeline_value = 0; // signalled once this slot's last submission has finished
+};
+
+// Semaphores of one vkQueueSubmit, filled while the frame is recorded. Binary semaphores ignore their value.
+struct SubmitSemaphores
+{
+  std::vector<VkSemaphore> wait;
+  std::vector<uint64_t> wait_values;
+  std::vector<VkPipelineStageFlags> wait_stages;
+  std::vector<VkSemaphore> signal;
+  std::vector<uint64_t> signal_values;
+};
+
+struct FrameScheduler
+{
+  uint32_t frames_in_flight = 2;
+  uint32_t frame_slot = 0;   // slot of the frame being recorded
+  uint64_t frame_number = 0; // frames submitted so far
+  VkSemaphore timeline = VK_NULL_HANDLE;
+  std::array<FrameContext, max_frames_in_flight> frames;
+
+  // Signalled by rendering, waited on by present. One per swapchain image because
+  // an image's previous present is only known to be done once it is acquired again.
+  std::vector<VkSemaphore> render_complete;
+
+  // The current frame's submit, cleared by frame_scheduler_begin (capacity is kept)
+  SubmitSemaphores submit;
+};
+
+void
+setup_frame_scheduler(FrameScheduler& scheduler, VkDevice device, uint32_t queue_family, uint32_t frames_in_flight, uint32_t image_count, VkAllocationCallbacks* allocator);
+
+void
+cleanup_frame_scheduler(FrameScheduler& scheduler, VkDevice device, VkAllocationCallbacks* allocator);
+
+// Replaces the per-image semaphores, call when the swapchain is rebuilt. The old ones may still be
+// waited on by a pending present, they are destroyed once the timeline reaches retire_value.
+void
+frame_scheduler_resize_images(FrameScheduler& scheduler, VkDevice device, uint32_t image_count, VkAllocationCallbacks* allocator, DeletionQueue& deletions, uint64_t retire_value);
+
+// Waits until the next slot's previous submission has finished, resets its command pool and clears submit.
+FrameContext&
+frame_scheduler_begin(FrameScheduler& scheduler, VkDevice device);
+
+// Timeline value the current frame's submission must signal.
+uint64_t
+frame_scheduler_signal_value(const FrameScheduler& scheduler);
+
+// Call after the current frame has been submitted.
+void
+frame_scheduler_end(FrameScheduler& scheduler);
+
+uint64_t
+frame_scheduler_completed_value(const FrameScheduler& scheduler, VkDevice device);
+
+void
+frame_scheduler_wait(const FrameScheduler& scheduler, VkDevice device, uint64_t value);
+
+void
+submit_semaphores_wait(SubmitSemaphores& submit, VkSemaphore semaphore, uint64_t value, VkPipelineStageFlags stage);
+
+void
+submit_semaphores_signal(SubmitSemaphores& submit, VkSemaphore semaphore, uint64_t value);
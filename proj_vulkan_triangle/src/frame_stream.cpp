@@ -0,0 +1,297 @@
+#include "frame_stream.hpp"
+
+#include "vulkan_utils.hpp"
+
+#include <algorithm>
+#include <string.h> // memcpy, strlen
+
+namespace {
+
+bool
+ends_with(const std::string& s, const char* suffix)
+{
+  const size_t n = strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// One row of opaque BGRA pixels
+void
+convert_row(const uint8_t* src, uint32_t width, bool swap_red_blue, std::vector<uint32_t>& row)
+{
+  row.resize(width);
+  uint8_t* dst = reinterpret_cast<uint8_t*>(row.data());
+  for (uint32_t x = 0; x < width; x++, src += 4, dst += 4) {
+    dst[0] = swap_red_blue ? src[2] : src[0];
+    dst[1] = src[1];
+    dst[2] = swap_red_blue ? src[0] : src[2];
+    dst[3] = 255;
+  }
+}
+
+// TGA run-length packets: a repeat count and one pixel, or a literal count and that many pixels, at most 128 each.
+// Packets stay within a row.
+void
+encode_row(const std::vector<uint32_t>& row, std::vector<uint8_t>& out)
+{
+  const uint32_t width = static_cast<uint32_t>(row.size());
+  uint32_t x = 0;
+  while (x < width) {
+    uint32_t run = 1;
+    while (x + run < width && run < 128 && row[x + run] == row[x])
+      run++;
+    if (run > 1) {
+      out.push_back(static_cast<uint8_t>(0x80 | (run - 1)));
+      const uint8_t* pixel = reinterpret_cast<const uint8_t*>(&row[x]);
+      out.insert(out.end(), pixel, pixel + 4);
+      x += run;
+      continue;
+    }
+    // Literal up to the start of the next run
+    uint32_t literal = 1;
+    while (x + literal < width && literal < 128 && !(x + literal + 1 < width && row[x + literal] == row[x + literal + 1]))
+      literal++;
+    out.push_back(static_cast<uint8_t>(literal - 1));
+    const uint8_t* pixels = reinterpret_cast<const uint8_t*>(&row[x]);
+    out.insert(out.end(), pixels, pixels + 4 * literal);
+    x += literal;
+  }
+}
+
+void
+write_tga(FrameStream& stream, const ReadbackSlot& slot, std::vector<uint32_t>& row, std::vector<uint8_t>& out)
+{
+  out.clear();
+  const uint8_t header[18] = {
+    0, 0, 10, // no id, no color map, run-length encoded true color
+    0, 0, 0, 0, 0,
+    0, 0, 0, 0, // origin
+    static_cast<uint8_t>(slot.width), static_cast<uint8_t>(slot.width >> 8),
+    static_cast<uint8_t>(slot.height), static_cast<uint8_t>(slot.height >> 8),
+    32,
+    0x28, // 8 alpha bits, top-left origin
+  };
+  out.insert(out.end(), header, header + sizeof(header));
+  const uint8_t* pixels = static_cast<const uint8_t*>(slot.buffer.allocation.mapped);
+  for (uint32_t y = 0; y < slot.height; y++) {
+    convert_row(pixels + size_t(y) * slot.width * 4, slot.width, slot.swap_red_blue, row);
+    encode_row(row, out);
+  }
+
+  char name[1024];
+  snprintf(name, sizeof(name), "%s_%06llu.tga", stream.path.c_str(), (unsigned long long)slot.frame);
+  FILE* file = fopen(name, "wb");
+  if (file == nullptr) {
+    fprintf(stderr, "[record] Failed to open %s\n", name);
+    stream.frames_dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  fwrite(out.data(), 1, out.size(), file);
+  fclose(file);
+  stream.bytes_written.fetch_add(out.size(), std::memory_order_relaxed);
+  stream.frames_written.fetch_add(1, std::memory_order_relaxed);
+}
+
+void
+write_raw(FrameStream& stream, const ReadbackSlot& slot, std::vector<uint32_t>& row)
+{
+  if (stream.raw_width == 0) {
+    stream.raw_width = slot.width;
+    stream.raw_height = slot.height;
+    printf("[record] %s: raw BGRA %u x %u\n", stream.path.c_str(), slot.width, slot.height);
+  }
+  // A video stream has one size, frames after a resize are left out
+  if (slot.width != stream.raw_width || slot.height != stream.raw_height) {
+    stream.frames_dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  const uint8_t* pixels = static_cast<const uint8_t*>(slot.buffer.allocation.mapped);
+  for (uint32_t y = 0; y < slot.height; y++) {
+    convert_row(pixels + size_t(y) * slot.width * 4, slot.width, slot.swap_red_blue, row);
+    fwrite(row.data(), 4, row.size(), stream.raw_file);
+  }
+  stream.bytes_written.fetch_add(uint64_t(slot.width) * slot.height * 4, std::memory_order_relaxed);
+  stream.frames_written.fetch_add(1, std::memory_order_relaxed);
+}
+
+void
+writer_loop(FrameStream& stream)
+{
+  std::vector<uint32_t> row;
+  std::vector<uint8_t> encoded;
+  for (;;) {
+    uint32_t index;
+    {
+      std::unique_lock<std::mutex> lock(stream.mutex);
+      stream.wake.wait(lock, [&stream] { return stream.stop || !stream.queue.empty(); });
+      if (stream.queue.empty())
+        return; // stopped and drained
+      index = stream.queue.front();
+      stream.queue.pop_front();
+    }
+    ReadbackSlot& slot = stream.slots[index];
+
+    // Only this frame's copy is waited for, the render loop keeps going
+    VkSemaphoreWaitInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    info.semaphoreCount = 1;
+    info.pSemaphores = &stream.timeline;
+    info.pValues = &slot.timeline_value;
+    VkResult err = vkWaitSemaphores(stream.device, &info, UINT64_MAX);
+    check_vk_result(err);
+
+    const VkDeviceSize bytes = VkDeviceSize(slot.width) * slot.height * 4;
+    gpu_invalidate(*stream.gpu, slot.buffer.allocation, 0, bytes);
+    stream.bytes_read.fetch_add(bytes, std::memory_order_relaxed);
+    if (stream.raw)
+      write_raw(stream, slot, row);
+    else
+      write_tga(stream, slot, row, encoded);
+    slot.busy.store(false, std::memory_order_release);
+  }
+}
+
+} // namespace
+
+bool
+setup_frame_stream(FrameStream& stream, GpuAllocator& gpu, VkDevice device, VkSemaphore timeline, uint32_t slot_count, const char* path)
+{
+  stream.gpu = &gpu;
+  stream.device = device;
+  stream.timeline = timeline;
+  stream.path = path;
+  stream.raw = ends_with(stream.path, ".bgra");
+  stream.slot_count = std::min(std::max(slot_count, 1u), frame_stream_max_slots);
+  if (stream.raw) {
+    stream.raw_file = fopen(path, "wb");
+    if (stream.raw_file == nullptr) {
+      fprintf(stderr, "[record] Failed to open %s\n", path);
+      return false;
+    }
+  }
+  stream.stop = false;
+  stream.writer = std::thread([&stream] { writer_loop(stream); });
+  return true;
+}
+
+void
+cleanup_frame_stream(FrameStream& stream)
+{
+  if (!stream.writer.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(stream.mutex);
+    stream.stop = true;
+  }
+  stream.wake.notify_one();
+  stream.writer.join();
+
+  for (uint32_t i = 0; i < stream.slot_count; i++)
+    if (stream.slots[i].buffer.buffer != VK_NULL_HANDLE)
+      gpu_destroy_buffer(*stream.gpu, stream.slots[i].buffer);
+  if (stream.raw_file) {
+    fclose(stream.raw_file);
+    stream.raw_file = nullptr;
+  }
+  const uint64_t read = stream.bytes_read.load();
+  const uint64_t written = stream.bytes_written.load();
+  printf("[record] %llu frames written, %llu dropped: %.1f MB read back, %.1f MB written (%.1f%%)\n",
+         (unsigned long long)stream.frames_written.load(),
+         (unsigned long long)stream.frames_dropped.load(),
+         read / (1024.0 * 1024.0),
+         written / (1024.0 * 1024.0),
+         read > 0 ? 100.0 * written / read : 0.0);
+}
+
+bool
+frame_stream_supports(VkFormat format)
+{
+  switch (format) {
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool
+frame_stream_record(FrameStream& stream,
+                    VkCommandBuffer command_buffer,
+                    VkImage image,
+                    VkImageLayout layout,
+                    VkFormat format,
+                    uint32_t width,
+                    uint32_t height,
+                    uint64_t signal_value)
+{
+  // Next in ring order, still queued when the writer or the GPU is behind
+  ReadbackSlot& slot = stream.slots[stream.next_slot];
+  if (!frame_stream_supports(format) || slot.busy.load(std::memory_order_acquire)) {
+    stream.frames_dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  // Idle: the writer has waited for its last copy
+  const VkDeviceSize bytes = VkDeviceSize(width) * height * 4;
+  if (slot.buffer.size < bytes) {
+    if (slot.buffer.buffer != VK_NULL_HANDLE)
+      gpu_destroy_buffer(*stream.gpu, slot.buffer);
+    if (!gpu_create_buffer(*stream.gpu, bytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT, slot.buffer)) {
+      stream.frames_dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+  }
+
+  // The render pass left the image in layout, its color writes happen before the copy
+  VkImageMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  barrier.oldLayout = layout;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+  VkBufferImageCopy region = {};
+  region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+  region.imageExtent = { width, height, 1 };
+  vkCmdCopyImageToBuffer(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer.buffer, 1, &region);
+
+  // Back to layout for present; the semaphore it waits on covers the copy
+  if (layout != VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) {
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.dstAccessMask = 0;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = layout;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+  }
+  // Make the copy visible to host reads once the timeline is signalled
+  VkBufferMemoryBarrier host = {};
+  host.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  host.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  host.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  host.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  host.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  host.buffer = slot.buffer.buffer;
+  host.size = bytes;
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &host, 0, nullptr);
+
+  slot.timeline_value = signal_value;
+  slot.frame = stream.frames_recorded++;
+  slot.width = width;
+  slot.height = height;
+  slot.swap_red_blue = format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB;
+  slot.busy.store(true, std::memory_order_relaxed);
+  // Waiting on a timeline value before it is submitted is allowed, the writer just blocks until then
+  {
+    std::lock_guard<std::mutex> lock(stream.mutex);
+    stream.queue.push_back(stream.next_slot);
+  }
+  stream.wake.notify_one();
+  stream.next_slot = (stream.next_slot + 1) % stream.slot_count;
+  return true;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "frame_scheduler.hpp" // max_frames_in_flight
+#include "gpu_allocator.hpp"
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Frame recording without stalling the renderer.
+// After the render pass the target image is copied into one of a ring of persistently mapped,
+// host-visible buffers; the copy is done once the timeline reaches the frame's signal value.
+// A writer thread waits for that value on the timeline semaphore (never on the device or the
+// queue), compresses the pixels, writes them out and hands the buffer back to the ring. A frame
+// that finds every buffer still queued is not recorded (counted as dropped) instead of waited for.
+//
+// A path ending in ".bgra" is written as one raw BGRA video stream, anything else is the prefix of
+// a run-length encoded TGA sequence: path_000000.tga, path_000001.tga, ...
+
+constexpr uint32_t frame_stream_max_slots = max_frames_in_flight + 2;
+
+struct ReadbackSlot
+{
+  GpuBuffer buffer;
+  uint64_t timeline_value = 0; // the copy has finished once the timeline reaches it
+  uint64_t frame = 0;          // index in the recording
+  uint32_t width = 0;
+  uint32_t height = 0;
+  bool swap_red_blue = false;      // RGBA image, written as BGRA
+  std::atomic<bool> busy{ false }; // queued for or owned by the writer thread
+};
+
+struct FrameStream
+{
+  GpuAllocator* gpu = nullptr;
+  VkDevice device = VK_NULL_HANDLE;
+  VkSemaphore timeline = VK_NULL_HANDLE;
+  std::string path;
+  bool raw = false;
+
+  // Render thread
+  std::array<ReadbackSlot, frame_stream_max_slots> slots;
+  uint32_t slot_count = 0;
+  uint32_t next_slot = 0;
+  uint64_t frames_recorded = 0;
+
+  // Writer thread
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<uint32_t> queue; // slots in recording order
+  bool stop = false;
+  std::thread writer;
+  FILE* raw_file = nullptr;
+  uint32_t raw_width = 0; // a raw stream keeps the first frame's size
+  uint32_t raw_height = 0;
+
+  std::atomic<uint64_t> frames_written{ 0 };
+  std::atomic<uint64_t> frames_dropped{ 0 };
+  std::atomic<uint64_t> bytes_read{ 0 };
+  std::atomic<uint64_t> bytes_written{ 0 };
+};
+
+// slot_count buffers (up to frame_stream_max_slots): frames_in_flight + 2 lets the writer fall two frames behind.
+// Buffers are sized by the first frame that uses them. False when the output cannot be opened.
+bool
+setup_frame_stream(FrameStream& stream, GpuAllocator& gpu, VkDevice device, VkSemaphore timeline, uint32_t slot_count, const char* path);
+
+// Writes out what is still queued, stops the writer and frees the buffers. Prints what was recorded.
+void
+cleanup_frame_stream(FrameStream& stream);
+
+// 8-bit RGBA and BGRA images can be recorded
+bool
+frame_stream_supports(VkFormat format);
+
+// Records the copy of image, in layout before and after, and queues it for the writer thread, which
+// waits for signal_value: the value this command buffer's submission signals on the timeline.
+// False when the frame was dropped.
+bool
+frame_stream_record(FrameStream& stream,
+                    VkCommandBuffer command_buffer,
+                    VkImage image,
+                    VkImageLayout layout,
+                    VkFormat format,
+                    uint32_t width,
+                    uint32_t height,
+                    uint64_t signal_value);
@@ -0,0 +1,367 @@
+#include "frame_timings.hpp"
+
+#include "imgui.h"
+#include "vulkan_utils.hpp"
+
+#include <algorithm>
+#include <stdio.h>
+#include <vector>
+
+const char*
+frame_stage_name(FrameStage stage)
+{
+  switch (stage) {
+    case FrameStage::pacing:
+      return "pacing";
+    case FrameStage::poll_events:
+      return "poll_events";
+    case FrameStage::imgui_new_frame:
+      return "imgui_new_frame";
+    case FrameStage::imgui_render:
+      return "imgui_render";
+    case FrameStage::handoff:
+      return "handoff";
+    case FrameStage::wait_gpu:
+      return "wait_gpu";
+    case FrameStage::record:
+      return "record";
+    case FrameStage::submit:
+      return "queue_submit";
+    case FrameStage::viewports:
+      return "viewports";
+    case FrameStage::present:
+      return "queue_present";
+    case FrameStage::COUNT:
+      break;
+  }
+  return "frame";
+}
+
+void
+setup_frame_timings(FrameTimings& ft, VkPhysicalDevice physical_device, VkDevice device, uint32_t queue_family, VkAllocationCallbacks* allocator)
+{
+  ft.epoch = std::chrono::steady_clock::now();
+  ft.frame = 0;
+  ft.slot_frame.fill(UINT64_MAX);
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+  uint32_t count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, NULL);
+  std::vector<VkQueueFamilyProperties> queue_families(count);
+  vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, queue_families.data());
+  const uint32_t valid_bits = queue_family < count ? queue_families[queue_family].timestampValidBits : 0;
+
+  ft.gpu_supported = valid_bits > 0 && properties.limits.timestampPeriod > 0.0f;
+  if (!ft.gpu_supported) {
+    printf("[timings] GPU timestamps not supported on this queue\n");
+    return;
+  }
+  ft.timestamp_period_ns = properties.limits.timestampPeriod;
+  ft.timestamp_mask = valid_bits >= 64 ? UINT64_MAX : ((uint64_t(1) << valid_bits) - 1);
+
+  VkQueryPoolCreateInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  info.queryCount = frame_timings_max_gpu_slots * 2;
+  VkResult err = vkCreateQueryPool(device, &info, allocator, &ft.query_pool);
+  check_vk_result(err);
+}
+
+void
+cleanup_frame_timings(FrameTimings& ft, VkDevice device, VkAllocationCallbacks* allocator)
+{
+  vkDestroyQueryPool(device, ft.query_pool, allocator);
+  ft.query_pool = VK_NULL_HANDLE;
+  ft.gpu_supported = false;
+}
+
+double
+frame_timings_now_ms(const FrameTimings& ft)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - ft.epoch).count();
+}
+
+void
+frame_timings_begin_frame(FrameTimings& ft)
+{
+  const double now = frame_timings_now_ms(ft);
+  FrameTimingRecord& prev = ft.records[ft.frame % frame_timings_history];
+  if (prev.frame == ft.frame) {
+    prev.total_ms = static_cast<float>(now - prev.start_ms);
+    ft.frame++;
+  }
+  FrameTimingRecord& record = ft.records[ft.frame % frame_timings_history];
+  record = FrameTimingRecord{};
+  record.frame = ft.frame;
+  record.start_ms = now;
+}
+
+void
+frame_timings_add_cpu(FrameTimings& ft, FrameStage stage, double begin_ms, double end_ms)
+{
+  FrameTimingRecord& record = ft.records[ft.frame % frame_timings_history];
+  const uint32_t i = static_cast<uint32_t>(stage);
+  if (record.cpu_ms[i] == 0.0f)
+    record.begin_ms[i] = static_cast<float>(begin_ms - record.start_ms);
+  record.cpu_ms[i] += static_cast<float>(end_ms - begin_ms); // stages hit more than once per frame accumulate
+}
+
+FrameTimingScope::FrameTimingScope(FrameTimings& ft, FrameStage stage)
+  : ft(ft)
+  , stage(stage)
+  , begin_ms(frame_timings_now_ms(ft))
+{
+}
+
+FrameTimingScope::~FrameTimingScope()
+{
+  frame_timings_add_cpu(ft, stage, begin_ms, frame_timings_now_ms(ft));
+}
+
+void
+frame_timings_collect_gpu(FrameTimings& ft, VkDevice device, uint32_t slot)
+{
+  if (!ft.gpu_supported)
+    return;
+  slot %= frame_timings_max_gpu_slots;
+  const uint64_t frame = ft.slot_frame[slot];
+  if (frame == UINT64_MAX)
+    return;
+
+  uint64_t ticks[2] = {};
+  VkResult err = vkGetQueryPoolResults(device, ft.query_pool, slot * 2, 2, sizeof(ticks), ticks, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+  if (err == VK_NOT_READY)
+    return;
+  check_vk_result(err);
+  ft.slot_frame[slot] = UINT64_MAX;
+
+  FrameTimingRecord& record = ft.records[frame % frame_timings_history];
+  if (record.frame != frame)
+    return; // already overwritten
+
+  const double ns_to_ms = ft.timestamp_period_ns / 1e6;
+  const uint64_t delta = ((ticks[1] & ft.timestamp_mask) - (ticks[0] & ft.timestamp_mask)) & ft.timestamp_mask;
+  const double gpu_begin_ms = static_cast<double>(ticks[0] & ft.timestamp_mask) * ns_to_ms;
+
+  // The GPU clock is a different time domain. Place GPU work no earlier than the end of its submit:
+  // the offset only ever grows, so it converges on the smallest observed submit->execute latency.
+  const uint32_t submit = static_cast<uint32_t>(FrameStage::submit);
+  const double submit_end_ms = record.start_ms + record.begin_ms[submit] + record.cpu_ms[submit];
+  const double offset = submit_end_ms - gpu_begin_ms;
+  if (!ft.gpu_offset_known || offset > ft.gpu_to_cpu_offset_ms) {
+    ft.gpu_to_cpu_offset_ms = offset;
+    ft.gpu_offset_known = true;
+  }
+
+  record.gpu_ms = static_cast<float>(static_cast<double>(delta) * ns_to_ms);
+  record.gpu_begin_ms = static_cast<float>(gpu_begin_ms + ft.gpu_to_cpu_offset_ms - record.start_ms);
+  record.gpu_valid = true;
+}
+
+void
+frame_timings_write_gpu_begin(FrameTimings& ft, VkCommandBuffer command_buffer, uint32_t slot)
+{
+  if (!ft.gpu_supported)
+    return;
+  slot %= frame_timings_max_gpu_slots;
+  vkCmdResetQueryPool(command_buffer, ft.query_pool, slot * 2, 2);
+  vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, ft.query_pool, slot * 2);
+  ft.slot_frame[slot] = ft.frame;
+}
+
+void
+frame_timings_write_gpu_end(FrameTimings& ft, VkCommandBuffer command_buffer, uint32_t slot)
+{
+  if (!ft.gpu_supported)
+    return;
+  slot %= frame_timings_max_gpu_slots;
+  vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, ft.query_pool, slot * 2 + 1);
+}
+
+static float
+record_value(const FrameTimingRecord& record, FrameStage stage, bool gpu)
+{
+  if (gpu)
+    return record.gpu_ms;
+  if (stage == FrameStage::COUNT)
+    return record.total_ms;
+  return record.cpu_ms[static_cast<uint32_t>(stage)];
+}
+
+FrameTimingPercentiles
+frame_timings_percentiles(FrameTimings& ft, FrameStage stage, bool gpu)
+{
+  size_t n = 0;
+  for (const FrameTimingRecord& record : ft.records) {
+    // only completed frames
+    if (record.frame == UINT64_MAX || record.frame >= ft.frame)
+      continue;
+    if (gpu && !record.gpu_valid)
+      continue;
+    ft.scratch[n++] = record_value(record, stage, gpu);
+  }
+
+  FrameTimingPercentiles result;
+  if (n == 0)
+    return result;
+  std::sort(ft.scratch.begin(), ft.scratch.begin() + n);
+  const auto at = [&](double p) { return ft.scratch[std::min(n - 1, static_cast<size_t>(p * (n - 1) + 0.5))]; };
+  result.p50 = at(0.50);
+  result.p95 = at(0.95);
+  result.p99 = at(0.99);
+  result.max = ft.scratch[n - 1];
+  return result;
+}
+
+static float
+plot_frame_time(void* data, int idx)
+{
+  const FrameTimings& ft = *static_cast<const FrameTimings*>(data);
+  const int64_t frame = static_cast<int64_t>(ft.frame) - frame_timings_history + idx;
+  if (frame < 0)
+    return 0.0f;
+  const FrameTimingRecord& record = ft.records[frame % frame_timings_history];
+  return record.frame == static_cast<uint64_t>(frame) ? record.total_ms : 0.0f;
+}
+
+void
+frame_timings_draw_overlay(FrameTimings& ft, bool* open)
+{
+  ImGui::SetNextWindowSize(ImVec2(440, 0), ImGuiCond_FirstUseEver);
+  if (!ImGui::Begin("Frame timings", open)) {
+    ImGui::End();
+    return;
+  }
+
+  const FrameTimingPercentiles total = frame_timings_percentiles(ft, FrameStage::COUNT);
+  ImGui::Text("frame %llu, p50 %.2f ms (%.0f fps)", (unsigned long long)ft.frame, total.p50, total.p50 > 0.0f ? 1000.0f / total.p50 : 0.0f);
+  ImGui::PlotLines("##frame_ms", plot_frame_time, &ft, frame_timings_history, 0, "frame ms", 0.0f, std::max(total.p99 * 1.5f, 1.0f), ImVec2(-1.0f, 60.0f));
+
+  const ImGuiTableFlags flags = ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_SizingStretchProp;
+  if (ImGui::BeginTable("##percentiles", 5, flags)) {
+    ImGui::TableSetupColumn("ms");
+    ImGui::TableSetupColumn("p50");
+    ImGui::TableSetupColumn("p95");
+    ImGui::TableSetupColumn("p99");
+    ImGui::TableSetupColumn("max");
+    ImGui::TableHeadersRow();
+    const auto row = [](const char* name, const FrameTimingPercentiles& p) {
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(name);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.3f", p.p50);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.3f", p.p95);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.3f", p.p99);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.3f", p.max);
+    };
+    row("frame", total);
+    for (uint32_t i = 0; i < frame_stage_count; i++)
+      row(frame_stage_name(static_cast<FrameStage>(i)), frame_timings_percentiles(ft, static_cast<FrameStage>(i)));
+    if (ft.gpu_supported)
+      row("gpu frame", frame_timings_percentiles(ft, FrameStage::COUNT, true));
+    ImGui::EndTable();
+  }
+
+  if (ImGui::Button("Export trace"))
+    frame_timings_export_trace(ft, "frame_timings.json");
+  ImGui::SameLine();
+  if (ImGui::Button("Export CSV"))
+    frame_timings_export_csv(ft, "frame_timings.csv");
+
+  ImGui::End();
+}
+
+void
+frame_timings_print_summary(FrameTimings& ft)
+{
+  const auto print = [](const char* name, const FrameTimingPercentiles& p) {
+    printf("  %-16s p50 %8.3f  p95 %8.3f  p99 %8.3f  max %8.3f ms\n", name, p.p50, p.p95, p.p99, p.max);
+  };
+  printf("[timings] last %u frames:\n", frame_timings_history);
+  print("frame", frame_timings_percentiles(ft, FrameStage::COUNT));
+  for (uint32_t i = 0; i < frame_stage_count; i++)
+    print(frame_stage_name(static_cast<FrameStage>(i)), frame_timings_percentiles(ft, static_cast<FrameStage>(i)));
+  if (ft.gpu_supported)
+    print("gpu frame", frame_timings_percentiles(ft, FrameStage::COUNT, true));
+}
+
+// Calls fn for every completed frame in the ring, oldest first
+template<typename Fn>
+static void
+for_each_completed(const FrameTimings& ft, Fn&& fn)
+{
+  const uint64_t first = ft.frame > frame_timings_history ? ft.frame - frame_timings_history : 0;
+  for (uint64_t frame = first; frame < ft.frame; frame++) {
+    const FrameTimingRecord& record = ft.records[frame % frame_timings_history];
+    if (record.frame == frame)
+      fn(record);
+  }
+}
+
+bool
+frame_timings_export_trace(const FrameTimings& ft, const char* path)
+{
+  FILE* f = fopen(path, "wb");
+  if (!f) {
+    fprintf(stderr, "[timings] failed to open %s\n", path);
+    return false;
+  }
+
+  bool first = true;
+  const auto event = [&](const char* name, uint32_t tid, double begin_ms, double duration_ms, uint64_t frame) {
+    fprintf(f, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}", first ? "" : ",", name, tid, begin_ms * 1000.0, duration_ms * 1000.0, (unsigned long long)frame);
+    first = false;
+  };
+
+  fprintf(f, "{\"traceEvents\":[");
+  fprintf(f, "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"CPU\"}},");
+  fprintf(f, "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"GPU (approximate alignment)\"}},");
+  for_each_completed(ft, [&](const FrameTimingRecord& record) {
+    event("frame", 0, record.start_ms, record.total_ms, record.frame);
+    for (uint32_t i = 0; i < frame_stage_count; i++) {
+      if (record.cpu_ms[i] > 0.0f)
+        event(frame_stage_name(static_cast<FrameStage>(i)), 0, record.start_ms + record.begin_ms[i], record.cpu_ms[i], record.frame);
+    }
+    if (record.gpu_valid)
+      event("gpu_frame", 1, record.start_ms + record.gpu_begin_ms, record.gpu_ms, record.frame);
+  });
+  fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+  fclose(f);
+
+  printf("[timings] wrote %s\n", path);
+  return true;
+}
+
+bool
+frame_timings_export_csv(const FrameTimings& ft, const char* path)
+{
+  FILE* f = fopen(path, "wb");
+  if (!f) {
+    fprintf(stderr, "[timings] failed to open %s\n", path);
+    return false;
+  }
+
+  fprintf(f, "frame,start_ms,total_ms");
+  for (uint32_t i = 0; i < frame_stage_count; i++)
+    fprintf(f, ",%s_ms", frame_stage_name(static_cast<FrameStage>(i)));
+  fprintf(f, ",gpu_ms\n");
+  for_each_completed(ft, [&](const FrameTimingRecord& record) {
+    fprintf(f, "%llu,%.3f,%.3f", (unsigned long long)record.frame, record.start_ms, record.total_ms);
+    for (uint32_t i = 0; i < frame_stage_count; i++)
+      fprintf(f, ",%.3f", record.cpu_ms[i]);
+    if (record.gpu_valid)
+      fprintf(f, ",%.3f\n", record.gpu_ms);
+    else
+      fprintf(f, ",\n");
+  });
+  fclose(f);
+
+  printf("[timings] wrote %s\n", path);
+  return true;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+// Per-frame CPU/GPU timings kept in a fixed-size ring (no allocations after setup).
+// CPU stages are timed with FrameTimingScope, the GPU side with timestamp queries
+// written at the start and end of the frame's command buffer (uploads, culling, every pass and copy).
+
+enum class FrameStage : uint8_t
+{
+  pacing,
+  poll_events,
+  imgui_new_frame,
+  imgui_render,
+  handoff, // deep copy of the draw data for the render thread
+  wait_gpu,
+  record,
+  submit,
+  viewports,
+  present,
+  COUNT
+};
+
+constexpr uint32_t frame_timings_history = 512;
+constexpr uint32_t frame_timings_max_gpu_slots = 16;
+constexpr uint32_t frame_stage_count = static_cast<uint32_t>(FrameStage::COUNT);
+
+struct FrameTimingRecord
+{
+  uint64_t frame = UINT64_MAX;
+  double start_ms = 0.0; // since FrameTimings::epoch
+  float total_ms = 0.0f; // start of this frame -> start of next frame
+  std::array<float, frame_stage_count> begin_ms{}; // relative to start_ms
+  std::array<float, frame_stage_count> cpu_ms{};
+  float gpu_begin_ms = 0.0f; // relative to start_ms, approximate (see frame_timings_collect_gpu)
+  float gpu_ms = 0.0f;
+  bool gpu_valid = false;
+};
+
+struct FrameTimings
+{
+  std::chrono::steady_clock::time_point epoch;
+  std::array<FrameTimingRecord, frame_timings_history> records;
+  uint64_t frame = 0; // frame currently being recorded
+
+  // gpu
+  bool gpu_supported = false;
+  VkQueryPool query_pool = VK_NULL_HANDLE;
+  float timestamp_period_ns = 1.0f;
+  uint64_t timestamp_mask = 0;
+  double gpu_to_cpu_offset_ms = 0.0;
+  bool gpu_offset_known = false;
+  std::array<uint64_t, frame_timings_max_gpu_slots> slot_frame;
+
+  // scratch for percentiles, avoids allocating while drawing the overlay
+  std::array<float, frame_timings_history> scratch;
+};
+
+void
+setup_frame_timings(FrameTimings& ft, VkPhysicalDevice physical_device, VkDevice device, uint32_t queue_family, VkAllocationCallbacks* allocator);
+
+void
+cleanup_frame_timings(FrameTimings& ft, VkDevice device, VkAllocationCallbacks* allocator);
+
+// Call once at the top of the main loop.
+void
+frame_timings_begin_frame(FrameTimings& ft);
+
+double
+frame_timings_now_ms(const FrameTimings& ft);
+
+void
+frame_timings_add_cpu(FrameTimings& ft, FrameStage stage, double begin_ms, double end_ms);
+
+struct FrameTimingScope
+{
+  FrameTimingScope(FrameTimings& ft, FrameStage stage);
+  ~FrameTimingScope();
+
+  FrameTimings& ft;
+  FrameStage stage;
+  double begin_ms;
+};
+
+// GPU timestamps. slot identifies the per-frame resources (e.g. wd->FrameIndex);
+// collect must be called after that slot's previous submission has completed and before writing it again.
+void
+frame_timings_collect_gpu(FrameTimings& ft, VkDevice device, uint32_t slot);
+
+void
+frame_timings_write_gpu_begin(FrameTimings& ft, VkCommandBuffer command_buffer, uint32_t slot);
+
+void
+frame_timings_write_gpu_end(FrameTimings& ft, VkCommandBuffer command_buffer, uint32_t slot);
+
+// Percentile over the frames currently in the ring (stage == COUNT for the whole-frame time, gpu for the frame's command buffer).
+struct FrameTimingPercentiles
+{
+  float p50 = 0.0f;
+  float p95 = 0.0f;
+  float p99 = 0.0f;
+  float max = 0.0f;
+};
+
+FrameTimingPercentiles
+frame_timings_percentiles(FrameTimings& ft, FrameStage stage, bool gpu = false);
+
+void
+frame_timings_draw_overlay(FrameTimings& ft, bool* open);
+
+void
+frame_timings_print_summary(FrameTimings& ft);
+
+// Chrome trace (chrome://tracing, https://ui.perfetto.dev) and CSV export
+bool
+frame_timings_export_trace(const FrameTimings& ft, const char* path);
+
+bool
+frame_timings_export_csv(const FrameTimings& ft, const char* path);
+
+const char*
+frame_stage_name(FrameStage stage);
@@ -0,0 +1,542 @@
+#include "gpu_allocator.hpp"
+
+#include "imgui.h"
+#include "vulkan_utils.hpp"
+
+#include <algorithm>
+#include <stdio.h>
+
+namespace {
+
+constexpr VkDeviceSize min_block = 256;
+constexpr uint32_t no_block = UINT32_MAX;
+
+uint32_t
+ceil_log2(VkDeviceSize v)
+{
+  uint32_t r = 0;
+  while ((VkDeviceSize(1) << r) < v)
+    r++;
+  return r;
+}
+
+VkDeviceSize
+align_up(VkDeviceSize v, VkDeviceSize alignment)
+{
+  return (v + alignment - 1) / alignment * alignment;
+}
+
+// Buddy tree helpers. Node i at depth d covers (min_block << (levels - d)) bytes,
+// and stores 1 + the order of the largest free block in its subtree (0 when nothing is free).
+
+void
+buddy_init(GpuMemoryBlock& block)
+{
+  block.nodes.assign((size_t(2) << block.levels) - 1, 0);
+  size_t first = 0;
+  for (uint32_t depth = 0; depth <= block.levels; depth++) {
+    const size_t count = size_t(1) << depth;
+    std::fill(block.nodes.begin() + first, block.nodes.begin() + first + count, static_cast<uint8_t>(block.levels - depth + 1));
+    first += count;
+  }
+}
+
+void
+buddy_update_parents(GpuMemoryBlock& block, size_t idx, uint32_t order)
+{
+  while (idx > 0) {
+    idx = (idx - 1) / 2;
+    order++;
+    const uint8_t l = block.nodes[2 * idx + 1];
+    const uint8_t r = block.nodes[2 * idx + 2];
+    // both halves entirely free: merge back into one block of this order
+    block.nodes[idx] = (l == order && r == order) ? static_cast<uint8_t>(order + 1) : std::max(l, r);
+  }
+}
+
+// Returns the offset in min_block units, or UINT64_MAX
+uint64_t
+buddy_alloc(GpuMemoryBlock& block, uint32_t order)
+{
+  if (order > block.levels || block.nodes[0] < order + 1)
+    return UINT64_MAX;
+
+  size_t idx = 0;
+  for (uint32_t node_order = block.levels; node_order > order; node_order--) {
+    const size_t l = 2 * idx + 1;
+    const size_t r = l + 1;
+    // best fit: descend into the child with the smaller (but sufficient) free block
+    const bool l_fits = block.nodes[l] >= order + 1;
+    const bool r_fits = block.nodes[r] >= order + 1;
+    if (l_fits && r_fits)
+      idx = block.nodes[l] <= block.nodes[r] ? l : r;
+    else
+      idx = l_fits ? l : r;
+  }
+  block.nodes[idx] = 0;
+  buddy_update_parents(block, idx, order);
+
+  const size_t first_at_order = (size_t(1) << (block.levels - order)) - 1;
+  return static_cast<uint64_t>(idx - first_at_order) << order;
+}
+
+void
+buddy_free(GpuMemoryBlock& block, uint64_t offset_units, uint32_t order)
+{
+  const size_t first_at_order = (size_t(1) << (block.levels - order)) - 1;
+  const size_t idx = first_at_order + static_cast<size_t>(offset_units >> order);
+  block.nodes[idx] = static_cast<uint8_t>(order + 1);
+  buddy_update_parents(block, idx, order);
+}
+
+// Counts maximal free ranges: fully-free nodes whose parent is not fully free
+void
+buddy_free_ranges(const GpuMemoryBlock& block, uint32_t& ranges, VkDeviceSize& free_bytes)
+{
+  size_t first = 0;
+  for (uint32_t depth = 0; depth <= block.levels; depth++) {
+    const uint32_t order = block.levels - depth;
+    const size_t count = size_t(1) << depth;
+    for (size_t idx = first; idx < first + count; idx++) {
+      if (block.nodes[idx] != order + 1)
+        continue;
+      const bool parent_full = idx > 0 && block.nodes[(idx - 1) / 2] == order + 2;
+      if (!parent_full) {
+        ranges++;
+        free_bytes += min_block << order;
+      }
+    }
+    first += count;
+  }
+}
+
+uint32_t
+select_memory_type(const GpuAllocator& gpu, uint32_t type_bits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred)
+{
+  const VkMemoryPropertyFlags wanted[] = { required | preferred, required };
+  for (VkMemoryPropertyFlags flags : wanted) {
+    for (uint32_t i = 0; i < gpu.memory_properties.memoryTypeCount; i++) {
+      if ((type_bits & (1u << i)) && (gpu.memory_properties.memoryTypes[i].propertyFlags & flags) == flags)
+        return i;
+    }
+  }
+  return UINT32_MAX;
+}
+
+bool
+allocate_device_memory(GpuAllocator& gpu, uint32_t memory_type, VkDeviceSize size, VkDeviceMemory& memory, void*& mapped)
+{
+  if (gpu.max_allocation_count > 0 && gpu.device_memory_count >= gpu.max_allocation_count)
+    return false;
+
+  VkMemoryAllocateInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  info.allocationSize = size;
+  info.memoryTypeIndex = memory_type;
+  VkResult err = vkAllocateMemory(gpu.device, &info, gpu.allocator, &memory);
+  if (err == VK_ERROR_OUT_OF_DEVICE_MEMORY || err == VK_ERROR_OUT_OF_HOST_MEMORY)
+    return false;
+  check_vk_result(err);
+  gpu.device_memory_count++;
+
+  mapped = nullptr;
+  if (gpu.memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    err = vkMapMemory(gpu.device, memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+    check_vk_result(err);
+  }
+  return true;
+}
+
+void
+free_device_memory(GpuAllocator& gpu, VkDeviceMemory memory)
+{
+  vkFreeMemory(gpu.device, memory, gpu.allocator); // implicitly unmaps
+  gpu.device_memory_count--;
+}
+
+} // namespace
+
+void
+setup_gpu_allocator(GpuAllocator& gpu, VkPhysicalDevice physical_device, VkDevice device, VkAllocationCallbacks* allocator)
+{
+  gpu.physical_device = physical_device;
+  gpu.device = device;
+  gpu.allocator = allocator;
+  vkGetPhysicalDeviceMemoryProperties(physical_device, &gpu.memory_properties);
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physical_device, &properties);
+  gpu.buffer_image_granularity = properties.limits.bufferImageGranularity;
+  gpu.non_coherent_atom_size = properties.limits.nonCoherentAtomSize;
+  gpu.max_allocation_count = properties.limits.maxMemoryAllocationCount;
+}
+
+void
+cleanup_gpu_allocator(GpuAllocator& gpu)
+{
+  std::lock_guard<std::mutex> lock(gpu.mutex);
+  for (uint32_t type = 0; type < VK_MAX_MEMORY_TYPES; type++) {
+    for (GpuMemoryBlock& block : gpu.blocks[type]) {
+      if (block.allocations > 0)
+        fprintf(stderr, "[gpu allocator] memory type %u: block freed with %u live allocations\n", type, block.allocations);
+      if (block.memory != VK_NULL_HANDLE)
+        free_device_memory(gpu, block.memory);
+    }
+    gpu.blocks[type].clear();
+    if (gpu.dedicated_count[type] > 0)
+      fprintf(stderr, "[gpu allocator] memory type %u: %u dedicated allocations leaked\n", type, gpu.dedicated_count[type]);
+  }
+}
+
+bool
+gpu_allocate(GpuAllocator& gpu, const VkMemoryRequirements& requirements, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, GpuResourceKind kind, GpuAllocation& out)
+{
+  const uint32_t memory_type = select_memory_type(gpu, requirements.memoryTypeBits, required, preferred);
+  if (memory_type == UINT32_MAX)
+    return false;
+
+  // Without any granularity restriction buffers and images may share blocks
+  if (gpu.buffer_image_granularity <= 1)
+    kind = GpuResourceKind::linear;
+
+  VkDeviceSize size = std::max(requirements.size, requirements.alignment);
+  if (gpu.memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    size = align_up(size, gpu.non_coherent_atom_size); // flush ranges never spill into a neighbour
+  const uint32_t order = ceil_log2((size + min_block - 1) / min_block);
+
+  std::lock_guard<std::mutex> lock(gpu.mutex);
+
+  // Keep big resources out of the blocks
+  if ((min_block << order) > gpu.block_size / 2) {
+    out = GpuAllocation{};
+    if (!allocate_device_memory(gpu, memory_type, requirements.size, out.memory, out.mapped))
+      return false;
+    out.size = requirements.size;
+    out.memory_type = memory_type;
+    out.block = no_block;
+    gpu.dedicated_count[memory_type]++;
+    return true;
+  }
+
+  std::vector<GpuMemoryBlock>& blocks = gpu.blocks[memory_type];
+  for (uint32_t b = 0; b <= blocks.size(); b++) {
+    if (b == blocks.size()) {
+      // No room anywhere: reuse an empty slot or take a new block from the driver
+      uint32_t slot = no_block;
+      for (uint32_t i = 0; i < blocks.size(); i++) {
+        if (blocks[i].memory == VK_NULL_HANDLE) {
+          slot = i;
+          break;
+        }
+      }
+      if (slot == no_block) {
+        slot = static_cast<uint32_t>(blocks.size());
+        blocks.emplace_back();
+      }
+      GpuMemoryBlock& block = blocks[slot];
+      const VkDeviceSize heap_size = gpu.memory_properties.memoryHeaps[gpu.memory_properties.memoryTypes[memory_type].heapIndex].size;
+      block.size = gpu.block_size;
+      while (block.size > heap_size / 4 && block.size > (min_block << order) * 2)
+        block.size /= 2;
+      if (!allocate_device_memory(gpu, memory_type, block.size, block.memory, block.mapped)) {
+        block = GpuMemoryBlock{};
+        return false;
+      }
+      block.kind = kind;
+      block.levels = ceil_log2(block.size / min_block);
+      block.used = 0;
+      block.allocations = 0;
+      buddy_init(block);
+      b = slot;
+    }
+
+    GpuMemoryBlock& block = blocks[b];
+    if (block.memory == VK_NULL_HANDLE || block.kind != kind)
+      continue;
+    const uint64_t offset_units = buddy_alloc(block, order);
+    if (offset_units == UINT64_MAX)
+      continue;
+
+    out.memory = block.memory;
+    out.offset = offset_units * min_block;
+    out.size = min_block << order;
+    out.mapped = block.mapped ? static_cast<uint8_t*>(block.mapped) + out.offset : nullptr;
+    out.memory_type = memory_type;
+    out.block = b;
+    out.order = static_cast<uint8_t>(order);
+    block.used += out.size;
+    block.allocations++;
+    return true;
+  }
+  return false;
+}
+
+void
+gpu_free(GpuAllocator& gpu, GpuAllocation& allocation)
+{
+  if (allocation.memory == VK_NULL_HANDLE)
+    return;
+  std::lock_guard<std::mutex> lock(gpu.mutex);
+
+  if (allocation.block == no_block) {
+    free_device_memory(gpu, allocation.memory);
+    gpu.dedicated_count[allocation.memory_type]--;
+    allocation = GpuAllocation{};
+    return;
+  }
+
+  std::vector<GpuMemoryBlock>& blocks = gpu.blocks[allocation.memory_type];
+  GpuMemoryBlock& block = blocks[allocation.block];
+  buddy_free(block, allocation.offset / min_block, allocation.order);
+  block.used -= allocation.size;
+  block.allocations--;
+
+  // Give empty blocks back to the driver, but keep one around per type to avoid thrashing
+  if (block.allocations == 0) {
+    uint32_t live_blocks = 0;
+    for (const GpuMemoryBlock& b : blocks)
+      live_blocks += b.memory != VK_NULL_HANDLE ? 1 : 0;
+    if (live_blocks > 1) {
+      free_device_memory(gpu, block.memory);
+      block = GpuMemoryBlock{};
+    }
+  }
+  allocation = GpuAllocation{};
+}
+
+bool
+gpu_create_buffer(GpuAllocator& gpu, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, GpuBuffer& out)
+{
+  VkBufferCreateInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  info.size = size;
+  info.usage = usage;
+  info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  VkResult err = vkCreateBuffer(gpu.device, &info, gpu.allocator, &out.buffer);
+  check_vk_result(err);
+
+  VkMemoryRequirements requirements;
+  vkGetBufferMemoryRequirements(gpu.device, out.buffer, &requirements);
+  if (!gpu_allocate(gpu, requirements, required, preferred, GpuResourceKind::linear, out.allocation)) {
+    vkDestroyBuffer(gpu.device, out.buffer, gpu.allocator);
+    out = GpuBuffer{};
+    return false;
+  }
+  err = vkBindBufferMemory(gpu.device, out.buffer, out.allocation.memory, out.allocation.offset);
+  check_vk_result(err);
+  out.size = size;
+  return true;
+}
+
+void
+gpu_destroy_buffer(GpuAllocator& gpu, GpuBuffer& buffer)
+{
+  vkDestroyBuffer(gpu.device, buffer.buffer, gpu.allocator);
+  gpu_free(gpu, buffer.allocation);
+  buffer = GpuBuffer{};
+}
+
+bool
+gpu_create_image(GpuAllocator& gpu, const VkImageCreateInfo& info, VkMemoryPropertyFlags required, GpuImage& out)
+{
+  VkResult err = vkCreateImage(gpu.device, &info, gpu.allocator, &out.image);
+  check_vk_result(err);
+
+  VkMemoryRequirements requirements;
+  vkGetImageMemoryRequirements(gpu.device, out.image, &requirements);
+  const GpuResourceKind kind = info.tiling == VK_IMAGE_TILING_OPTIMAL ? GpuResourceKind::optimal : GpuResourceKind::linear;
+  if (!gpu_allocate(gpu, requirements, required, 0, kind, out.allocation)) {
+    vkDestroyImage(gpu.device, out.image, gpu.allocator);
+    out = GpuImage{};
+    return false;
+  }
+  err = vkBindImageMemory(gpu.device, out.image, out.allocation.memory, out.allocation.offset);
+  check_vk_result(err);
+  return true;
+}
+
+void
+gpu_destroy_image(GpuAllocator& gpu, GpuImage& image)
+{
+  vkDestroyImage(gpu.device, image.image, gpu.allocator);
+  gpu_free(gpu, image.allocation);
+  image = GpuImage{};
+}
+
+void
+gpu_flush(GpuAllocator& gpu, const GpuAllocation& allocation, VkDeviceSize offset, VkDeviceSize size)
+{
+  if (gpu.memory_properties.memoryTypes[allocation.memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+    return;
+  // Allocations are atom aligned, so rounding out stays inside this allocation
+  const VkDeviceSize begin = offset / gpu.non_coherent_atom_size * gpu.non_coherent_atom_size;
+  const VkDeviceSize end = std::min(align_up(offset + size, gpu.non_coherent_atom_size), allocation.size);
+  VkMappedMemoryRange range = {};
+  range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+  range.memory = allocation.memory;
+  range.offset = allocation.offset + begin;
+  range.size = end - begin;
+  VkResult err = vkFlushMappedMemoryRanges(gpu.device, 1, &range);
+  check_vk_result(err);
+}
+
+void
+gpu_invalidate(GpuAllocator& gpu, const GpuAllocation& allocation, VkDeviceSize offset, VkDeviceSize size)
+{
+  if (gpu.memory_properties.memoryTypes[allocation.memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+    return;
+  const VkDeviceSize begin = offset / gpu.non_coherent_atom_size * gpu.non_coherent_atom_size;
+  const VkDeviceSize end = std::min(align_up(offset + size, gpu.non_coherent_atom_size), allocation.size);
+  VkMappedMemoryRange range = {};
+  range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+  range.memory = allocation.memory;
+  range.offset = allocation.offset + begin;
+  range.size = end - begin;
+  VkResult err = vkInvalidateMappedMemoryRanges(gpu.device, 1, &range);
+  check_vk_result(err);
+}
+
+GpuMemoryTypeStats
+gpu_allocator_stats(GpuAllocator& gpu, uint32_t memory_type)
+{
+  std::lock_guard<std::mutex> lock(gpu.mutex);
+  GpuMemoryTypeStats stats;
+  stats.dedicated = gpu.dedicated_count[memory_type];
+
+  VkDeviceSize free_bytes = 0;
+  VkDeviceSize smallest_block = 0;
+  for (const GpuMemoryBlock& block : gpu.blocks[memory_type]) {
+    if (block.memory == VK_NULL_HANDLE)
+      continue;
+    stats.blocks++;
+    stats.allocations += block.allocations;
+    stats.block_bytes += block.size;
+    stats.used_bytes += block.used;
+    if (block.nodes[0] > 0)
+      stats.largest_free = std::max(stats.largest_free, min_block << (block.nodes[0] - 1));
+    buddy_free_ranges(block, stats.free_ranges, free_bytes);
+    smallest_block = smallest_block == 0 ? block.size : std::min(smallest_block, block.size);
+  }
+  if (free_bytes > 0)
+    stats.fragmentation = 1.0f - static_cast<float>(stats.largest_free) / static_cast<float>(free_bytes);
+  if (smallest_block > 0) {
+    const uint32_t needed = static_cast<uint32_t>((stats.used_bytes + smallest_block - 1) / smallest_block);
+    stats.reclaimable_blocks = stats.blocks > needed ? stats.blocks - needed : 0;
+  }
+  return stats;
+}
+
+void
+gpu_allocator_draw_stats(GpuAllocator& gpu, bool* open)
+{
+  if (!ImGui::Begin("GPU memory", open)) {
+    ImGui::End();
+    return;
+  }
+  ImGui::Text("vkAllocateMemory: %u live / %u max, bufferImageGranularity %llu", gpu.device_memory_count, gpu.max_allocation_count, (unsigned long long)gpu.buffer_image_granularity);
+  if (ImGui::BeginTable("##types", 8, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV)) {
+    ImGui::TableSetupColumn("type");
+    ImGui::TableSetupColumn("blocks");
+    ImGui::TableSetupColumn("dedicated");
+    ImGui::TableSetupColumn("allocs");
+    ImGui::TableSetupColumn("used KiB");
+    ImGui::TableSetupColumn("block KiB");
+    ImGui::TableSetupColumn("frag");
+    ImGui::TableSetupColumn("reclaimable");
+    ImGui::TableHeadersRow();
+    for (uint32_t type = 0; type < gpu.memory_properties.memoryTypeCount; type++) {
+      const GpuMemoryTypeStats stats = gpu_allocator_stats(gpu, type);
+      if (stats.blocks == 0 && stats.dedicated == 0)
+        continue;
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::Text("%u", type);
+      ImGui::TableNextColumn();
+      ImGui::Text("%u", stats.blocks);
+      ImGui::TableNextColumn();
+      ImGui::Text("%u", stats.dedicated);
+      ImGui::TableNextColumn();
+      ImGui::Text("%u", stats.allocations);
+      ImGui::TableNextColumn();
+      ImGui::Text("%llu", (unsigned long long)(stats.used_bytes / 1024));
+      ImGui::TableNextColumn();
+      ImGui::Text("%llu", (unsigned long long)(stats.block_bytes / 1024));
+      ImGui::TableNextColumn();
+      ImGui::Text("%.0f%% (%u)", stats.fragmentation * 100.0f, stats.free_ranges);
+      ImGui::TableNextColumn();
+      ImGui::Text("%u", stats.reclaimable_blocks);
+    }
+    ImGui::EndTable();
+  }
+  ImGui::End();
+}
+
+bool
+gpu_create_ring(GpuAllocator& gpu, VkDeviceSize size, VkBufferUsageFlags usage, GpuRingBuffer& ring)
+{
+  // Host-visible is required for the persistent mapping, device-local is a bonus (BAR / UMA)
+  const VkMemoryPropertyFlags required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  if (!gpu_create_buffer(gpu, size, usage, required, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ring.buffer))
+    return false;
+  ring.head = 0;
+  ring.tail = 0;
+  ring.used = 0;
+  ring.frame_used = 0;
+  ring.frames.clear();
+  return true;
+}
+
+void
+gpu_destroy_ring(GpuAllocator& gpu, GpuRingBuffer& ring)
+{
+  gpu_destroy_buffer(gpu, ring.buffer);
+  ring.frames.clear();
+}
+
+bool
+gpu_ring_allocate(GpuRingBuffer& ring, VkDeviceSize size, VkDeviceSize alignment, GpuRingAllocation& out)
+{
+  const VkDeviceSize capacity = ring.buffer.size;
+  VkDeviceSize offset = align_up(ring.head, alignment);
+  VkDeviceSize consumed = offset - ring.head + size;
+  if (offset + size > capacity) {
+    // wrap, wasting the tail end of the buffer
+    offset = 0;
+    consumed = capacity - ring.head + size;
+  }
+  if (size > capacity || ring.used + consumed > capacity)
+    return false;
+
+  ring.head = offset + size;
+  ring.used += consumed;
+  ring.frame_used += consumed;
+  ring.peak_used = std::max(ring.peak_used, ring.used);
+
+  out.buffer = ring.buffer.buffer;
+  out.offset = offset;
+  out.mapped = static_cast<uint8_t*>(ring.buffer.allocation.mapped) + offset;
+  return true;
+}
+
+void
+gpu_ring_end_frame(GpuRingBuffer& ring, uint64_t timeline_value)
+{
+  if (ring.frame_used == 0)
+    return;
+  ring.frames.push_back({ timeline_value, ring.head, ring.frame_used });
+  ring.frame_used = 0;
+}
+
+void
+gpu_ring_retire(GpuRingBuffer& ring, uint64_t completed_value)
+{
+  while (!ring.frames.empty() && ring.frames.front().timeline_value <= completed_value) {
+    ring.tail = ring.frames.front().end;
+    ring.used -= ring.frames.front().used;
+    ring.frames.pop_front();
+  }
+  if (ring.used == 0) {
+    ring.head = 0;
+    ring.tail = 0;
+  }
+}
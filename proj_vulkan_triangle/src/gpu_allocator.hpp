@@ -0,0 +1,170 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Device memory suballocator.
+// Memory is taken from the driver in large blocks per memory type and handed out with a buddy
+// allocator (power-of-two sizes, O(log n) allocate/free, naturally aligned). Buffers and
+// optimal-tiling images never share a block, which satisfies bufferImageGranularity without
+// padding. Host-visible blocks are mapped once for their whole lifetime.
+// Transient per-frame data should use a GpuRingBuffer on top of one long-lived buffer instead.
+
+enum class GpuResourceKind : uint8_t
+{
+  linear,  // buffers, linear images
+  optimal, // optimal-tiling images
+};
+
+struct GpuAllocation
+{
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+  VkDeviceSize size = 0; // rounded size actually reserved
+  void* mapped = nullptr; // non-null for host-visible memory
+  uint32_t memory_type = UINT32_MAX;
+  uint32_t block = UINT32_MAX; // UINT32_MAX for dedicated allocations
+  uint8_t order = 0;
+};
+
+struct GpuBuffer
+{
+  VkBuffer buffer = VK_NULL_HANDLE;
+  VkDeviceSize size = 0;
+  GpuAllocation allocation;
+};
+
+struct GpuImage
+{
+  VkImage image = VK_NULL_HANDLE;
+  GpuAllocation allocation;
+};
+
+struct GpuMemoryBlock
+{
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize size = 0;
+  void* mapped = nullptr;
+  GpuResourceKind kind = GpuResourceKind::linear;
+  uint32_t levels = 0;        // size == min_block << levels
+  std::vector<uint8_t> nodes; // buddy tree: largest free order + 1 in each subtree (0 = full)
+  VkDeviceSize used = 0;
+  uint32_t allocations = 0;
+};
+
+struct GpuMemoryTypeStats
+{
+  uint32_t blocks = 0;
+  uint32_t dedicated = 0;
+  uint32_t allocations = 0;
+  VkDeviceSize block_bytes = 0;
+  VkDeviceSize used_bytes = 0;
+  VkDeviceSize largest_free = 0;
+  uint32_t free_ranges = 0;
+  float fragmentation = 0.0f; // 1 - largest_free / total_free
+  uint32_t reclaimable_blocks = 0; // blocks a full compaction would release
+};
+
+struct GpuAllocator
+{
+  VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+  VkDevice device = VK_NULL_HANDLE;
+  VkAllocationCallbacks* allocator = nullptr;
+  VkPhysicalDeviceMemoryProperties memory_properties = {};
+  VkDeviceSize buffer_image_granularity = 1;
+  VkDeviceSize non_coherent_atom_size = 1;
+  uint32_t max_allocation_count = 0;
+  VkDeviceSize block_size = 64ull * 1024 * 1024;
+
+  std::mutex mutex;
+  std::vector<GpuMemoryBlock> blocks[VK_MAX_MEMORY_TYPES];
+  uint32_t dedicated_count[VK_MAX_MEMORY_TYPES] = {};
+  uint32_t device_memory_count = 0; // live vkAllocateMemory calls
+};
+
+void
+setup_gpu_allocator(GpuAllocator& gpu, VkPhysicalDevice physical_device, VkDevice device, VkAllocationCallbacks* allocator);
+
+void
+cleanup_gpu_allocator(GpuAllocator& gpu);
+
+// Memory with all of required, and preferred where a type offers it
+bool
+gpu_allocate(GpuAllocator& gpu, const VkMemoryRequirements& requirements, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, GpuResourceKind kind, GpuAllocation& out);
+
+void
+gpu_free(GpuAllocator& gpu, GpuAllocation& allocation);
+
+bool
+gpu_create_buffer(GpuAllocator& gpu, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, GpuBuffer& out);
+
+void
+gpu_destroy_buffer(GpuAllocator& gpu, GpuBuffer& buffer);
+
+bool
+gpu_create_image(GpuAllocator& gpu, const VkImageCreateInfo& info, VkMemoryPropertyFlags required, GpuImage& out);
+
+void
+gpu_destroy_image(GpuAllocator& gpu, GpuImage& image);
+
+// Needed after CPU writes to memory that is not HOST_COHERENT
+void
+gpu_flush(GpuAllocator& gpu, const GpuAllocation& allocation, VkDeviceSize offset, VkDeviceSize size);
+
+// Needed before CPU reads of GPU writes to memory that is not HOST_COHERENT
+void
+gpu_invalidate(GpuAllocator& gpu, const GpuAllocation& allocation, VkDeviceSize offset, VkDeviceSize size);
+
+GpuMemoryTypeStats
+gpu_allocator_stats(GpuAllocator& gpu, uint32_t memory_type);
+
+void
+gpu_allocator_draw_stats(GpuAllocator& gpu, bool* open);
+
+// Linear allocator over one persistently mapped buffer, recycled in frame order.
+// Allocations made during a frame are released together once the timeline value passed to
+// gpu_ring_end_frame() has been reached.
+struct GpuRingBuffer
+{
+  GpuBuffer buffer;
+  VkDeviceSize head = 0;
+  VkDeviceSize tail = 0; // oldest byte still in use by the GPU
+  VkDeviceSize used = 0;
+  struct FrameMark
+  {
+    uint64_t timeline_value;
+    VkDeviceSize end;
+    VkDeviceSize used;
+  };
+  std::deque<FrameMark> frames;
+  VkDeviceSize frame_used = 0;
+  VkDeviceSize peak_used = 0;
+};
+
+struct GpuRingAllocation
+{
+  VkBuffer buffer = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+  void* mapped = nullptr;
+};
+
+bool
+gpu_create_ring(GpuAllocator& gpu, VkDeviceSize size, VkBufferUsageFlags usage, GpuRingBuffer& ring);
+
+void
+gpu_destroy_ring(GpuAllocator& gpu, GpuRingBuffer& ring);
+
+// Returns false when the ring has no room left until the GPU catches up
+bool
+gpu_ring_allocate(GpuRingBuffer& ring, VkDeviceSize size, VkDeviceSize alignment, GpuRingAllocation& out);
+
+// Marks everything allocated since the previous call as belonging to timeline_value
+void
+gpu_ring_end_frame(GpuRingBuffer& ring, uint64_t timeline_value);
+
+void
+gpu_ring_retire(GpuRingBuffer& ring, uint64_t completed_value);
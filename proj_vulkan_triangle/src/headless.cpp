@@ -0,0 +1,147 @@
+#include "headless.hpp"
+
+#include "vulkan_utils.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+void
+setup_vulkan_headless(ImGui_ImplVulkanH_Window* wd,
+                      GpuAllocator& gpu,
+                      std::vector<GpuImage>& images,
+                      uint32_t width,
+                      uint32_t height,
+                      VkAllocationCallbacks* allocator,
+                      VkDevice& device,
+                      uint32_t image_count)
+{
+  VkResult err;
+
+  wd->Width = static_cast<int>(width);
+  wd->Height = static_cast<int>(height);
+  wd->Swapchain = VK_NULL_HANDLE;
+  wd->Surface = VK_NULL_HANDLE;
+  wd->SurfaceFormat.format = VK_FORMAT_R8G8B8A8_UNORM;
+  wd->SurfaceFormat.colorSpace = VK_COLORSPACE_SRGB_NONLINEAR_KHR;
+  wd->ImageCount = image_count;
+  wd->FrameIndex = 0;
+  wd->SemaphoreIndex = 0;
+
+  // Render pass (same shape as the swapchain one, but ends ready to be copied out instead of presented)
+  {
+    VkAttachmentDescription attachment = {};
+    attachment.format = wd->SurfaceFormat.format;
+    attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    attachment.loadOp = wd->ClearEnable ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    attachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    VkAttachmentReference color_attachment = {};
+    color_attachment.attachment = 0;
+    color_attachment.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    VkSubpassDescription subpass = {};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &color_attachment;
+    VkSubpassDependency dependency = {};
+    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependency.dstSubpass = 0;
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency.srcAccessMask = 0;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    VkRenderPassCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    info.attachmentCount = 1;
+    info.pAttachments = &attachment;
+    info.subpassCount = 1;
+    info.pSubpasses = &subpass;
+    info.dependencyCount = 1;
+    info.pDependencies = &dependency;
+    err = vkCreateRenderPass(device, &info, allocator, &wd->RenderPass);
+    check_vk_result(err);
+  }
+
+  // Like the swapchain's, kept out of the ImGui context's allocator
+  wd->Frames = new ImGui_ImplVulkanH_Frame[wd->ImageCount]();
+  wd->FrameSemaphores = new ImGui_ImplVulkanH_FrameSemaphores[wd->ImageCount]();
+
+  // Colour targets, suballocated from device-local memory
+  {
+    VkImageCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    info.imageType = VK_IMAGE_TYPE_2D;
+    info.format = wd->SurfaceFormat.format;
+    info.extent.width = width;
+    info.extent.height = height;
+    info.extent.depth = 1;
+    info.mipLevels = 1;
+    info.arrayLayers = 1;
+    info.samples = VK_SAMPLE_COUNT_1_BIT;
+    info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    images.resize(wd->ImageCount);
+    for (uint32_t i = 0; i < wd->ImageCount; i++) {
+      if (!gpu_create_image(gpu, info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, images[i])) {
+        fprintf(stderr, "Error no device local memory for headless targets\n");
+        exit(-1);
+      }
+      wd->Frames[i].Backbuffer = images[i].image;
+    }
+  }
+
+  // Image views and framebuffers
+  for (uint32_t i = 0; i < wd->ImageCount; i++) {
+    ImGui_ImplVulkanH_Frame* fd = &wd->Frames[i];
+    {
+      VkImageViewCreateInfo info = {};
+      info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+      info.image = fd->Backbuffer;
+      info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+      info.format = wd->SurfaceFormat.format;
+      info.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+      info.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+      err = vkCreateImageView(device, &info, allocator, &fd->BackbufferView);
+      check_vk_result(err);
+    }
+    {
+      VkFramebufferCreateInfo info = {};
+      info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+      info.renderPass = wd->RenderPass;
+      info.attachmentCount = 1;
+      info.pAttachments = &fd->BackbufferView;
+      info.width = width;
+      info.height = height;
+      info.layers = 1;
+      err = vkCreateFramebuffer(device, &info, allocator, &fd->Framebuffer);
+      check_vk_result(err);
+    }
+  }
+
+  printf("[vulkan] Headless targets: %u x %u, %u images\n", width, height, image_count);
+}
+
+void
+cleanup_vulkan_headless(VkDevice& device, ImGui_ImplVulkanH_Window& wd, GpuAllocator& gpu, std::vector<GpuImage>& images, VkAllocationCallbacks* allocator)
+{
+  for (uint32_t i = 0; i < wd.ImageCount; i++) {
+    ImGui_ImplVulkanH_Frame* fd = &wd.Frames[i];
+    vkDestroyFramebuffer(device, fd->Framebuffer, allocator);
+    vkDestroyImageView(device, fd->BackbufferView, allocator);
+  }
+  for (GpuImage& image : images)
+    gpu_destroy_image(gpu, image);
+  images.clear();
+  delete[] wd.Frames;
+  delete[] wd.FrameSemaphores;
+  wd.Frames = NULL;
+  wd.FrameSemaphores = NULL;
+  wd.ImageCount = 0;
+
+  vkDestroyRenderPass(device, wd.RenderPass, allocator);
+  wd.RenderPass = VK_NULL_HANDLE;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "backends/imgui_impl_vulkan.h"
+#include "gpu_allocator.hpp"
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+// Offscreen replacement for a swapchain.
+// Fills in an ImGui_ImplVulkanH_Window with device-local colour targets so that
+// frame_render() can record into it unchanged. wd->Swapchain stays VK_NULL_HANDLE,
+// which is how frame_render()/frame_present() tell the two paths apart.
+// Images are picked by frame slot, so image_count must be >= the number of frames in flight.
+void
+setup_vulkan_headless(ImGui_ImplVulkanH_Window* wd,
+                      GpuAllocator& gpu,
+                      std::vector<GpuImage>& images,
+                      uint32_t width,
+                      uint32_t height,
+                      VkAllocationCallbacks* allocator,
+                      VkDevice& device,
+                      uint32_t image_count);
+
+void
+cleanup_vulkan_headless(VkDevice& device, ImGui_ImplVulkanH_Window& wd, GpuAllocator& gpu, std::vector<GpuImage>& images, VkAllocationCallbacks* allocator);
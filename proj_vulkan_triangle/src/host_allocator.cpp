@@ -0,0 +1,365 @@
+#include "host_allocator.hpp"
+
+#include "imgui.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+constexpr size_t header_size = 16;
+constexpr size_t min_alignment = 16;
+constexpr size_t smallest_class = 16;
+constexpr size_t pool_page_size = 64 * 1024;
+constexpr size_t linear_chunk_size = 256 * 1024;
+constexpr uint32_t header_magic = 0x484c41; // "ALH"
+
+enum class BlockKind : uint8_t
+{
+  pool,
+  linear,
+  heap,
+};
+
+// Sits directly in front of every pointer handed to the driver
+struct BlockHeader
+{
+  uint32_t magic : 24;
+  uint32_t kind : 8;
+  uint16_t size_class;
+  uint16_t scope;
+  uint32_t offset; // user pointer - block start
+  uint32_t size;   // requested bytes
+};
+static_assert(sizeof(BlockHeader) == header_size);
+
+uintptr_t
+align_up(uintptr_t v, size_t alignment)
+{
+  return (v + alignment - 1) & ~(uintptr_t)(alignment - 1);
+}
+
+// Bytes a block needs so that an aligned user pointer plus its header always fit
+size_t
+block_bytes(size_t size, size_t alignment)
+{
+  return size + header_size + (alignment > min_alignment ? alignment - min_alignment : 0);
+}
+
+int
+size_class_for(size_t bytes)
+{
+  size_t class_size = smallest_class;
+  for (int c = 0; c < (int)host_allocator_class_count; c++, class_size <<= 1) {
+    if (bytes <= class_size)
+      return c;
+  }
+  return -1;
+}
+
+// Blocks start 16-byte aligned, so the header always fits in front of the first aligned address past it
+void*
+place(uint8_t* block, size_t size, size_t alignment, BlockKind kind, int size_class, VkSystemAllocationScope scope)
+{
+  const uintptr_t user = align_up(reinterpret_cast<uintptr_t>(block) + header_size, alignment);
+  BlockHeader* header = reinterpret_cast<BlockHeader*>(user - header_size);
+  header->magic = header_magic;
+  header->kind = static_cast<uint32_t>(kind);
+  header->size_class = static_cast<uint16_t>(size_class);
+  header->scope = static_cast<uint16_t>(scope);
+  header->offset = static_cast<uint32_t>(user - reinterpret_cast<uintptr_t>(block));
+  header->size = static_cast<uint32_t>(size);
+  return reinterpret_cast<void*>(user);
+}
+
+BlockHeader*
+header_of(void* memory)
+{
+  BlockHeader* header = reinterpret_cast<BlockHeader*>(static_cast<uint8_t*>(memory) - header_size);
+  IM_ASSERT(header->magic == header_magic);
+  return header;
+}
+
+void*
+linear_alloc(HostLinearArena& arena, size_t bytes)
+{
+  std::lock_guard<std::mutex> lock(arena.mutex);
+  while (arena.current < arena.chunks.size()) {
+    HostLinearArena::Chunk& chunk = arena.chunks[arena.current];
+    const size_t offset = align_up(chunk.used, min_alignment);
+    if (offset + bytes <= chunk.size) {
+      chunk.used = offset + bytes;
+      arena.live++;
+      return chunk.data + offset;
+    }
+    arena.current++;
+  }
+  HostLinearArena::Chunk chunk;
+  chunk.size = std::max(linear_chunk_size, bytes);
+  chunk.data = static_cast<uint8_t*>(malloc(chunk.size));
+  if (!chunk.data)
+    return nullptr;
+  chunk.used = bytes;
+  arena.chunks.push_back(chunk);
+  arena.current = arena.chunks.size() - 1;
+  arena.live++;
+  return chunk.data;
+}
+
+void
+linear_free(HostLinearArena& arena)
+{
+  std::lock_guard<std::mutex> lock(arena.mutex);
+  if (--arena.live > 0)
+    return;
+  // Nothing alive: rewind every chunk in one go
+  for (HostLinearArena::Chunk& chunk : arena.chunks)
+    chunk.used = 0;
+  arena.current = 0;
+  arena.resets++;
+}
+
+void*
+pool_alloc(HostPoolArena& arena, int size_class)
+{
+  std::lock_guard<std::mutex> lock(arena.mutex);
+  void*& head = arena.free_lists[size_class];
+  if (!head) {
+    // carve a fresh page into blocks of this class
+    uint8_t* page = static_cast<uint8_t*>(malloc(pool_page_size));
+    if (!page)
+      return nullptr;
+    arena.pages.push_back(page);
+    const size_t class_size = smallest_class << size_class;
+    for (size_t offset = 0; offset + class_size <= pool_page_size; offset += class_size) {
+      void* block = page + offset;
+      *static_cast<void**>(block) = head;
+      head = block;
+    }
+  }
+  void* block = head;
+  head = *static_cast<void**>(block);
+  return block;
+}
+
+void
+pool_free(HostPoolArena& arena, void* block, int size_class)
+{
+  std::lock_guard<std::mutex> lock(arena.mutex);
+  *static_cast<void**>(block) = arena.free_lists[size_class];
+  arena.free_lists[size_class] = block;
+}
+
+void*
+allocate(HostAllocator& ha, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+  if (size == 0)
+    return nullptr;
+  alignment = std::max(alignment, min_alignment);
+  const size_t bytes = block_bytes(size, alignment);
+  HostAllocatorCounters& counters = ha.counters[scope];
+
+  void* result = nullptr;
+  if (scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND && bytes <= linear_chunk_size / 4) {
+    if (uint8_t* block = static_cast<uint8_t*>(linear_alloc(ha.command_arena, bytes)))
+      result = place(block, size, alignment, BlockKind::linear, 0, scope);
+  } else if (const int size_class = size_class_for(bytes); size_class >= 0 && scope != VK_SYSTEM_ALLOCATION_SCOPE_COMMAND) {
+    if (uint8_t* block = static_cast<uint8_t*>(pool_alloc(ha.pool_arena, size_class)))
+      result = place(block, size, alignment, BlockKind::pool, size_class, scope);
+  } else {
+    if (uint8_t* block = static_cast<uint8_t*>(malloc(bytes)))
+      result = place(block, size, alignment, BlockKind::heap, 0, scope);
+    counters.heap_allocations++;
+  }
+
+  if (result) {
+    counters.live_bytes += static_cast<int64_t>(size);
+    counters.live_allocations++;
+    counters.total_allocations++;
+  }
+  return result;
+}
+
+void
+release(HostAllocator& ha, void* memory)
+{
+  if (!memory)
+    return;
+  BlockHeader* header = header_of(memory);
+  uint8_t* block = static_cast<uint8_t*>(memory) - header->offset;
+  HostAllocatorCounters& counters = ha.counters[header->scope];
+  counters.live_bytes -= static_cast<int64_t>(header->size);
+  counters.live_allocations--;
+
+  switch (static_cast<BlockKind>(header->kind)) {
+    case BlockKind::pool:
+      pool_free(ha.pool_arena, block, header->size_class);
+      break;
+    case BlockKind::linear:
+      linear_free(ha.command_arena);
+      break;
+    case BlockKind::heap:
+      free(block);
+      break;
+  }
+}
+
+VKAPI_ATTR void* VKAPI_CALL
+vk_allocation(void* user_data, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+  return allocate(*static_cast<HostAllocator*>(user_data), size, alignment, scope);
+}
+
+VKAPI_ATTR void* VKAPI_CALL
+vk_reallocation(void* user_data, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+  HostAllocator& ha = *static_cast<HostAllocator*>(user_data);
+  if (!original)
+    return allocate(ha, size, alignment, scope);
+  if (size == 0) {
+    release(ha, original);
+    return nullptr;
+  }
+  // The original scope is kept, as the spec requires
+  BlockHeader* header = header_of(original);
+  void* result = allocate(ha, size, alignment, static_cast<VkSystemAllocationScope>(header->scope));
+  if (!result)
+    return nullptr; // original stays valid
+  memcpy(result, original, std::min<size_t>(size, header->size));
+  release(ha, original);
+  return result;
+}
+
+VKAPI_ATTR void VKAPI_CALL
+vk_free(void* user_data, void* memory)
+{
+  release(*static_cast<HostAllocator*>(user_data), memory);
+}
+
+VKAPI_ATTR void VKAPI_CALL
+vk_internal_allocation(void* user_data, size_t size, VkInternalAllocationType, VkSystemAllocationScope)
+{
+  static_cast<HostAllocator*>(user_data)->internal_bytes += static_cast<int64_t>(size);
+}
+
+VKAPI_ATTR void VKAPI_CALL
+vk_internal_free(void* user_data, size_t size, VkInternalAllocationType, VkSystemAllocationScope)
+{
+  static_cast<HostAllocator*>(user_data)->internal_bytes -= static_cast<int64_t>(size);
+}
+
+const char*
+scope_name(uint32_t scope)
+{
+  const char* names[] = { "command", "object", "cache", "device", "instance" };
+  return scope < host_allocator_scope_count ? names[scope] : "?";
+}
+
+} // namespace
+
+void
+setup_host_allocator(HostAllocator& ha)
+{
+  ha.callbacks.pUserData = &ha;
+  ha.callbacks.pfnAllocation = vk_allocation;
+  ha.callbacks.pfnReallocation = vk_reallocation;
+  ha.callbacks.pfnFree = vk_free;
+  ha.callbacks.pfnInternalAllocation = vk_internal_allocation;
+  ha.callbacks.pfnInternalFree = vk_internal_free;
+}
+
+void
+cleanup_host_allocator(HostAllocator& ha)
+{
+  // Everything should have been handed back by now (instance destroyed last)
+  int64_t leaked = 0;
+  for (const HostAllocatorCounters& counters : ha.counters)
+    leaked += counters.live_allocations.load();
+  if (leaked != 0)
+    fprintf(stderr, "[host allocator] %lld allocations still live at shutdown\n", (long long)leaked);
+
+  for (HostLinearArena::Chunk& chunk : ha.command_arena.chunks)
+    free(chunk.data);
+  ha.command_arena.chunks.clear();
+  for (uint8_t* page : ha.pool_arena.pages)
+    free(page);
+  ha.pool_arena.pages.clear();
+  ha.pool_arena.free_lists.fill(nullptr);
+}
+
+void
+host_allocator_end_frame(HostAllocator& ha)
+{
+  uint64_t total = 0;
+  for (const HostAllocatorCounters& counters : ha.counters)
+    total += counters.total_allocations.load(std::memory_order_relaxed);
+  ha.last_frame_allocations = total - ha.frame_snapshot;
+  ha.max_frame_allocations = std::max(ha.max_frame_allocations, ha.last_frame_allocations);
+  ha.frame_snapshot = total;
+}
+
+void
+host_allocator_draw_stats(HostAllocator& ha, bool* open)
+{
+  if (!ImGui::Begin("Host allocator", open)) {
+    ImGui::End();
+    return;
+  }
+  // The arenas grow from whichever thread the driver allocates on
+  size_t chunks = 0;
+  uint64_t resets = 0;
+  {
+    std::lock_guard<std::mutex> lock(ha.command_arena.mutex);
+    chunks = ha.command_arena.chunks.size();
+    resets = ha.command_arena.resets;
+  }
+  size_t pages = 0;
+  {
+    std::lock_guard<std::mutex> lock(ha.pool_arena.mutex);
+    pages = ha.pool_arena.pages.size();
+  }
+  ImGui::Text("allocations last frame: %llu (max %llu)", (unsigned long long)ha.last_frame_allocations, (unsigned long long)ha.max_frame_allocations);
+  ImGui::Text("command arena: %zu chunks, %llu resets", chunks, (unsigned long long)resets);
+  ImGui::Text("pool pages: %zu (%zu KiB), driver internal: %lld B", pages, pages * pool_page_size / 1024, (long long)ha.internal_bytes.load());
+  if (ImGui::BeginTable("##scopes", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV)) {
+    ImGui::TableSetupColumn("scope");
+    ImGui::TableSetupColumn("live bytes");
+    ImGui::TableSetupColumn("live");
+    ImGui::TableSetupColumn("total");
+    ImGui::TableSetupColumn("heap");
+    ImGui::TableHeadersRow();
+    for (uint32_t i = 0; i < host_allocator_scope_count; i++) {
+      const HostAllocatorCounters& counters = ha.counters[i];
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(scope_name(i));
+      ImGui::TableNextColumn();
+      ImGui::Text("%lld", (long long)counters.live_bytes.load());
+      ImGui::TableNextColumn();
+      ImGui::Text("%lld", (long long)counters.live_allocations.load());
+      ImGui::TableNextColumn();
+      ImGui::Text("%llu", (unsigned long long)counters.total_allocations.load());
+      ImGui::TableNextColumn();
+      ImGui::Text("%llu", (unsigned long long)counters.heap_allocations.load());
+    }
+    ImGui::EndTable();
+  }
+  ImGui::End();
+}
+
+void
+host_allocator_print_stats(const HostAllocator& ha)
+{
+  printf("[host allocator] max allocations in one frame: %llu, command arena resets: %llu\n", (unsigned long long)ha.max_frame_allocations, (unsigned long long)ha.command_arena.resets);
+  for (uint32_t i = 0; i < host_allocator_scope_count; i++) {
+    const HostAllocatorCounters& counters = ha.counters[i];
+    printf("  %-9s live %10lld B in %6lld, total %8llu, heap %6llu\n",
+           scope_name(i),
+           (long long)counters.live_bytes.load(),
+           (long long)counters.live_allocations.load(),
+           (unsigned long long)counters.total_allocations.load(),
+           (unsigned long long)counters.heap_allocations.load());
+  }
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// VkAllocationCallbacks for the driver's host allocations, with one arena per VkSystemAllocationScope.
+// - COMMAND scope lives only for the duration of a single Vulkan call: it is a bump allocator
+//   that rewinds to the start whenever its live count drops to zero.
+// - every other scope is pooled by power-of-two size class (16 B - 4 KiB), larger requests go to the heap.
+// Counters are atomics so they can be read from any thread while the driver allocates.
+
+constexpr uint32_t host_allocator_scope_count = 5; // VK_SYSTEM_ALLOCATION_SCOPE_COMMAND..INSTANCE
+constexpr uint32_t host_allocator_class_count = 9; // 16, 32, ... 4096
+
+struct HostAllocatorCounters
+{
+  std::atomic<int64_t> live_bytes{ 0 };
+  std::atomic<int64_t> live_allocations{ 0 };
+  std::atomic<uint64_t> total_allocations{ 0 };
+  std::atomic<uint64_t> heap_allocations{ 0 }; // requests that fell through to malloc
+};
+
+struct HostLinearArena
+{
+  struct Chunk
+  {
+    uint8_t* data = nullptr;
+    size_t size = 0;
+    size_t used = 0;
+  };
+  std::mutex mutex;
+  std::vector<Chunk> chunks;
+  size_t current = 0;
+  int64_t live = 0;
+  uint64_t resets = 0;
+};
+
+struct HostPoolArena
+{
+  std::mutex mutex;
+  std::array<void*, host_allocator_class_count> free_lists{};
+  std::vector<uint8_t*> pages;
+};
+
+struct HostAllocator
+{
+  VkAllocationCallbacks callbacks = {};
+  HostLinearArena command_arena;
+  HostPoolArena pool_arena;
+  std::array<HostAllocatorCounters, host_allocator_scope_count> counters;
+  std::atomic<int64_t> internal_bytes{ 0 }; // driver-reported internal (e.g. executable) allocations
+
+  // per-frame sampling, see host_allocator_end_frame
+  uint64_t frame_snapshot = 0;
+  uint64_t last_frame_allocations = 0;
+  uint64_t max_frame_allocations = 0;
+};
+
+// callbacks.pUserData points back at the allocator, so it must not move after setup
+void
+setup_host_allocator(HostAllocator& ha);
+
+void
+cleanup_host_allocator(HostAllocator& ha);
+
+void
+host_allocator_end_frame(HostAllocator& ha);
+
+void
+host_allocator_draw_stats(HostAllocator& ha, bool* open);
+
+void
+host_allocator_print_stats(const HostAllocator& ha);
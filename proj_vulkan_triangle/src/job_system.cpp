@@ -0,0 +1,118 @@
+#include "job_system.hpp"
+
+#include <algorithm>
+#include <stdio.h>
+
+namespace {
+
+bool
+pop_job(JobSystem& jobs, uint32_t thread, Job& out)
+{
+  {
+    JobQueue& own = *jobs.queues[thread];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.jobs.empty()) {
+      out = own.jobs.back();
+      own.jobs.pop_back();
+      jobs.queued--;
+      return true;
+    }
+  }
+  for (uint32_t i = 1; i < jobs.thread_count; i++) {
+    JobQueue& victim = *jobs.queues[(thread + i) % jobs.thread_count];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.jobs.empty()) {
+      out = victim.jobs.front();
+      victim.jobs.pop_front();
+      jobs.queued--;
+      jobs.stolen++;
+      return true;
+    }
+  }
+  return false;
+}
+
+void
+execute(JobSystem& jobs, const Job& job, uint32_t thread)
+{
+  (*job.function)(job.index, thread);
+  jobs.executed++;
+  job.counter->pending.fetch_sub(1, std::memory_order_release);
+}
+
+void
+worker_main(JobSystem& jobs, uint32_t thread)
+{
+  Job job;
+  while (true) {
+    if (pop_job(jobs, thread, job)) {
+      execute(jobs, job, thread);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(jobs.sleep_mutex);
+    jobs.wake.wait(lock, [&] { return jobs.stop || jobs.queued.load() > 0; });
+    if (jobs.stop)
+      return;
+  }
+}
+
+} // namespace
+
+void
+setup_job_system(JobSystem& jobs, uint32_t worker_count)
+{
+  if (worker_count == 0)
+    worker_count = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+  jobs.thread_count = worker_count + 1;
+  jobs.stop = false;
+  jobs.queues.clear();
+  for (uint32_t i = 0; i < jobs.thread_count; i++)
+    jobs.queues.push_back(std::make_unique<JobQueue>());
+  for (uint32_t i = 1; i < jobs.thread_count; i++)
+    jobs.workers.emplace_back(worker_main, std::ref(jobs), i);
+  printf("[jobs] %u worker threads\n", worker_count);
+}
+
+void
+cleanup_job_system(JobSystem& jobs)
+{
+  {
+    std::lock_guard<std::mutex> lock(jobs.sleep_mutex);
+    jobs.stop = true;
+  }
+  jobs.wake.notify_all();
+  for (std::thread& worker : jobs.workers)
+    worker.join();
+  jobs.workers.clear();
+  jobs.queues.clear();
+}
+
+void
+job_system_run(JobSystem& jobs, uint32_t count, const JobFunction& function, JobCounter& counter)
+{
+  if (count == 0)
+    return;
+  counter.pending.fetch_add(count, std::memory_order_relaxed);
+  for (uint32_t i = 0; i < count; i++) {
+    JobQueue& queue = *jobs.queues[jobs.next_queue];
+    jobs.next_queue = (jobs.next_queue + 1) % jobs.thread_count;
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.jobs.push_back({ &function, i, &counter });
+    jobs.queued++;
+  }
+  // Taking the lock orders this against a worker that is about to sleep
+  { std::lock_guard<std::mutex> lock(jobs.sleep_mutex); }
+  jobs.wake.notify_all();
+}
+
+void
+job_system_wait(JobSystem& jobs, JobCounter& counter)
+{
+  Job job;
+  while (counter.pending.load(std::memory_order_acquire) > 0) {
+    if (pop_job(jobs, 0, job))
+      execute(jobs, job, 0);
+    else
+      std::this_thread::yield();
+  }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool.
+// Each thread owns a deque: it pops its own work from the back and steals from the front of
+// the others when it runs dry. Thread 0 is the thread that calls job_system_wait (the main
+// thread), workers are 1..thread_count-1. Jobs receive the index of the thread running them
+// so they can use per-thread resources without locking.
+
+using JobFunction = std::function<void(uint32_t index, uint32_t thread)>;
+
+struct JobCounter
+{
+  std::atomic<uint32_t> pending{ 0 };
+};
+
+struct Job
+{
+  const JobFunction* function = nullptr; // must outlive job_system_wait
+  uint32_t index = 0;
+  JobCounter* counter = nullptr;
+};
+
+struct JobQueue
+{
+  std::mutex mutex;
+  std::deque<Job> jobs;
+};
+
+struct JobSystem
+{
+  uint32_t thread_count = 1; // including the main thread
+  std::vector<std::unique_ptr<JobQueue>> queues;
+  std::vector<std::thread> workers;
+  uint32_t next_queue = 0;
+
+  std::atomic<uint32_t> queued{ 0 };
+  std::mutex sleep_mutex;
+  std::condition_variable wake;
+  bool stop = false;
+
+  // stats
+  std::atomic<uint64_t> executed{ 0 };
+  std::atomic<uint64_t> stolen{ 0 };
+};
+
+// worker_count 0 picks hardware_concurrency - 1.
+void
+setup_job_system(JobSystem& jobs, uint32_t worker_count);
+
+void
+cleanup_job_system(JobSystem& jobs);
+
+// Queues function(0..count-1), spread over every thread. Returns immediately.
+void
+job_system_run(JobSystem& jobs, uint32_t count, const JobFunction& function, JobCounter& counter);
+
+// Runs queued jobs on the calling (main) thread until counter reaches zero.
+void
+job_system_wait(JobSystem& jobs, JobCounter& counter);
@@ -1,393 +1,263 @@
 // References:
 // https://github.com/ocornut/imgui/blob/master/examples/example_sdl_vulkan/main.cpp
 
+#include "app.hpp"
 #include "backends/imgui_impl_sdl2.h"
 #include "backends/imgui_impl_vulkan.h"
+#include "command_recorder.hpp"
+#include "descriptors.hpp"
+#include "deletion_queue.hpp"
+#include "device_select.hpp"
+#include "frame_capture.hpp"
+#include "frame_pacing.hpp"
+#include "frame_scheduler.hpp"
+#include "frame_stream.hpp"
+#include "frame_timings.hpp"
+#include "gpu_allocator.hpp"
+#include "headless.hpp"
+#include "host_allocator.hpp"
 #include "imgui.h"
+#include "job_system.hpp"
+#include "mesh_renderer.hpp"
+#include "pipeline_cache.hpp"
+#include "redraw.hpp"
+#include "render_thread.hpp"
+#include "startup_timings.hpp"
+#include "swapchain.hpp"
+#include "ui_renderer.hpp"
+#include "upload_queue.hpp"
+#include "viewport_renderer.hpp"
+#include "vulkan_utils.hpp"
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_vulkan.h>
 #include <vulkan/vulkan.h>
 
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
+#include <memory>
 #include <optional>
 #include <stdexcept>
 #include <stdio.h>  // printf, fprintf
 #include <stdlib.h> // abort
 #include <string>
+#include <string.h> // strcmp
 #include <vector>
 
-// #define IMGUI_UNLIMITED_FRAME_RATE
-
-void
-check_vk_result(VkResult err)
+struct AppOptions
 {
-  if (err == VK_SUCCESS)
-    return;
-  fprintf(stderr, "[vulkan] Error: VkResult = %d\n", err);
-  if (err < 0)
-    abort();
-}
+  // Render into offscreen images instead of a window/swapchain.
+  // Needs no display, so it runs on CI machines and software ICDs (e.g. lavapipe).
+  bool headless = false;
+  uint32_t width = 1200;
+  uint32_t height = 800;
+  // Frames to render before exiting (0 = until quit). Defaults to 600 when headless.
+  uint32_t frames = 0;
+  // Written on exit if set (chrome trace json / csv)
+  std::string trace_path;
+  std::string csv_path;
+  // Startup phases as a chrome trace, written once the first frame is submitted
+  std::string startup_trace_path;
+  // Empty disables the on-disk pipeline cache
+  std::string pipeline_cache_path = "pipeline_cache.bin";
+  // CPU may run this many frames ahead of the GPU, independent of the swapchain image count
+  uint32_t frames_in_flight = 2;
+  // Route the driver's host allocations through HostAllocator instead of the global heap
+  bool host_allocator = false;
+  // Instances drawn by the mesh renderer (0 = ImGui only)
+  uint32_t instances = 20000;
+  // Independently recordable mesh batches
+  uint32_t batches = 64;
+  // Recording worker threads (0 = one per core besides the main thread)
+  uint32_t threads = 0;
+  // GPU index or part of its name, overrides VT_DEVICE
+  std::string device;
+  // Initial pacing, all changeable at runtime from the "Frame pacing" window
+  VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
+  float fps_limit = 0.0f; // 0 = unlimited
+  bool low_latency = false;
+  // Render only when the UI changes, block on input otherwise
+  bool on_demand = false;
+  float keep_alive_s = 0.0f; // redraw at least this often when on demand (0 = only on change)
+  // Draw the main viewport with UiRenderer instead of ImGui_ImplVulkan_RenderDrawData
+  bool retained_ui = true;
+  // Render and submit on a separate thread, fed deep copies of the draw data
+  bool render_thread = false;
+  // Write every rendered frame's draw data to a capture file / render a capture offscreen instead of a UI
+  std::string capture_path;
+  std::string replay_path;
+  // Read back every rendered frame and write it out on a background thread (TGA sequence, or raw video for *.bgra)
+  std::string record_path;
+};
 
-#ifdef _DEBUG
-static VKAPI_ATTR VkBool32 VKAPI_CALL
-debug_report(VkDebugReportFlagsEXT flags, VkDebugReportObjectTypeEXT objectType, uint64_t object, size_t location, int32_t messageCode, const char* pLayerPrefix, const char* pMessage, void* pUserData)
+void
+print_usage(const char* exe)
 {
-  (void)flags;
-  (void)object;
-  (void)location;
-  (void)messageCode;
-  (void)pUserData;
-  (void)pLayerPrefix; // Unused arguments
-  fprintf(stderr, "[vulkan] Debug report from ObjectType: %i\nMessage: %s\n\n", objectType, pMessage);
-  return VK_FALSE;
+  printf("usage: %s [--headless] [--size WxH] [--frames N] [--trace-out file.json] [--csv-out file.csv] [--startup-trace file.json] [--pipeline-cache file | --no-pipeline-cache] [--frames-in-flight N] [--host-allocator] [--instances N] [--batches N] [--threads N] [--device index|name] [--present-mode fifo|fifo_relaxed|mailbox|immediate] [--fps-limit N] [--low-latency] [--on-demand] [--keep-alive seconds] [--backend-ui-renderer] [--render-thread] [--capture file.vtcap | --replay file.vtcap] [--record prefix | file.bgra]\n", exe);
 }
-#endif // _DEBUG
 
 bool
-init_sdl2()
+parse_options(int argc, char** argv, AppOptions& options)
 {
-  if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_GAMECONTROLLER) != 0) {
-    printf("Error: %s\n", SDL_GetError());
-    return false;
+  bool frames_set = false;
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (strcmp(arg, "--headless") == 0)
+      options.headless = true;
+    else if (strcmp(arg, "--size") == 0 && has_value) {
+      if (sscanf(argv[++i], "%ux%u", &options.width, &options.height) != 2 || options.width == 0 || options.height == 0) {
+        fprintf(stderr, "Error invalid --size '%s'\n", argv[i]);
+        return false;
+      }
+    } else if (strcmp(arg, "--frames") == 0 && has_value) {
+      options.frames = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+      frames_set = true;
+    } else if (strcmp(arg, "--trace-out") == 0 && has_value)
+      options.trace_path = argv[++i];
+    else if (strcmp(arg, "--csv-out") == 0 && has_value)
+      options.csv_path = argv[++i];
+    else if (strcmp(arg, "--startup-trace") == 0 && has_value)
+      options.startup_trace_path = argv[++i];
+    else if (strcmp(arg, "--pipeline-cache") == 0 && has_value)
+      options.pipeline_cache_path = argv[++i];
+    else if (strcmp(arg, "--no-pipeline-cache") == 0)
+      options.pipeline_cache_path.clear();
+    else if (strcmp(arg, "--frames-in-flight") == 0 && has_value)
+      options.frames_in_flight = std::clamp(static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)), 1u, max_frames_in_flight);
+    else if (strcmp(arg, "--host-allocator") == 0)
+      options.host_allocator = true;
+    else if (strcmp(arg, "--instances") == 0 && has_value)
+      options.instances = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+    else if (strcmp(arg, "--batches") == 0 && has_value)
+      options.batches = std::max(static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)), 1u);
+    else if (strcmp(arg, "--threads") == 0 && has_value)
+      options.threads = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+    else if (strcmp(arg, "--device") == 0 && has_value)
+      options.device = argv[++i];
+    else if (strcmp(arg, "--present-mode") == 0 && has_value) {
+      if (!parse_present_mode(argv[++i], options.present_mode)) {
+        fprintf(stderr, "Error invalid --present-mode '%s'\n", argv[i]);
+        return false;
+      }
+    } else if (strcmp(arg, "--fps-limit") == 0 && has_value)
+      options.fps_limit = std::max(strtof(argv[++i], nullptr), 0.0f);
+    else if (strcmp(arg, "--low-latency") == 0)
+      options.low_latency = true;
+    else if (strcmp(arg, "--on-demand") == 0)
+      options.on_demand = true;
+    else if (strcmp(arg, "--keep-alive") == 0 && has_value)
+      options.keep_alive_s = std::max(strtof(argv[++i], nullptr), 0.0f);
+    else if (strcmp(arg, "--backend-ui-renderer") == 0)
+      options.retained_ui = false;
+    else if (strcmp(arg, "--render-thread") == 0)
+      options.render_thread = true;
+    else if (strcmp(arg, "--record") == 0 && has_value)
+      options.record_path = argv[++i];
+    else if (strcmp(arg, "--capture") == 0 && has_value)
+      options.capture_path = argv[++i];
+    else if (strcmp(arg, "--replay") == 0 && has_value) {
+      options.replay_path = argv[++i];
+      options.headless = true;
+    }
+    else {
+      fprintf(stderr, "Error unknown argument '%s'\n", arg);
+      print_usage(argv[0]);
+      return false;
+    }
   }
-  printf("(init) sdl2 success\n");
+  // A replay runs to the end of its stream
+  if (options.headless && !frames_set && options.replay_path.empty())
+    options.frames = 600;
   return true;
 }
 
-SDL_Window*
-init_sdl2_window(const std::string& window, int32_t x, int32_t y)
-{
-  SDL_WindowFlags window_flags = (SDL_WindowFlags)(SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI);
-  return SDL_CreateWindow(window.c_str(), SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, x, y, window_flags);
-}
-
-void
-sdl2_handle_quit_event(SDL_Window* window, const SDL_Event& event, bool& running)
+int
+main(int argc, char** argv)
 {
-  if (event.type == SDL_QUIT)
-    running = false;
-
-  if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_CLOSE && event.window.windowID == SDL_GetWindowID(window))
-    running = false;
-
-  if (event.type == SDL_KEYDOWN) {
-    switch (event.key.keysym.sym) {
-      case SDLK_ESCAPE:
-        running = false;
-        break;
+  StartupTimings startup;
+  setup_startup_timings(startup);
+  AppOptions options;
+  if (!parse_options(argc, argv, options))
+    return EXIT_FAILURE;
+  // Replay: a capture rendered offscreen at the size it was captured at, without input or UI building
+  FrameReplay replay;
+  const bool replaying = !options.replay_path.empty();
+  if (replaying) {
+    if (!open_frame_replay(replay, options.replay_path.c_str()))
+      return EXIT_FAILURE;
+    if (replay.width > 0 && replay.height > 0) {
+      options.width = replay.width;
+      options.height = replay.height;
     }
+    options.render_thread = false;
   }
-}
-
-void
-setup_vulkan(const std::vector<const char*>& extensions,
-             // instance
-             VkInstance& instance,
-             VkAllocationCallbacks* allocator,
-             VkDebugReportCallbackEXT& reporter,
-             // device
-             VkPhysicalDevice& physical_device,
-             VkDevice& device,
-             std::optional<uint32_t>& queue_family,
-             VkQueue& queue,
-             VkDescriptorPool& descriptor_pool)
-{
-  VkResult err;
-
-  // Create vulkan instance
-  {
-    VkInstanceCreateInfo create_info{};
-    create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-    create_info.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
-    create_info.ppEnabledExtensionNames = extensions.data();
-#ifdef _DEBUG
-    // Enabling validation layers
-    const char* layers[] = { "VK_LAYER_KHRONOS_validation" };
-    create_info.enabledLayerCount = 1;
-    create_info.ppEnabledLayerNames = layers;
-    // Enable debug report extension
-    // (we need additional storage, so we duplicate the user array to add our new extension to it)
-    std::vector<const char*> extensions_ext(extensions.size() + 1);
-    std::copy(extensions.begin(), extensions.end(), extensions_ext.begin());
-    extensions_ext[extensions.size()] = "VK_EXT_debug_report";
-    create_info.enabledExtensionCount = static_cast<uint32_t>(extensions_ext.size());
-    create_info.ppEnabledExtensionNames = extensions_ext.data();
-
-    // Create vulkan instance
-    err = vkCreateInstance(&create_info, allocator, &instance);
-    check_vk_result(err);
-
-    // Get the function pointer (required for any extensions)
-    auto vkCreateDebugReportCallbackEXT = (PFN_vkCreateDebugReportCallbackEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugReportCallbackEXT");
-    IM_ASSERT(vkCreateDebugReportCallbackEXT != NULL);
-
-    // Setup the debug report callback
-    VkDebugReportCallbackCreateInfoEXT debug_report_ci = {};
-    debug_report_ci.sType = VK_STRUCTURE_TYPE_DEBUG_REPORT_CALLBACK_CREATE_INFO_EXT;
-    debug_report_ci.flags = VK_DEBUG_REPORT_ERROR_BIT_EXT | VK_DEBUG_REPORT_WARNING_BIT_EXT | VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT;
-    debug_report_ci.pfnCallback = debug_report;
-    debug_report_ci.pUserData = NULL;
-    err = vkCreateDebugReportCallbackEXT(instance, &debug_report_ci, allocator, &reporter);
-    check_vk_result(err);
-#else
-    // Create Vulkan Instance without any debug feature
-    err = vkCreateInstance(&create_info, allocator, &instance);
-    check_vk_result(err);
-    IM_UNUSED(debug_report);
-#endif
+  const bool headless = options.headless;
+  if (options.render_thread && !options.retained_ui) {
+    // The backend's renderer reads the ImGui context, which belongs to the UI thread
+    printf("[render thread] --backend-ui-renderer is not supported with a render thread, ignored\n");
+    options.retained_ui = true;
   }
 
-  // Select GPU
-  {
-    uint32_t device_count = 0;
-    err = vkEnumeratePhysicalDevices(instance, &device_count, nullptr);
-    check_vk_result(err);
-    IM_ASSERT(device_count > 0);
-    std::vector<VkPhysicalDevice> devices(device_count);
-    err = vkEnumeratePhysicalDevices(instance, &device_count, devices.data());
-    check_vk_result(err);
-
-    // If a number >1 of GPUs got reported, find discrete GPU if present, or use first one available.
-    // This covers most common cases (multi-gpu/integrated+dedicated graphics)
-    // Handling more complicated setups (multiple dedicated GPUs) is out of scope of this sample.
-    for (const auto& d : devices) {
-      VkPhysicalDeviceProperties device_properties;
-      VkPhysicalDeviceFeatures device_features;
-      vkGetPhysicalDeviceProperties(d, &device_properties);
-      vkGetPhysicalDeviceFeatures(d, &device_features);
-
-      if (device_properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU && device_features.geometryShader) {
-        physical_device = d;
-        break;
-      }
-    }
-  }
+  // Worker threads: startup work first, parallel recording afterwards
+  auto jobs = std::make_unique<JobSystem>();
+  setup_job_system(*jobs, options.threads);
 
-  // Select graphics queue family
-  {
-    uint32_t count = 0;
-    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, NULL);
-    std::vector<VkQueueFamilyProperties> queue_families(count);
-    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, queue_families.data());
-
-    for (uint32_t i = 0; i < count; i++) {
-      if (queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-        queue_family = i;
-        break;
+  // Setup Dear ImGui context, style and the CPU side of the font atlas on a worker while the window and
+  // device are created. ImGui (including IM_ALLOC) is not touched on this thread until imgui_ready is waited for.
+  const JobFunction setup_imgui = [&](uint32_t, uint32_t) {
+    {
+      StartupTimingScope scope(startup, "imgui_context");
+      IMGUI_CHECKVERSION();
+      ImGui::CreateContext();
+      ImGuiIO& io = ImGui::GetIO();
+      io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard; // Enable Keyboard Controls
+      // io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;  // Enable Gamepad Controls
+      // io.ConfigFlags |= ImGuiConfigFlags_ViewportsNoTaskBarIcons;
+      // io.ConfigFlags |= ImGuiConfigFlags_ViewportsNoMerge;
+      io.ConfigFlags |= ImGuiConfigFlags_DockingEnable; // Enable Docking
+      // Platform windows are created and drawn from the UI thread's UpdatePlatformWindows, not with a render thread
+      if (!headless && !options.render_thread)
+        io.ConfigFlags |= ImGuiConfigFlags_ViewportsEnable; // Enable Multi-Viewport / Platform Windows
+
+      // Setup Dear ImGui style
+      ImGui::StyleColorsDark();
+      // ImGui::StyleColorsLight();
+
+      // When viewports are enabled we tweak WindowRounding/WindowBg so platform windows can look identical to regular ones.
+      ImGuiStyle& style = ImGui::GetStyle();
+      if (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable) {
+        style.WindowRounding = 0.0f;
+        style.Colors[ImGuiCol_WindowBg].w = 1.0f;
       }
     }
-  }
-
-  // Create logical device (with 1 queue)
-  {
-    int device_extension_count = 1;
-    const char* device_extensions[] = { "VK_KHR_swapchain" };
-    const float queue_priority[] = { 1.0f };
-    VkDeviceQueueCreateInfo queue_info[1] = {};
-    queue_info[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queue_info[0].queueFamilyIndex = queue_family.value();
-    queue_info[0].queueCount = 1;
-    queue_info[0].pQueuePriorities = queue_priority;
-    VkDeviceCreateInfo create_info = {};
-    create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    create_info.queueCreateInfoCount = sizeof(queue_info) / sizeof(queue_info[0]);
-    create_info.pQueueCreateInfos = queue_info;
-    create_info.enabledExtensionCount = device_extension_count;
-    create_info.ppEnabledExtensionNames = device_extensions;
-    err = vkCreateDevice(physical_device, &create_info, allocator, &device);
-    check_vk_result(err);
-    vkGetDeviceQueue(device, queue_family.value(), 0, &queue);
-  }
-
-  // Create descriptor pool
-  {
-    VkDescriptorPoolSize pool_sizes[] = { { VK_DESCRIPTOR_TYPE_SAMPLER, 1000 },
-                                          { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1000 },
-                                          { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1000 },
-                                          { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1000 },
-                                          { VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 1000 },
-                                          { VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 1000 },
-                                          { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1000 },
-                                          { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1000 },
-                                          { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1000 },
-                                          { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1000 },
-                                          { VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1000 } };
-    VkDescriptorPoolCreateInfo pool_info = {};
-    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-    pool_info.maxSets = 1000 * IM_ARRAYSIZE(pool_sizes);
-    pool_info.poolSizeCount = (uint32_t)IM_ARRAYSIZE(pool_sizes);
-    pool_info.pPoolSizes = pool_sizes;
-    err = vkCreateDescriptorPool(device, &pool_info, allocator, &descriptor_pool);
-    check_vk_result(err);
-  }
-}
-
-void
-setup_vulkan_window(ImGui_ImplVulkanH_Window* wd,
-                    VkSurfaceKHR surface,
-                    uint32_t width,
-                    uint32_t height,
-                    VkInstance& instance,
-                    VkAllocationCallbacks* allocator,
-                    VkPhysicalDevice& physical_device,
-                    VkDevice& device,
-                    std::optional<uint32_t>& queue_family,
-                    const int& min_image_count)
-{
-  wd->Surface = surface;
-
-  // Check for WSI support
-  VkBool32 res;
-  vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, queue_family.value(), wd->Surface, &res);
-  if (res != VK_TRUE) {
-    fprintf(stderr, "Error no WSI support on physical device 0\n");
-    exit(-1);
-  }
-
-  // Select Surface Format
-  const VkFormat image_format[] = { VK_FORMAT_B8G8R8A8_UNORM, VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_B8G8R8_UNORM, VK_FORMAT_R8G8B8_UNORM };
-  const VkColorSpaceKHR colour_space = VK_COLORSPACE_SRGB_NONLINEAR_KHR;
-  wd->SurfaceFormat = ImGui_ImplVulkanH_SelectSurfaceFormat(physical_device, wd->Surface, image_format, (size_t)IM_ARRAYSIZE(image_format), colour_space);
-
-  // Select Present Mode
-#ifdef IMGUI_UNLIMITED_FRAME_RATE
-  VkPresentModeKHR present_modes[] = { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_KHR };
-#else
-  VkPresentModeKHR present_modes[] = { VK_PRESENT_MODE_FIFO_KHR };
-#endif
-  wd->PresentMode = ImGui_ImplVulkanH_SelectPresentMode(physical_device, wd->Surface, &present_modes[0], IM_ARRAYSIZE(present_modes));
-  printf("[vulkan] Selected PresentMode = %d\n", wd->PresentMode);
-
-  // Create SwapChain, RenderPass, Framebuffer, etc.
-  ImGui_ImplVulkanH_CreateOrResizeWindow(instance, physical_device, device, wd, queue_family.value(), allocator, width, height, min_image_count);
-}
-
-void
-cleanup_vulkan(VkInstance& instance, VkAllocationCallbacks* allocator, VkDebugReportCallbackEXT& reporter, VkDevice& device, VkDescriptorPool& descriptor_pool)
-{
-  vkDestroyDescriptorPool(device, descriptor_pool, allocator);
-
-#ifdef _DEBUG
-  // Remove the debug report callback
-  auto vkDestroyDebugReportCallbackEXT = (PFN_vkDestroyDebugReportCallbackEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugReportCallbackEXT");
-  vkDestroyDebugReportCallbackEXT(instance, reporter, allocator);
-#endif // _DEBUG
-
-  vkDestroyDevice(device, allocator);
-  vkDestroyInstance(instance, nullptr);
-}
-
-void
-cleanup_vulkan_window(VkInstance& instance, VkDevice& device, ImGui_ImplVulkanH_Window& main_window_data, VkAllocationCallbacks* allocator)
-{
-  ImGui_ImplVulkanH_DestroyWindow(instance, device, &main_window_data, allocator);
-}
-
-void
-frame_render(ImGui_ImplVulkanH_Window* wd, ImDrawData* draw_data, VkQueue& queue, VkDevice& device, bool& rebuild_swapchain)
-{
-  VkResult err;
-
-  VkSemaphore image_acquired_semaphore = wd->FrameSemaphores[wd->SemaphoreIndex].ImageAcquiredSemaphore;
-  VkSemaphore render_complete_semaphore = wd->FrameSemaphores[wd->SemaphoreIndex].RenderCompleteSemaphore;
-  err = vkAcquireNextImageKHR(device, wd->Swapchain, UINT64_MAX, image_acquired_semaphore, VK_NULL_HANDLE, &wd->FrameIndex);
-  if (err == VK_ERROR_OUT_OF_DATE_KHR || err == VK_SUBOPTIMAL_KHR) {
-    rebuild_swapchain = true;
-    return;
-  }
-  check_vk_result(err);
-
-  ImGui_ImplVulkanH_Frame* fd = &wd->Frames[wd->FrameIndex];
-  {
-    // wait for previous frame to finish
-    // wait indefinitely instead of periodically checking
-    err = vkWaitForFences(device, 1, &fd->Fence, VK_TRUE, UINT64_MAX);
-    check_vk_result(err);
-
-    err = vkResetFences(device, 1, &fd->Fence);
-    check_vk_result(err);
-  }
-  {
-    err = vkResetCommandPool(device, fd->CommandPool, 0);
-    check_vk_result(err);
-    VkCommandBufferBeginInfo info = {};
-    info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    info.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    err = vkBeginCommandBuffer(fd->CommandBuffer, &info);
-    check_vk_result(err);
-  }
-  {
-    VkRenderPassBeginInfo info = {};
-    info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    info.renderPass = wd->RenderPass;
-    info.framebuffer = fd->Framebuffer;
-    info.renderArea.extent.width = wd->Width;
-    info.renderArea.extent.height = wd->Height;
-    info.clearValueCount = 1;
-    info.pClearValues = &wd->ClearValue;
-    vkCmdBeginRenderPass(fd->CommandBuffer, &info, VK_SUBPASS_CONTENTS_INLINE);
-  }
-
-  // Record dear imgui primitives into command buffer
-  ImGui_ImplVulkan_RenderDrawData(draw_data, fd->CommandBuffer);
-
-  // Submit command buffer
-  vkCmdEndRenderPass(fd->CommandBuffer);
-  {
-    VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    VkSubmitInfo info = {};
-    info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    info.waitSemaphoreCount = 1;
-    info.pWaitSemaphores = &image_acquired_semaphore;
-    info.pWaitDstStageMask = &wait_stage;
-    info.commandBufferCount = 1;
-    info.pCommandBuffers = &fd->CommandBuffer;
-    info.signalSemaphoreCount = 1;
-    info.pSignalSemaphores = &render_complete_semaphore;
-
-    err = vkEndCommandBuffer(fd->CommandBuffer);
-    check_vk_result(err);
-    err = vkQueueSubmit(queue, 1, &info, fd->Fence);
-    check_vk_result(err);
-  }
-}
-
-void
-frame_present(ImGui_ImplVulkanH_Window* wd, VkQueue& queue, bool& rebuild_swapchain)
-{
-  if (rebuild_swapchain)
-    return;
-  VkSemaphore render_complete_semaphore = wd->FrameSemaphores[wd->SemaphoreIndex].RenderCompleteSemaphore;
-  VkPresentInfoKHR info = {};
-  info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-  info.waitSemaphoreCount = 1;
-  info.pWaitSemaphores = &render_complete_semaphore;
-  info.swapchainCount = 1;
-  info.pSwapchains = &wd->Swapchain;
-  info.pImageIndices = &wd->FrameIndex;
-  VkResult err = vkQueuePresentKHR(queue, &info);
-  if (err == VK_ERROR_OUT_OF_DATE_KHR || err == VK_SUBOPTIMAL_KHR) {
-    rebuild_swapchain = true;
-    return;
-  }
-  check_vk_result(err);
-  wd->SemaphoreIndex = (wd->SemaphoreIndex + 1) % wd->ImageCount; // Now we can use the next set of semaphores
-}
-
-int
-main(int, char**)
-{
-  if (!init_sdl2())
-    return EXIT_FAILURE;
+    // ImFontAtlas::Build and the RGBA conversion ImGui_ImplVulkan_CreateFontsTexture would otherwise do on the main thread
+    StartupTimingScope scope(startup, "font_atlas");
+    unsigned char* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    ImGui::GetIO().Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+  };
+  JobCounter imgui_ready;
+  job_system_run(*jobs, 1, setup_imgui, imgui_ready);
+
+  SDL_Window* window = nullptr;
+  if (!headless) {
+    StartupTimingScope scope(startup, "sdl_window");
+    if (!init_sdl2()) {
+      job_system_wait(*jobs, imgui_ready);
+      cleanup_job_system(*jobs);
+      return EXIT_FAILURE;
+    }
 
-    // From 2.0.18: Enable native IME.
+      // From 2.0.18: Enable native IME.
 #ifdef SDL_HINT_IME_SHOW_UI
-  SDL_SetHint(SDL_HINT_IME_SHOW_UI, "1");
+    SDL_SetHint(SDL_HINT_IME_SHOW_UI, "1");
 #endif
 
-  // Setup Window
-  auto window = init_sdl2_window({ "Triangle App" }, 1200, 800);
+    // Setup Window
+    window = init_sdl2_window({ "Triangle App" }, options.width, options.height);
+  }
 
   // Graphics Context
   const int min_image_count = 2;
@@ -398,57 +268,133 @@ main(int, char**)
   VkDevice device = VK_NULL_HANDLE;
   std::optional<uint32_t> queue_family = std::nullopt;
   VkQueue queue = VK_NULL_HANDLE;
+  DeviceQueues queues;
   VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
-  VkSurfaceKHR surface;
+  VkSurfaceKHR surface = VK_NULL_HANDLE;
   //
   ImGui_ImplVulkanH_Window main_window_data;
+  std::vector<GpuImage> headless_images;
+  auto gpu_allocator = std::make_unique<GpuAllocator>();
   VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
+  FrameScheduler scheduler;
   bool rebuild_swapchain = false;
+  FramePacing pacing;
+  DeletionQueue deletions; // swapchain objects retired by resizes
+
+  // Must outlive the instance: every object created with it is freed through it
+  auto host_allocator = std::make_unique<HostAllocator>();
+  if (options.host_allocator) {
+    setup_host_allocator(*host_allocator);
+    allocator = &host_allocator->callbacks;
+  }
+  bool show_host_allocator_window = options.host_allocator;
+  bool show_gpu_memory_window = false;
+
+  {
+    StartupTimingScope scope(startup, "instance_device");
+    std::vector<const char*> extensions_names;
+    std::vector<const char*> device_extensions;
+    if (!headless) {
+      uint32_t extensions_count = 0;
+      SDL_Vulkan_GetInstanceExtensions(window, &extensions_count, NULL);
+      extensions_names.resize(extensions_count);
+      SDL_Vulkan_GetInstanceExtensions(window, &extensions_count, extensions_names.data());
+      device_extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
+    const char* device_override = options.device.empty() ? getenv("VT_DEVICE") : options.device.c_str();
+    setup_vulkan(extensions_names, device_extensions, instance, allocator, reporter, window, surface, physical_device, device, queue_family, queue, queues, device_override, descriptor_pool);
+  }
 
+  // Device memory for everything we create ourselves
+  setup_gpu_allocator(*gpu_allocator, physical_device, device, allocator);
+
+  // Streaming uploads through the transfer queue
+  const VkDeviceSize upload_staging_size = 32ull * 1024 * 1024;
+  auto uploads = std::make_unique<UploadQueue>();
   {
-    uint32_t extensions_count = 0;
-    SDL_Vulkan_GetInstanceExtensions(window, &extensions_count, NULL);
-    std::vector<const char*> extensions_names(extensions_count);
-    SDL_Vulkan_GetInstanceExtensions(window, &extensions_count, extensions_names.data());
-    setup_vulkan(extensions_names, instance, allocator, reporter, physical_device, device, queue_family, queue, descriptor_pool);
+    StartupTimingScope scope(startup, "upload_queue");
+    setup_upload_queue(*uploads, *gpu_allocator, device, queues.transfer, queues.transfer_family, queue, queue_family.value(), upload_staging_size, allocator);
   }
 
-  // Create Window Surface
-  if (SDL_Vulkan_CreateSurface(window, instance, &surface) == 0) {
-    printf("Failed to create SDL_Vulkan surface.\n");
-    return EXIT_FAILURE;
+  // The backend setup below needs the ImGui context
+  {
+    StartupTimingScope scope(startup, "wait_imgui");
+    job_system_wait(*jobs, imgui_ready);
   }
+  ImGuiIO& io = ImGui::GetIO();
 
-  // Create framebuffers
-  int w, h;
-  SDL_GetWindowSize(window, &w, &h);
-  setup_vulkan_window(&main_window_data, surface, w, h, instance, allocator, physical_device, device, queue_family, min_image_count);
+  const double swapchain_begin_ms = startup_timings_now_ms(startup);
+  if (headless) {
+    // Offscreen framebuffers
+    const uint32_t image_count = std::max<uint32_t>(min_image_count, options.frames_in_flight);
+    setup_vulkan_headless(&main_window_data, *gpu_allocator, headless_images, options.width, options.height, allocator, device, image_count);
+    setup_frame_pacing(pacing, physical_device, VK_NULL_HANDLE, options.present_mode, options.fps_limit, options.low_latency);
+  } else {
+    // Create framebuffers
+    int w, h;
+    SDL_GetWindowSize(window, &w, &h);
+    setup_frame_pacing(pacing, physical_device, surface, options.present_mode, options.fps_limit, options.low_latency);
+    setup_vulkan_window(&main_window_data, surface, w, h, allocator, physical_device, device, queue_family, pacing.present_mode, min_image_count, deletions);
+  }
 
-  // Setup Dear ImGui context
-  IMGUI_CHECKVERSION();
-  ImGui::CreateContext();
-  ImGuiIO& io = ImGui::GetIO();
-  (void)io;
-  io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard; // Enable Keyboard Controls
-  // io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;  // Enable Gamepad Controls
-  // io.ConfigFlags |= ImGuiConfigFlags_ViewportsNoTaskBarIcons;
-  // io.ConfigFlags |= ImGuiConfigFlags_ViewportsNoMerge;
-  io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;   // Enable Docking
-  io.ConfigFlags |= ImGuiConfigFlags_ViewportsEnable; // Enable Multi-Viewport / Platform Windows
-
-  // Setup Dear ImGui style
-  ImGui::StyleColorsDark();
-  // ImGui::StyleColorsLight();
-
-  // When viewports are enabled we tweak WindowRounding/WindowBg so platform windows can look identical to regular ones.
-  ImGuiStyle& style = ImGui::GetStyle();
-  if (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable) {
-    style.WindowRounding = 0.0f;
-    style.Colors[ImGuiCol_WindowBg].w = 1.0f;
+  startup_timings_add(startup, "swapchain", swapchain_begin_ms, startup_timings_now_ms(startup));
+
+  // The UI thread never waits on the GPU with a render thread
+  if (options.render_thread) {
+    pacing.low_latency = false;
+    pacing.low_latency_available = false;
   }
 
+  // Frame slots, their command buffers and sync
+  setup_frame_scheduler(scheduler, device, queue_family.value(), options.frames_in_flight, headless ? 0 : main_window_data.ImageCount, allocator);
+  printf("[vulkan] %u frames in flight, %u images\n", scheduler.frames_in_flight, main_window_data.ImageCount);
+
+  // Parallel recording: a command pool per (thread, frame slot)
+  CommandRecorder recorder;
+  setup_command_recorder(recorder, device, queue_family.value(), jobs->thread_count, scheduler.frames_in_flight, allocator);
+
+  // Transient descriptor sets, reset per frame slot; long-lived textures and buffers go in the bindless table
+  const std::vector<DescriptorPoolRatio> descriptor_ratios = { { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4.0f },
+                                                               { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f },
+                                                               { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f } };
+  DescriptorAllocator descriptors;
+  setup_descriptor_allocator(descriptors, device, scheduler.frames_in_flight, descriptor_ratios, allocator);
+  BindlessTable bindless;
+  const bool has_bindless = setup_bindless_table(bindless, physical_device, device, deletions, allocator);
+
+  // Pipeline cache, seeded from the previous run
+  PipelineCacheInfo pipeline_cache_info;
+  {
+    StartupTimingScope scope(startup, "pipeline_cache");
+    pipeline_cache_info = setup_pipeline_cache(physical_device, device, options.pipeline_cache_path, allocator, pipeline_cache);
+  }
+
+  // Mesh and UI renderer pipelines are built on workers while the backend builds its own (the pipeline cache is
+  // internally synchronized, the allocator and upload queue lock)
+  MeshRenderer meshes;
+  UiRenderer ui;
+  bool meshes_ready = false;
+  bool ui_ready = !options.retained_ui;
+  const JobFunction setup_renderers = [&](uint32_t index, uint32_t) {
+    if (index == 0) {
+      // GPU-culled instanced meshes, drawn in the same render pass before ImGui
+      StartupTimingScope scope(startup, "mesh_renderer");
+      meshes_ready = setup_mesh_renderer(meshes, physical_device, device, *gpu_allocator, *uploads, descriptors, has_bindless ? &bindless : nullptr, main_window_data.RenderPass, pipeline_cache, scheduler.frames_in_flight, options.instances, options.batches, allocator);
+    } else if (options.retained_ui) {
+      // Main viewport UI: cached vertex data and command buffers
+      StartupTimingScope scope(startup, "ui_renderer");
+      ui_ready = setup_ui_renderer(ui, device, *gpu_allocator, deletions, main_window_data.RenderPass, pipeline_cache, queue_family.value(), scheduler.frames_in_flight, allocator);
+    }
+  };
+  // Pipeline creation is timed as a whole, from starting the workers until they and the backend are done
+  const auto pipelines_begin = std::chrono::steady_clock::now();
+  JobCounter renderers_ready;
+  job_system_run(*jobs, 2, setup_renderers, renderers_ready);
+
   // Setup Platform/Renderer backends
-  ImGui_ImplSDL2_InitForVulkan(window);
+  const double backend_begin_ms = startup_timings_now_ms(startup);
+  if (!headless)
+    ImGui_ImplSDL2_InitForVulkan(window);
   ImGui_ImplVulkan_InitInfo init_info = {};
   init_info.Instance = instance;
   init_info.PhysicalDevice = physical_device;
@@ -459,70 +405,208 @@ main(int, char**)
   init_info.DescriptorPool = descriptor_pool;
   init_info.Subpass = 0;
   init_info.MinImageCount = min_image_count;
-  init_info.ImageCount = main_window_data.ImageCount;
+  // The backend rotates its vertex/index buffers by ImageCount, which must cover every frame in flight
+  init_info.ImageCount = std::max(main_window_data.ImageCount, scheduler.frames_in_flight);
   init_info.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
   init_info.Allocator = allocator;
   init_info.CheckVkResultFn = check_vk_result;
   ImGui_ImplVulkan_Init(&init_info, main_window_data.RenderPass);
 
-  // Upload Fonts
+  // Upload Fonts: the atlas is already built; submitted without waiting, so the first frame only queues behind
+  // the copy on the GPU. The staging objects are released once the fence signals, by this thread's upload_queue_collect.
+  upload_queue_submit_graphics(
+    *uploads, [](VkCommandBuffer command_buffer) { ImGui_ImplVulkan_CreateFontsTexture(command_buffer); }, [] { ImGui_ImplVulkan_DestroyFontUploadObjects(); });
+  startup_timings_add(startup, "imgui_backend", backend_begin_ms, startup_timings_now_ms(startup));
+
   {
-    // Use any command queue
-    VkCommandPool command_pool = main_window_data.Frames[main_window_data.FrameIndex].CommandPool;
-    VkCommandBuffer command_buffer = main_window_data.Frames[main_window_data.FrameIndex].CommandBuffer;
-
-    auto err = vkResetCommandPool(device, command_pool, 0);
-    check_vk_result(err);
-    VkCommandBufferBeginInfo begin_info = {};
-    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    begin_info.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    err = vkBeginCommandBuffer(command_buffer, &begin_info);
-    check_vk_result(err);
-
-    ImGui_ImplVulkan_CreateFontsTexture(command_buffer);
-
-    VkSubmitInfo end_info = {};
-    end_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    end_info.commandBufferCount = 1;
-    end_info.pCommandBuffers = &command_buffer;
-    err = vkEndCommandBuffer(command_buffer);
-    check_vk_result(err);
-    err = vkQueueSubmit(queue, 1, &end_info, VK_NULL_HANDLE);
-    check_vk_result(err);
-
-    err = vkDeviceWaitIdle(device);
-    check_vk_result(err);
-    ImGui_ImplVulkan_DestroyFontUploadObjects();
+    StartupTimingScope scope(startup, "wait_renderers");
+    job_system_wait(*jobs, renderers_ready);
+  }
+  const float pipelines_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - pipelines_begin).count();
+
+  // Only a cold run measures the uncached cost, keep that as the baseline
+  const float cold_pipelines_ms = pipeline_cache_info.warm ? pipeline_cache_info.cold_create_ms : pipelines_ms;
+  if (pipeline_cache_info.warm)
+    printf("[vulkan] Pipeline creation %.2f ms with cache (%zu bytes), %.2f ms cold: saved %.2f ms\n", pipelines_ms, pipeline_cache_info.loaded_bytes, cold_pipelines_ms, cold_pipelines_ms - pipelines_ms);
+  else
+    printf("[vulkan] Pipeline creation %.2f ms (cold cache)\n", pipelines_ms);
+
+  // A failure from here on skips the loop and goes through the normal cleanup
+  int exit_code = EXIT_SUCCESS;
+  if (!meshes_ready || !ui_ready)
+    exit_code = EXIT_FAILURE;
+  bool show_meshes_window = false;
+  bool show_ui_renderer_window = false;
+
+  // Platform windows: drawn with their own UiRenderer in the main window's submit and present.
+  // --backend-ui-renderer keeps the backend's one-window-at-a-time path.
+  ViewportRenderer viewports;
+  const bool batched_viewports = options.retained_ui && (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable);
+  if (batched_viewports)
+    setup_viewport_renderer(viewports, instance, physical_device, device, queue_family.value(), min_image_count, pipeline_cache, *gpu_allocator, deletions, scheduler, main_window_data, allocator);
+
+  // Timings (allocated once, the ring itself never allocates)
+  auto timings = std::make_unique<FrameTimings>();
+  setup_frame_timings(*timings, physical_device, device, queue_family.value(), allocator);
+  // With a render thread it owns timings, the UI thread's stages go to their own ring (shown in the overlay)
+  auto ui_timings = std::make_unique<FrameTimings>();
+  if (options.render_thread)
+    setup_frame_timings(*ui_timings, physical_device, device, queue_family.value(), allocator);
+  FrameTimings& loop_timings = options.render_thread ? *ui_timings : *timings;
+  // The live graphs change every frame, which would keep on-demand mode from ever idling
+  bool show_timings_window = !options.on_demand;
+
+  // Recording: frames are read back through a ring of mapped buffers, one per frame in flight and two for the writer
+  auto stream = std::make_unique<FrameStream>();
+  if (!options.record_path.empty()) {
+    VkSurfaceCapabilitiesKHR cap = {};
+    if (!headless) {
+      VkResult err = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, main_window_data.Surface, &cap);
+      check_vk_result(err);
+    }
+    if (!headless && (cap.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) == 0)
+      fprintf(stderr, "[record] Swapchain images cannot be copied from, not recording\n");
+    else if (!frame_stream_supports(main_window_data.SurfaceFormat.format))
+      fprintf(stderr, "[record] Surface format %d is not supported, not recording\n", main_window_data.SurfaceFormat.format);
+    else if (!setup_frame_stream(*stream, *gpu_allocator, device, scheduler.timeline, scheduler.frames_in_flight + 2, options.record_path.c_str()))
+      fprintf(stderr, "[record] Not recording\n");
   }
+  FrameStream* record = stream->writer.joinable() ? stream.get() : nullptr;
 
   // State
   bool show_demo_window = true;
   ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
-  bool running = true;
+  uint32_t frame_count = 0;
+  const auto start_time = std::chrono::steady_clock::now();
+  auto last_time = start_time;
+
+  bool show_pacing_window = false;
+  bool present_mode_changed = false;
+
+  // Headless has no input to wait for, it always renders
+  RedrawState redraw;
+  redraw.on_demand = options.on_demand && !headless;
+  redraw.keep_alive_s = options.keep_alive_s;
+  // The animated mesh scene would render every frame, it starts paused (the Meshes window resumes it)
+  if (redraw.on_demand)
+    meshes.paused = true;
+  bool show_redraw_window = false;
+
+  // Rebuilds the main swapchain, false while the window has no area
+  const auto rebuild_main_swapchain = [&](uint32_t width, uint32_t height, VkPresentModeKHR present_mode) {
+    main_window_data.PresentMode = present_mode;
+    // No device wait: the old swapchain is passed as oldSwapchain and its objects are destroyed
+    // once the first frame submitted after this point has finished
+    const uint64_t retire_value = frame_scheduler_signal_value(scheduler);
+    if (width == 0 || height == 0 || !resize_vulkan_swapchain(&main_window_data, physical_device, device, width, height, min_image_count, allocator, deletions, retire_value))
+      return false;
+    frame_scheduler_resize_images(scheduler, device, main_window_data.ImageCount, allocator, deletions, retire_value);
+    return true;
+  };
+
+  // Render thread: from here on it owns the queue, the swapchain and everything frame_render touches.
+  // The swapchain follows the window size and present mode each snapshot was built with.
+  auto render = std::make_unique<RenderThread>();
+  uint32_t swapchain_width = main_window_data.Width;
+  uint32_t swapchain_height = main_window_data.Height;
+  const auto render_snapshot = [&](DrawSnapshot& snapshot) {
+    frame_timings_begin_frame(*timings);
+    deletion_queue_collect(deletions, frame_scheduler_completed_value(scheduler, device));
+    const bool resized = snapshot.width != swapchain_width || snapshot.height != swapchain_height;
+    if (!headless && (rebuild_swapchain || resized || snapshot.present_mode != main_window_data.PresentMode)) {
+      rebuild_swapchain = !rebuild_main_swapchain(snapshot.width, snapshot.height, snapshot.present_mode);
+      swapchain_width = snapshot.width;
+      swapchain_height = snapshot.height;
+      if (rebuild_swapchain)
+        return;
+    }
+    main_window_data.ClearValue = snapshot.clear_value;
+    if (frame_render(&main_window_data, &snapshot.draw_data, true, queue, device, scheduler, *uploads, meshes, *jobs, recorder, descriptors, &ui, nullptr, record, *timings, rebuild_swapchain))
+      startup_timings_first_frame(startup);
+    frame_present(&main_window_data, true, queue, scheduler, nullptr, *timings, rebuild_swapchain);
+  };
+
+  FrameCapture capture;
+  if (exit_code == EXIT_SUCCESS && !options.capture_path.empty() && !open_frame_capture(capture, options.capture_path.c_str()))
+    exit_code = EXIT_FAILURE;
+
+  if (options.render_thread && exit_code == EXIT_SUCCESS)
+    start_render_thread(*render, render_snapshot);
+
+  bool running = exit_code == EXIT_SUCCESS;
   while (running) {
-    SDL_Event event;
-    while (SDL_PollEvent(&event)) {
-      ImGui_ImplSDL2_ProcessEvent(&event);
-      sdl2_handle_quit_event(window, event, running);
+    frame_timings_begin_frame(loop_timings);
+
+    // Frame limiter / low latency: before input is sampled
+    {
+      FrameTimingScope scope(loop_timings, FrameStage::pacing);
+      frame_pacing_wait(pacing, scheduler, device);
+    }
+    if (!options.render_thread)
+      deletion_queue_collect(deletions, frame_scheduler_completed_value(scheduler, device));
+    else
+      upload_queue_collect(*uploads); // the font upload's completion belongs to this thread, frames only collect their own
+
+    if (replaying) {
+      if (!frame_replay_next(replay)) {
+        running = false;
+        continue;
+      }
+      main_window_data.ClearValue = replay.clear_value;
+      if (frame_render(&main_window_data, &replay.draw_data, true, queue, device, scheduler, *uploads, meshes, *jobs, recorder, descriptors, options.retained_ui ? &ui : nullptr, nullptr, record, *timings, rebuild_swapchain))
+        startup_timings_first_frame(startup);
+      frame_present(&main_window_data, true, queue, scheduler, nullptr, *timings, rebuild_swapchain);
+      if (options.host_allocator)
+        host_allocator_end_frame(*host_allocator);
+      frame_count++;
+      if (options.frames > 0 && frame_count >= options.frames)
+        running = false;
+      continue;
+    }
+
+    // The mesh scene changes every frame without touching the draw data
+    redraw.animating = mesh_renderer_animating(meshes);
+    if (headless) {
+      // No platform backend: feed ImGui the display size and frame time ourselves
+      const auto now = std::chrono::steady_clock::now();
+      const float dt = std::chrono::duration<float>(now - last_time).count();
+      last_time = now;
+      io.DisplaySize = ImVec2((float)options.width, (float)options.height);
+      io.DeltaTime = dt > 0.0f ? dt : 1.0f / 60.0f;
+    } else {
+      FrameTimingScope scope(loop_timings, FrameStage::poll_events);
+      // Idle (on demand and nothing changed, or minimized): block until input or a timeout
+      const bool minimized = (SDL_GetWindowFlags(window) & SDL_WINDOW_MINIMIZED) != 0;
+      const int wait_ms = minimized ? 250 : redraw_wait_timeout_ms(redraw);
+      SDL_Event event;
+      bool has_event = wait_ms >= 0 ? SDL_WaitEventTimeout(&event, wait_ms) != 0 : SDL_PollEvent(&event) != 0;
+      while (has_event) {
+        ImGui_ImplSDL2_ProcessEvent(&event);
+        sdl2_handle_quit_event(window, event, running);
+        redraw_mark_dirty(redraw, event.type == SDL_WINDOWEVENT);
+        has_event = SDL_PollEvent(&event) != 0;
+      }
     }
 
-    // resize swap chain?
-    if (rebuild_swapchain) {
+    // resize swap chain? (the render thread does its own)
+    if (!options.render_thread && rebuild_swapchain) {
       int width = 0;
       int height = 0;
       SDL_GetWindowSize(window, &width, &height);
-      if (width > 0 && height > 0) {
-        ImGui_ImplVulkan_SetMinImageCount(min_image_count);
-        ImGui_ImplVulkanH_CreateOrResizeWindow(instance, physical_device, device, &main_window_data, queue_family.value(), allocator, width, height, min_image_count);
-        main_window_data.FrameIndex = 0;
+      if (rebuild_main_swapchain(width, height, pacing.present_mode)) {
         rebuild_swapchain = false;
+        redraw_mark_dirty(redraw, true);
       }
     }
 
-    ImGui_ImplVulkan_NewFrame();
-    ImGui_ImplSDL2_NewFrame();
-    ImGui::NewFrame();
+    {
+      FrameTimingScope scope(loop_timings, FrameStage::imgui_new_frame);
+      ImGui_ImplVulkan_NewFrame();
+      if (!headless)
+        ImGui_ImplSDL2_NewFrame();
+      ImGui::NewFrame();
+    }
 
     // Show demo window
     ImGui::ShowDemoWindow(&show_demo_window);
@@ -530,44 +614,188 @@ main(int, char**)
     // 2. Show a simple window that we create ourselves. We use a Begin/End pair to create a named window.
     ImGui::Begin("Sample window");
     ImGui::Text("Hello, World!");
+    ImGui::Checkbox("Frame timings", &show_timings_window);
+    ImGui::Checkbox("Frame pacing", &show_pacing_window);
+    ImGui::Checkbox("Redraw", &show_redraw_window);
+    // These read (or, for the mesh camera, write) renderer state, which a render thread owns
+    if (!options.render_thread) {
+      ImGui::Checkbox("GPU memory", &show_gpu_memory_window);
+      ImGui::Checkbox("Meshes", &show_meshes_window);
+      if (options.retained_ui)
+        ImGui::Checkbox("UI renderer", &show_ui_renderer_window);
+    }
     ImGui::End();
 
+    if (show_timings_window)
+      frame_timings_draw_overlay(loop_timings, &show_timings_window);
+    if (show_host_allocator_window)
+      host_allocator_draw_stats(*host_allocator, &show_host_allocator_window);
+    if (show_gpu_memory_window)
+      gpu_allocator_draw_stats(*gpu_allocator, &show_gpu_memory_window);
+    if (show_meshes_window)
+      mesh_renderer_draw_stats(meshes, &show_meshes_window);
+    if (show_pacing_window && frame_pacing_draw_settings(pacing, &show_pacing_window))
+      present_mode_changed = !headless;
+    if (show_redraw_window)
+      redraw_draw_settings(redraw, &show_redraw_window);
+    if (show_ui_renderer_window)
+      ui_renderer_draw_stats(ui, &show_ui_renderer_window);
+
     // Rendering
     {
-      ImGui::Render();
+      {
+        FrameTimingScope scope(loop_timings, FrameStage::imgui_render);
+        ImGui::Render();
+      }
       ImDrawData* draw_data = ImGui::GetDrawData();
-      const bool is_minimized = (draw_data->DisplaySize.x <= 0.0f || draw_data->DisplaySize.y <= 0.0f);
-      main_window_data.ClearValue.color.float32[0] = clear_color.x * clear_color.w;
-      main_window_data.ClearValue.color.float32[1] = clear_color.y * clear_color.w;
-      main_window_data.ClearValue.color.float32[2] = clear_color.z * clear_color.w;
-      main_window_data.ClearValue.color.float32[3] = clear_color.w;
-
-      if (!is_minimized)
-        frame_render(&main_window_data, draw_data, queue, device, rebuild_swapchain);
 
-      // Update and Render additional Platform Windows
+      // Create, resize and destroy platform windows before any of them is drawn
       if (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable) {
+        FrameTimingScope scope(loop_timings, FrameStage::viewports);
         ImGui::UpdatePlatformWindows();
+      }
+
+      // Unchanged UI in on-demand mode: the frame was built but is neither rendered nor presented.
+      // Batched platform windows are still drawn while the main window is minimized.
+      const bool is_minimized = (draw_data->DisplaySize.x <= 0.0f || draw_data->DisplaySize.y <= 0.0f);
+      const bool has_platform_windows = batched_viewports && !viewports.windows.empty();
+      const bool skip_render = (is_minimized && !has_platform_windows) || !redraw_should_render(redraw);
+      VkClearValue clear_value = {};
+      clear_value.color.float32[0] = clear_color.x * clear_color.w;
+      clear_value.color.float32[1] = clear_color.y * clear_color.w;
+      clear_value.color.float32[2] = clear_color.z * clear_color.w;
+      clear_value.color.float32[3] = clear_color.w;
+      if (!skip_render)
+        frame_capture_write(capture, draw_data, clear_value);
+
+      // Hand the frame to the render thread, which takes the latest one whenever it is ready
+      if (options.render_thread && !skip_render) {
+        FrameTimingScope scope(loop_timings, FrameStage::handoff);
+        DrawSnapshot& snapshot = render_thread_back(*render);
+        draw_snapshot_copy(snapshot, draw_data);
+        snapshot.frame = frame_count;
+        snapshot.width = options.width;
+        snapshot.height = options.height;
+        if (!headless) {
+          int width = 0;
+          int height = 0;
+          SDL_GetWindowSize(window, &width, &height);
+          snapshot.width = static_cast<uint32_t>(width);
+          snapshot.height = static_cast<uint32_t>(height);
+        }
+        snapshot.present_mode = pacing.present_mode;
+        snapshot.clear_value = clear_value;
+        render_thread_publish(*render);
+      }
+      if (!options.render_thread)
+        main_window_data.ClearValue = clear_value;
+
+      // A swapchain that failed to rebuild is neither acquired nor presented, so its images and semaphores stay balanced
+      const bool draw_main = !is_minimized && !rebuild_swapchain;
+      ViewportRenderer* batched = batched_viewports ? &viewports : nullptr;
+      if (!skip_render && !options.render_thread &&
+          frame_render(&main_window_data, draw_data, draw_main, queue, device, scheduler, *uploads, meshes, *jobs, recorder, descriptors, options.retained_ui ? &ui : nullptr, batched, record, *timings, rebuild_swapchain))
+        startup_timings_first_frame(startup);
+
+      // Render additional Platform Windows one by one (backend path)
+      if (!batched_viewports && (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable) && redraw.rendered) {
+        FrameTimingScope scope(loop_timings, FrameStage::viewports);
         ImGui::RenderPlatformWindowsDefault();
       }
 
-      // Present Main Platform Window
-      if (!is_minimized)
-        frame_present(&main_window_data, queue, rebuild_swapchain);
+      // Present Main Platform Window, and the batched platform windows with it
+      if (!skip_render && !options.render_thread)
+        frame_present(&main_window_data, draw_main, queue, scheduler, batched, *timings, rebuild_swapchain);
+    }
+
+    // New present mode: rebuild once this frame has been presented
+    if (present_mode_changed && options.render_thread)
+      present_mode_changed = false; // travels with the next snapshot
+    if (present_mode_changed) {
+      rebuild_swapchain = true;
+      if (batched_viewports)
+        viewport_renderer_invalidate(viewports);
+      present_mode_changed = false;
     }
+
+    if (options.host_allocator)
+      host_allocator_end_frame(*host_allocator);
+
+    frame_count++;
+    if (options.frames > 0 && frame_count >= options.frames)
+      running = false;
   }
 
   // Cleanup
+  cleanup_render_thread(*render);
+  close_frame_capture(capture);
   auto err = vkDeviceWaitIdle(device);
   check_vk_result(err);
+  cleanup_frame_stream(*stream);
+
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+  if (headless && seconds > 0.0 && frame_count > 0) {
+    printf("(headless) %u frames in %.3fs: %.1f fps, %.3f ms/frame\n", frame_count, seconds, frame_count / seconds, 1000.0 * seconds / frame_count);
+    // Counts are read back a few frames late, scale the average by every frame rendered
+    const double triangles_per_frame = meshes.frames_drawn > 0 ? double(meshes.triangles_drawn) / meshes.frames_drawn : 0.0;
+    printf("(headless) %.1f M triangles/s (%.0f triangles per frame after culling)\n", triangles_per_frame * frame_count / seconds / 1e6, triangles_per_frame);
+    frame_timings_print_summary(*timings);
+  }
+  if (options.render_thread)
+    printf("[render thread] %llu frames rendered, %llu replaced before rendering\n", (unsigned long long)render->frames_rendered.load(), (unsigned long long)render->frames_dropped.load());
+  if (redraw.on_demand) {
+    printf("[redraw] %llu frames rendered, %llu skipped\n", (unsigned long long)redraw.frames_rendered, (unsigned long long)redraw.frames_skipped);
+    // Each burst of input builds settle_frames frames, a run longer than that that never skipped one never idled
+    if (redraw.frames_skipped == 0 && redraw.frames_rendered > redraw.settle_frames + 1)
+      fprintf(stderr, "[redraw] no unchanged frame was skipped, something changes every frame (animated scene or live window)\n");
+  }
+  if (!options.trace_path.empty())
+    frame_timings_export_trace(*timings, options.trace_path.c_str());
+  if (!options.csv_path.empty())
+    frame_timings_export_csv(*timings, options.csv_path.c_str());
+  if (!options.startup_trace_path.empty())
+    startup_timings_export_trace(startup, options.startup_trace_path.c_str());
+  cleanup_frame_timings(*timings, device, allocator);
+  if (options.render_thread)
+    cleanup_frame_timings(*ui_timings, device, allocator);
+  cleanup_command_recorder(recorder);
+  cleanup_descriptor_allocator(descriptors);
+  if (has_bindless)
+    cleanup_bindless_table(bindless);
+  cleanup_job_system(*jobs);
+  if (batched_viewports)
+    cleanup_viewport_renderer(viewports);
+  deletion_queue_flush(deletions);
+  cleanup_frame_scheduler(scheduler, device, allocator);
+  cleanup_mesh_renderer(meshes);
+  if (options.retained_ui)
+    cleanup_ui_renderer(ui);
+  cleanup_upload_queue(*uploads);
+
+  save_pipeline_cache(device, pipeline_cache, options.pipeline_cache_path, cold_pipelines_ms);
+
   ImGui_ImplVulkan_Shutdown();
-  ImGui_ImplSDL2_Shutdown();
+  vkDestroyPipelineCache(device, pipeline_cache, allocator);
+  if (!headless)
+    ImGui_ImplSDL2_Shutdown();
+  if (replaying)
+    close_frame_replay(replay);
   ImGui::DestroyContext();
-  cleanup_vulkan_window(instance, device, main_window_data, allocator);
+  if (headless)
+    cleanup_vulkan_headless(device, main_window_data, *gpu_allocator, headless_images, allocator);
+  else
+    cleanup_vulkan_window(instance, device, main_window_data, allocator);
+  cleanup_gpu_allocator(*gpu_allocator);
   cleanup_vulkan(instance, allocator, reporter, device, descriptor_pool);
-  SDL_DestroyWindow(window);
-  SDL_Quit();
+  if (!headless) {
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+  }
+  if (options.host_allocator) {
+    host_allocator_print_stats(*host_allocator);
+    cleanup_host_allocator(*host_allocator);
+  }
 
   printf("shutdown...\n");
-  return EXIT_SUCCESS;
-}
\ No newline at end of file
+  return exit_code;
+}
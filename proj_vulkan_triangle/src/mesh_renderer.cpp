@@ -0,0 +1,598 @@
+#include "mesh_renderer.hpp"
+
+#include "imgui.h"
+#include "vulkan_utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdio.h>
+
+namespace {
+
+// SPIR-V generated from shaders/ at build time (glslc -mfmt=c)
+const uint32_t mesh_vert_spv[] =
+#include "mesh.vert.h"
+  ;
+const uint32_t mesh_frag_spv[] =
+#include "mesh.frag.h"
+  ;
+const uint32_t cull_comp_spv[] =
+#include "cull.comp.h"
+  ;
+const uint32_t cull_subgroup_comp_spv[] =
+#include "cull_subgroup.comp.h"
+  ;
+// Same shaders reading their buffers from the bindless table
+const uint32_t mesh_bindless_vert_spv[] =
+#include "mesh_bindless.vert.h"
+  ;
+const uint32_t cull_bindless_comp_spv[] =
+#include "cull_bindless.comp.h"
+  ;
+const uint32_t cull_subgroup_bindless_comp_spv[] =
+#include "cull_subgroup_bindless.comp.h"
+  ;
+
+constexpr uint32_t cull_group_size = 64;
+// Batches are a multiple of the largest subgroup size, so a subgroup never spans two batches
+constexpr uint32_t batch_alignment = 128;
+
+// Shared by every stage, matches PushConstants in the shaders
+struct PushConstants
+{
+  float scale[2];
+  float time;
+  uint32_t instance_base;
+  float camera[2];
+  float zoom;
+  uint32_t instance_count;
+  float extent;
+  uint32_t batch_size;
+  uint32_t instances_index;
+  uint32_t visible_index;
+  uint32_t commands_index;
+};
+
+// LOD chain of a disc: regular polygons from a 64-sided fan down to a single triangle
+const uint32_t mesh_sides[mesh_lod_count] = { 64, 16, 6, 4, 3 };
+
+void
+build_meshes(std::vector<float>& vertices, std::vector<uint32_t>& indices, std::vector<MeshRange>& meshes)
+{
+  const float pi = 3.14159265358979f;
+  for (uint32_t sides : mesh_sides) {
+    MeshRange range;
+    range.first_index = static_cast<uint32_t>(indices.size());
+    range.vertex_offset = static_cast<int32_t>(vertices.size() / 2);
+    if (sides == 3) {
+      for (uint32_t i = 0; i < 3; i++) {
+        vertices.push_back(cosf(2.0f * pi * i / 3.0f + pi / 2.0f));
+        vertices.push_back(sinf(2.0f * pi * i / 3.0f + pi / 2.0f));
+        indices.push_back(i);
+      }
+    } else {
+      // fan around a center vertex
+      vertices.push_back(0.0f);
+      vertices.push_back(0.0f);
+      for (uint32_t i = 0; i < sides; i++) {
+        vertices.push_back(cosf(2.0f * pi * i / sides));
+        vertices.push_back(sinf(2.0f * pi * i / sides));
+        indices.push_back(0);
+        indices.push_back(1 + i);
+        indices.push_back(1 + (i + 1) % sides);
+      }
+    }
+    range.index_count = static_cast<uint32_t>(indices.size()) - range.first_index;
+    meshes.push_back(range);
+  }
+}
+
+void
+create_pipeline(MeshRenderer& renderer, VkRenderPass render_pass, VkPipelineCache pipeline_cache)
+{
+  VkResult err;
+  VkShaderModule vert = renderer.bindless ? create_shader_module(renderer.device, mesh_bindless_vert_spv, sizeof(mesh_bindless_vert_spv), renderer.allocator)
+                                           : create_shader_module(renderer.device, mesh_vert_spv, sizeof(mesh_vert_spv), renderer.allocator);
+  VkShaderModule frag = create_shader_module(renderer.device, mesh_frag_spv, sizeof(mesh_frag_spv), renderer.allocator);
+
+  VkPipelineShaderStageCreateInfo stages[2] = {};
+  stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+  stages[0].module = vert;
+  stages[0].pName = "main";
+  stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  stages[1].module = frag;
+  stages[1].pName = "main";
+
+  VkVertexInputBindingDescription binding = {};
+  binding.binding = 0;
+  binding.stride = 2 * sizeof(float);
+  binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+  VkVertexInputAttributeDescription attribute = {};
+  attribute.location = 0;
+  attribute.binding = 0;
+  attribute.format = VK_FORMAT_R32G32_SFLOAT;
+  attribute.offset = 0;
+  VkPipelineVertexInputStateCreateInfo vertex_info = {};
+  vertex_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  vertex_info.vertexBindingDescriptionCount = 1;
+  vertex_info.pVertexBindingDescriptions = &binding;
+  vertex_info.vertexAttributeDescriptionCount = 1;
+  vertex_info.pVertexAttributeDescriptions = &attribute;
+
+  VkPipelineInputAssemblyStateCreateInfo ia_info = {};
+  ia_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  ia_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+  VkPipelineViewportStateCreateInfo viewport_info = {};
+  viewport_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  viewport_info.viewportCount = 1;
+  viewport_info.scissorCount = 1;
+
+  VkPipelineRasterizationStateCreateInfo raster_info = {};
+  raster_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  raster_info.polygonMode = VK_POLYGON_MODE_FILL;
+  raster_info.cullMode = VK_CULL_MODE_NONE;
+  raster_info.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+  raster_info.lineWidth = 1.0f;
+
+  VkPipelineMultisampleStateCreateInfo ms_info = {};
+  ms_info.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  ms_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+  VkPipelineColorBlendAttachmentState color_attachment = {};
+  color_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+  VkPipelineColorBlendStateCreateInfo blend_info = {};
+  blend_info.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+  blend_info.attachmentCount = 1;
+  blend_info.pAttachments = &color_attachment;
+
+  VkPipelineDepthStencilStateCreateInfo depth_info = {};
+  depth_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+
+  const VkDynamicState dynamic_states[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+  VkPipelineDynamicStateCreateInfo dynamic_state = {};
+  dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamic_state.dynamicStateCount = IM_ARRAYSIZE(dynamic_states);
+  dynamic_state.pDynamicStates = dynamic_states;
+
+  VkGraphicsPipelineCreateInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  info.stageCount = 2;
+  info.pStages = stages;
+  info.pVertexInputState = &vertex_info;
+  info.pInputAssemblyState = &ia_info;
+  info.pViewportState = &viewport_info;
+  info.pRasterizationState = &raster_info;
+  info.pMultisampleState = &ms_info;
+  info.pDepthStencilState = &depth_info;
+  info.pColorBlendState = &blend_info;
+  info.pDynamicState = &dynamic_state;
+  info.layout = renderer.pipeline_layout;
+  info.renderPass = render_pass;
+  info.subpass = 0;
+  err = vkCreateGraphicsPipelines(renderer.device, pipeline_cache, 1, &info, renderer.allocator, &renderer.pipeline);
+  check_vk_result(err);
+
+  vkDestroyShaderModule(renderer.device, vert, renderer.allocator);
+  vkDestroyShaderModule(renderer.device, frag, renderer.allocator);
+}
+
+void
+create_cull_pipeline(MeshRenderer& renderer, VkPipelineCache pipeline_cache)
+{
+  VkShaderModule comp = VK_NULL_HANDLE;
+  if (renderer.bindless)
+    comp = renderer.subgroup_compaction ? create_shader_module(renderer.device, cull_subgroup_bindless_comp_spv, sizeof(cull_subgroup_bindless_comp_spv), renderer.allocator)
+                                        : create_shader_module(renderer.device, cull_bindless_comp_spv, sizeof(cull_bindless_comp_spv), renderer.allocator);
+  else
+    comp = renderer.subgroup_compaction ? create_shader_module(renderer.device, cull_subgroup_comp_spv, sizeof(cull_subgroup_comp_spv), renderer.allocator)
+                                        : create_shader_module(renderer.device, cull_comp_spv, sizeof(cull_comp_spv), renderer.allocator);
+  VkComputePipelineCreateInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  info.stage.module = comp;
+  info.stage.pName = "main";
+  info.layout = renderer.pipeline_layout;
+  VkResult err = vkCreateComputePipelines(renderer.device, pipeline_cache, 1, &info, renderer.allocator, &renderer.cull_pipeline);
+  check_vk_result(err);
+  vkDestroyShaderModule(renderer.device, comp, renderer.allocator);
+}
+
+void
+push_constants(MeshRenderer& renderer, const MeshFrame& frame, VkCommandBuffer command_buffer, uint32_t width, uint32_t height, uint32_t instance_base)
+{
+  const float extent = static_cast<float>(std::min(width, height));
+  PushConstants constants = {};
+  constants.scale[0] = extent / width;
+  constants.scale[1] = extent / height;
+  constants.time = renderer.time;
+  constants.instance_base = instance_base;
+  constants.camera[0] = renderer.camera[0];
+  constants.camera[1] = renderer.camera[1];
+  constants.zoom = renderer.zoom;
+  constants.instance_count = renderer.instance_count;
+  constants.extent = extent;
+  constants.batch_size = renderer.batch_size;
+  constants.instances_index = renderer.instances_index;
+  constants.visible_index = frame.visible_index;
+  constants.commands_index = frame.commands_index;
+  vkCmdPushConstants(command_buffer, renderer.pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+}
+
+bool
+create_device_buffer(MeshRenderer& renderer, UploadQueue& uploads, const void* data, VkDeviceSize size, VkBufferUsageFlags usage, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access, GpuBuffer& out)
+{
+  if (!gpu_create_buffer(*renderer.gpu, size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, out))
+    return false;
+  upload_buffer(uploads, out.buffer, 0, data, size, dst_stage, dst_access);
+  return true;
+}
+
+} // namespace
+
+bool
+setup_mesh_renderer(MeshRenderer& renderer,
+                    VkPhysicalDevice physical_device,
+                    VkDevice device,
+                    GpuAllocator& gpu,
+                    UploadQueue& uploads,
+                    DescriptorAllocator& descriptors,
+                    BindlessTable* bindless,
+                    VkRenderPass render_pass,
+                    VkPipelineCache pipeline_cache,
+                    uint32_t frames_in_flight,
+                    uint32_t instance_count,
+                    uint32_t batch_count,
+                    VkAllocationCallbacks* allocator)
+{
+  VkResult err;
+  renderer.device = device;
+  renderer.allocator = allocator;
+  renderer.gpu = &gpu;
+  renderer.descriptors = &descriptors;
+  renderer.bindless = bindless;
+  renderer.instance_count = instance_count;
+  renderer.start_time = std::chrono::steady_clock::now();
+
+  // setup_vulkan enables these whenever the device supports them
+  VkPhysicalDeviceFeatures features;
+  vkGetPhysicalDeviceFeatures(physical_device, &features);
+  renderer.multi_draw_indirect = features.multiDrawIndirect;
+  renderer.draw_indirect_first_instance = features.drawIndirectFirstInstance;
+
+  // Ballot compaction needs basic + ballot subgroup operations in compute
+  VkPhysicalDeviceSubgroupProperties subgroup = {};
+  subgroup.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+  VkPhysicalDeviceProperties2 properties = {};
+  properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+  properties.pNext = &subgroup;
+  vkGetPhysicalDeviceProperties2(physical_device, &properties);
+  const VkSubgroupFeatureFlags subgroup_ops = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT;
+  renderer.subgroup_compaction = (subgroup.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) && (subgroup.supportedOperations & subgroup_ops) == subgroup_ops;
+
+  if (!bindless) {
+    // instances, visible indices, draw commands
+    VkDescriptorSetLayoutBinding bindings[3] = {};
+    for (uint32_t i = 0; i < 3; i++) {
+      bindings[i].binding = i;
+      bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      bindings[i].descriptorCount = 1;
+      bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    bindings[0].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+    bindings[1].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+    VkDescriptorSetLayoutCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    info.bindingCount = 3;
+    info.pBindings = bindings;
+    err = vkCreateDescriptorSetLayout(device, &info, allocator, &renderer.set_layout);
+    check_vk_result(err);
+  }
+  {
+    VkPushConstantRange range = {};
+    range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+    range.offset = 0;
+    range.size = sizeof(PushConstants);
+    VkPipelineLayoutCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    info.setLayoutCount = 1;
+    info.pSetLayouts = bindless ? &bindless->layout : &renderer.set_layout;
+    info.pushConstantRangeCount = 1;
+    info.pPushConstantRanges = &range;
+    err = vkCreatePipelineLayout(device, &info, allocator, &renderer.pipeline_layout);
+    check_vk_result(err);
+  }
+  create_pipeline(renderer, render_pass, pipeline_cache);
+  create_cull_pipeline(renderer, pipeline_cache);
+
+  // Geometry
+  std::vector<float> vertices;
+  std::vector<uint32_t> indices;
+  build_meshes(vertices, indices, renderer.meshes);
+
+  // Instances, spread over [-1, 1] at zoom 1
+  const uint32_t capacity = std::max(instance_count, 1u);
+  std::vector<MeshInstance> instances(capacity);
+  {
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const float base_radius = 0.6f / sqrtf(static_cast<float>(capacity));
+    for (MeshInstance& instance : instances) {
+      instance.transform[0] = unit(rng) * 2.0f - 1.0f;
+      instance.transform[1] = unit(rng) * 2.0f - 1.0f;
+      instance.transform[2] = base_radius * (0.5f + unit(rng));
+      instance.transform[3] = (unit(rng) * 2.0f - 1.0f) * 2.0f;
+      instance.color[0] = unit(rng);
+      instance.color[1] = unit(rng);
+      instance.color[2] = unit(rng);
+      instance.color[3] = 1.0f;
+    }
+  }
+
+  // Instances are split into batches that can be drawn independently, each with one command per LOD.
+  // Command c = batch * mesh_lod_count + lod, its instances live in visible[c * batch_size, ...)
+  renderer.batch_size = (capacity + std::max(batch_count, 1u) - 1) / std::max(batch_count, 1u);
+  renderer.batch_size = (renderer.batch_size + batch_alignment - 1) / batch_alignment * batch_alignment;
+  renderer.batch_count = (capacity + renderer.batch_size - 1) / renderer.batch_size;
+  const uint32_t command_count = renderer.batch_count * mesh_lod_count;
+  std::vector<VkDrawIndexedIndirectCommand> draws(command_count);
+  for (uint32_t command = 0; command < command_count; command++) {
+    const uint32_t lod = command % mesh_lod_count;
+    draws[command].indexCount = renderer.meshes[lod].index_count;
+    draws[command].instanceCount = 0;
+    draws[command].firstIndex = renderer.meshes[lod].first_index;
+    draws[command].vertexOffset = renderer.meshes[lod].vertex_offset;
+    draws[command].firstInstance = renderer.draw_indirect_first_instance ? command * renderer.batch_size : 0;
+    renderer.instance_bases.push_back(renderer.draw_indirect_first_instance ? 0 : command * renderer.batch_size);
+  }
+
+  // Static data goes through the upload queue, the first frame acquires it
+  bool ok = true;
+  ok = ok && create_device_buffer(renderer, uploads, vertices.data(), vertices.size() * sizeof(float), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, renderer.vertices);
+  ok = ok && create_device_buffer(renderer, uploads, indices.data(), indices.size() * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT, renderer.indices);
+  ok = ok && create_device_buffer(renderer, uploads, instances.data(), instances.size() * sizeof(MeshInstance), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, renderer.instances);
+  ok = ok && create_device_buffer(renderer, uploads, draws.data(), draws.size() * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, renderer.command_template);
+
+  // Cull output per frame slot, so a frame can cull while the previous one still draws
+  const VkDeviceSize commands_size = command_count * sizeof(VkDrawIndexedIndirectCommand);
+  const VkMemoryPropertyFlags host = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  renderer.frames.resize(frames_in_flight);
+  for (MeshFrame& frame : renderer.frames) {
+    const VkDeviceSize visible_size = static_cast<VkDeviceSize>(command_count) * renderer.batch_size * sizeof(uint32_t);
+    ok = ok && gpu_create_buffer(gpu, visible_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, frame.visible);
+    ok = ok && gpu_create_buffer(gpu, commands_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, frame.commands);
+    ok = ok && gpu_create_buffer(gpu, commands_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, host, VK_MEMORY_PROPERTY_HOST_CACHED_BIT, frame.readback);
+  }
+  if (!ok) {
+    fprintf(stderr, "[mesh] failed to allocate buffers for %u instances\n", instance_count);
+    return false;
+  }
+
+  // Registered once, the shaders find them through the indices in the push constants
+  if (bindless) {
+    renderer.instances_index = bindless_add_buffer(*bindless, renderer.instances.buffer, 0, VK_WHOLE_SIZE);
+    ok = renderer.instances_index != bindless_invalid;
+    for (MeshFrame& frame : renderer.frames) {
+      frame.visible_index = bindless_add_buffer(*bindless, frame.visible.buffer, 0, VK_WHOLE_SIZE);
+      frame.commands_index = bindless_add_buffer(*bindless, frame.commands.buffer, 0, VK_WHOLE_SIZE);
+      frame.descriptor_set = bindless->set;
+      ok = ok && frame.visible_index != bindless_invalid && frame.commands_index != bindless_invalid;
+    }
+    if (!ok) {
+      fprintf(stderr, "[mesh] bindless table is full\n");
+      return false;
+    }
+  }
+
+  printf("[mesh] %u instances in %u batches, %s, %s compaction, %s\n",
+         instance_count,
+         renderer.batch_count,
+         renderer.multi_draw_indirect ? "multi draw indirect" : "one indirect draw per LOD",
+         renderer.subgroup_compaction ? "subgroup ballot" : "atomic",
+         bindless ? "bindless buffers" : "per-frame descriptor sets");
+  return true;
+}
+
+void
+cleanup_mesh_renderer(MeshRenderer& renderer)
+{
+  gpu_destroy_buffer(*renderer.gpu, renderer.vertices);
+  gpu_destroy_buffer(*renderer.gpu, renderer.indices);
+  gpu_destroy_buffer(*renderer.gpu, renderer.instances);
+  gpu_destroy_buffer(*renderer.gpu, renderer.command_template);
+  for (MeshFrame& frame : renderer.frames) {
+    gpu_destroy_buffer(*renderer.gpu, frame.visible);
+    gpu_destroy_buffer(*renderer.gpu, frame.commands);
+    gpu_destroy_buffer(*renderer.gpu, frame.readback);
+  }
+  renderer.frames.clear();
+  vkDestroyPipeline(renderer.device, renderer.pipeline, renderer.allocator);
+  vkDestroyPipeline(renderer.device, renderer.cull_pipeline, renderer.allocator);
+  vkDestroyPipelineLayout(renderer.device, renderer.pipeline_layout, renderer.allocator);
+  vkDestroyDescriptorSetLayout(renderer.device, renderer.set_layout, renderer.allocator);
+  renderer.pipeline = VK_NULL_HANDLE;
+  renderer.cull_pipeline = VK_NULL_HANDLE;
+  renderer.pipeline_layout = VK_NULL_HANDLE;
+  renderer.set_layout = VK_NULL_HANDLE;
+}
+
+void
+mesh_renderer_cull(MeshRenderer& renderer, VkCommandBuffer command_buffer, uint32_t frame_slot, uint32_t width, uint32_t height)
+{
+  if (renderer.instance_count == 0 || width == 0 || height == 0)
+    return;
+  MeshFrame& frame = renderer.frames[frame_slot];
+  const uint32_t command_count = renderer.batch_count * mesh_lod_count;
+  const VkDeviceSize commands_size = command_count * sizeof(VkDrawIndexedIndirectCommand);
+  // Paused: hold the time by moving the start, so resuming continues where it stopped
+  const auto now = std::chrono::steady_clock::now();
+  if (renderer.paused)
+    renderer.start_time = now - std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(renderer.time));
+  else
+    renderer.time = std::chrono::duration<float>(now - renderer.start_time).count();
+
+  // This slot's previous frame has finished, its counts are ready
+  if (frame.readback_pending) {
+    const VkDrawIndexedIndirectCommand* draws = static_cast<const VkDrawIndexedIndirectCommand*>(frame.readback.allocation.mapped);
+    renderer.triangles_per_frame = 0;
+    for (uint32_t lod = 0; lod < mesh_lod_count; lod++)
+      renderer.lod_instances[lod] = 0;
+    for (uint32_t command = 0; command < command_count; command++) {
+      renderer.lod_instances[command % mesh_lod_count] += draws[command].instanceCount;
+      renderer.triangles_per_frame += static_cast<uint64_t>(draws[command].instanceCount) * (draws[command].indexCount / 3);
+    }
+    renderer.frames_drawn++;
+    renderer.triangles_drawn += renderer.triangles_per_frame;
+  }
+
+  // Reset instance counts
+  VkBufferCopy region = { 0, 0, commands_size };
+  vkCmdCopyBuffer(command_buffer, renderer.command_template.buffer, frame.commands.buffer, 1, &region);
+  {
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = frame.commands.buffer;
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 1, &barrier, 0, NULL);
+  }
+
+  // One transient set per frame, dropped with the slot's descriptor pools; the bindless table needs no per-frame writes
+  if (!renderer.bindless) {
+    frame.descriptor_set = descriptor_allocator_allocate(*renderer.descriptors, frame_slot, renderer.set_layout);
+    const VkDescriptorBufferInfo buffer_info[3] = {
+      { renderer.instances.buffer, 0, VK_WHOLE_SIZE },
+      { frame.visible.buffer, 0, VK_WHOLE_SIZE },
+      { frame.commands.buffer, 0, VK_WHOLE_SIZE },
+    };
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = frame.descriptor_set;
+    write.dstBinding = 0;
+    write.descriptorCount = 3;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pBufferInfo = buffer_info;
+    vkUpdateDescriptorSets(renderer.device, 1, &write, 0, NULL);
+  }
+
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, renderer.cull_pipeline);
+  vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, renderer.pipeline_layout, 0, 1, &frame.descriptor_set, 0, NULL);
+  push_constants(renderer, frame, command_buffer, width, height, 0);
+  vkCmdDispatch(command_buffer, (renderer.instance_count + cull_group_size - 1) / cull_group_size, 1, 1);
+
+  // Cull output feeds the indirect draw, the vertex shader and the readback
+  {
+    VkBufferMemoryBarrier barriers[2] = {};
+    for (VkBufferMemoryBarrier& barrier : barriers) {
+      barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+      barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+      barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      barrier.size = VK_WHOLE_SIZE;
+    }
+    barriers[0].dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+    barriers[0].buffer = frame.commands.buffer;
+    barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barriers[1].buffer = frame.visible.buffer;
+    vkCmdPipelineBarrier(command_buffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0,
+                         0,
+                         NULL,
+                         2,
+                         barriers,
+                         0,
+                         NULL);
+  }
+  vkCmdCopyBuffer(command_buffer, frame.commands.buffer, frame.readback.buffer, 1, &region);
+  {
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = frame.readback.buffer;
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, NULL, 1, &barrier, 0, NULL);
+  }
+  frame.readback_pending = true;
+}
+
+void
+mesh_renderer_draw(MeshRenderer& renderer, VkCommandBuffer command_buffer, uint32_t frame_slot, uint32_t width, uint32_t height, uint32_t first_batch, uint32_t batch_count)
+{
+  if (renderer.instance_count == 0 || width == 0 || height == 0 || batch_count == 0)
+    return;
+  MeshFrame& frame = renderer.frames[frame_slot];
+
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, renderer.pipeline);
+  vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, renderer.pipeline_layout, 0, 1, &frame.descriptor_set, 0, NULL);
+  const VkDeviceSize vertex_offset = 0;
+  vkCmdBindVertexBuffers(command_buffer, 0, 1, &renderer.vertices.buffer, &vertex_offset);
+  vkCmdBindIndexBuffer(command_buffer, renderer.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+  VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(width), static_cast<float>(height), 0.0f, 1.0f };
+  VkRect2D scissor = { { 0, 0 }, { width, height } };
+  vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+  vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+  // The batches' commands are contiguous
+  const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+  const uint32_t first_command = first_batch * mesh_lod_count;
+  const uint32_t command_count = batch_count * mesh_lod_count;
+  if (renderer.draw_indirect_first_instance) {
+    push_constants(renderer, frame, command_buffer, width, height, 0);
+    if (renderer.multi_draw_indirect)
+      vkCmdDrawIndexedIndirect(command_buffer, frame.commands.buffer, first_command * stride, command_count, stride);
+    else
+      for (uint32_t command = first_command; command < first_command + command_count; command++)
+        vkCmdDrawIndexedIndirect(command_buffer, frame.commands.buffer, command * stride, 1, stride);
+  } else {
+    // firstInstance must be 0 in the commands, the command's region goes through push constants
+    for (uint32_t command = first_command; command < first_command + command_count; command++) {
+      push_constants(renderer, frame, command_buffer, width, height, renderer.instance_bases[command]);
+      vkCmdDrawIndexedIndirect(command_buffer, frame.commands.buffer, command * stride, 1, stride);
+    }
+  }
+}
+
+bool
+mesh_renderer_animating(const MeshRenderer& renderer)
+{
+  return renderer.instance_count > 0 && !renderer.paused;
+}
+
+void
+mesh_renderer_draw_stats(MeshRenderer& renderer, bool* open)
+{
+  if (!ImGui::Begin("Meshes", open)) {
+    ImGui::End();
+    return;
+  }
+  const float framerate = ImGui::GetIO().Framerate;
+  uint32_t visible = 0;
+  for (uint32_t lod = 0; lod < mesh_lod_count; lod++)
+    visible += renderer.lod_instances[lod];
+  ImGui::Text("%u instances in %u batches, %u visible", renderer.instance_count, renderer.batch_count, visible);
+  for (uint32_t lod = 0; lod < mesh_lod_count; lod++)
+    ImGui::Text("  LOD %u (%u triangles): %u", lod, renderer.meshes[lod].index_count / 3, renderer.lod_instances[lod]);
+  ImGui::Text("%.2f M triangles/frame", renderer.triangles_per_frame / 1e6);
+  ImGui::Text("%.1f M triangles/s", renderer.triangles_per_frame * framerate / 1e6);
+  ImGui::Text("%s, %s, %s compaction",
+              renderer.multi_draw_indirect ? "multiDrawIndirect" : "no multiDrawIndirect",
+              renderer.draw_indirect_first_instance ? "drawIndirectFirstInstance" : "no drawIndirectFirstInstance",
+              renderer.subgroup_compaction ? "subgroup ballot" : "atomic");
+  ImGui::Checkbox("pause animation", &renderer.paused);
+  ImGui::SliderFloat("zoom", &renderer.zoom, 0.5f, 64.0f, "%.1f", ImGuiSliderFlags_Logarithmic);
+  ImGui::SliderFloat2("camera", renderer.camera, -1.0f, 1.0f);
+  ImGui::End();
+}
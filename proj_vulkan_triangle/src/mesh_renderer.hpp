@@ -0,0 +1,124 @@
+#pragma once
+
+#include "descriptors.hpp"
+#include "gpu_allocator.hpp"
+#include "upload_queue.hpp"
+#include <vulkan/vulkan.h>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// GPU-driven instanced mesh rendering.
+// All meshes share one vertex and one index buffer and all instances live in one storage buffer,
+// split into fixed-size batches. Every frame a compute pass (mesh_renderer_cull) frustum-culls the
+// instances, picks a LOD from their size on screen and compacts the survivors into per-(batch, LOD)
+// index lists, writing the instance counts of one VkDrawIndexedIndirectCommand each. Drawing a range
+// of batches is then a single vkCmdDrawIndexedIndirect (one per command without multiDrawIndirect),
+// so CPU cost does not depend on the instance count, and ranges can be recorded on separate threads.
+// With a BindlessTable the storage buffers are registered once and indexed through push constants;
+// otherwise each frame binds them with a transient set from the DescriptorAllocator.
+
+constexpr uint32_t mesh_lod_count = 5;
+
+struct MeshRange
+{
+  uint32_t first_index = 0;
+  uint32_t index_count = 0;
+  int32_t vertex_offset = 0;
+};
+
+// Matches Instance in shaders/mesh.glsl and shaders/cull.glsl
+struct MeshInstance
+{
+  float transform[4]; // xy position, z bounding radius, w angular velocity
+  float color[4];
+};
+
+// Written by the cull pass, owned by one frame slot
+struct MeshFrame
+{
+  GpuBuffer visible;  // instance indices, one region of batch_size per command
+  GpuBuffer commands; // one VkDrawIndexedIndirectCommand per (batch, LOD)
+  GpuBuffer readback; // host copy of commands, read when the slot comes around again
+  VkDescriptorSet descriptor_set = VK_NULL_HANDLE; // transient, allocated by mesh_renderer_cull (the table's set when bindless)
+  uint32_t visible_index = bindless_invalid;
+  uint32_t commands_index = bindless_invalid;
+  bool readback_pending = false;
+};
+
+struct MeshRenderer
+{
+  VkDevice device = VK_NULL_HANDLE;
+  VkAllocationCallbacks* allocator = nullptr;
+  GpuAllocator* gpu = nullptr;
+  DescriptorAllocator* descriptors = nullptr;
+  BindlessTable* bindless = nullptr; // null without descriptor indexing
+
+  VkDescriptorSetLayout set_layout = VK_NULL_HANDLE; // the transient set's, unused when bindless
+  VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  VkPipeline cull_pipeline = VK_NULL_HANDLE;
+
+  GpuBuffer vertices;
+  GpuBuffer indices;
+  GpuBuffer instances;
+  uint32_t instances_index = bindless_invalid;
+  GpuBuffer command_template; // per-LOD commands with zero instances, copied over commands before culling
+  std::vector<MeshFrame> frames;
+
+  std::vector<MeshRange> meshes; // indexed by LOD, most detailed first
+  std::vector<uint32_t> instance_bases; // first instance of each draw, pushed per draw without drawIndirectFirstInstance
+  bool multi_draw_indirect = false;
+  bool draw_indirect_first_instance = false;
+  bool subgroup_compaction = false;
+
+  float camera[2] = { 0.0f, 0.0f };
+  float zoom = 1.0f;
+
+  uint32_t instance_count = 0;
+  uint32_t batch_count = 0;
+  uint32_t batch_size = 0;
+  float time = 0.0f; // animation time of the frame being recorded
+  bool paused = false; // time stops advancing, see mesh_renderer_animating
+  uint32_t lod_instances[mesh_lod_count] = {}; // visible per LOD, from the last read back frame
+  uint64_t triangles_per_frame = 0;            // from the last read back frame
+  uint64_t frames_drawn = 0;
+  uint64_t triangles_drawn = 0;
+  std::chrono::steady_clock::time_point start_time;
+};
+
+bool
+setup_mesh_renderer(MeshRenderer& renderer,
+                    VkPhysicalDevice physical_device,
+                    VkDevice device,
+                    GpuAllocator& gpu,
+                    UploadQueue& uploads,
+                    DescriptorAllocator& descriptors,
+                    BindlessTable* bindless,
+                    VkRenderPass render_pass,
+                    VkPipelineCache pipeline_cache,
+                    uint32_t frames_in_flight,
+                    uint32_t instance_count,
+                    uint32_t batch_count,
+                    VkAllocationCallbacks* allocator);
+
+void
+cleanup_mesh_renderer(MeshRenderer& renderer);
+
+// Records the cull pass, outside the render pass. The slot's previous frame must have completed
+// and its descriptor pools must have been reset.
+void
+mesh_renderer_cull(MeshRenderer& renderer, VkCommandBuffer command_buffer, uint32_t frame_slot, uint32_t width, uint32_t height);
+
+// Records the draws of batches [first_batch, first_batch + batch_count), inside a render pass compatible
+// with the one passed at setup. Safe to call from several threads with different command buffers.
+void
+mesh_renderer_draw(MeshRenderer& renderer, VkCommandBuffer command_buffer, uint32_t frame_slot, uint32_t width, uint32_t height, uint32_t first_batch, uint32_t batch_count);
+
+// Whether consecutive frames differ without any input: on-demand redraw keeps rendering while true.
+bool
+mesh_renderer_animating(const MeshRenderer& renderer);
+
+void
+mesh_renderer_draw_stats(MeshRenderer& renderer, bool* open);
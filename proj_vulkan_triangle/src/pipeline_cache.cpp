@@ -0,0 +1,174 @@
+#include "pipeline_cache.hpp"
+
+#include "vulkan_utils.hpp"
+
+#include <filesystem>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t pipeline_cache_magic = 0x43505456; // "VTPC"
+constexpr uint32_t pipeline_cache_version = 1;
+
+struct PipelineCacheFileHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t data_size;
+  uint64_t data_hash;
+  float cold_create_ms;
+  uint32_t reserved;
+};
+
+uint64_t
+fnv1a(const uint8_t* data, size_t size)
+{
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= data[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+bool
+read_file(const std::string& path, std::vector<uint8_t>& data)
+{
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f)
+    return false;
+  fseek(f, 0, SEEK_END);
+  const long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  if (size <= 0) {
+    fclose(f);
+    return false;
+  }
+  data.resize(static_cast<size_t>(size));
+  const size_t read = fread(data.data(), 1, data.size(), f);
+  fclose(f);
+  return read == data.size();
+}
+
+// Checks the VkPipelineCacheHeaderVersionOne at the start of the driver blob
+bool
+is_compatible(VkPhysicalDevice physical_device, const uint8_t* blob, size_t size)
+{
+  // uint32 headerSize, uint32 headerVersion, uint32 vendorID, uint32 deviceID, uint8 uuid[VK_UUID_SIZE]
+  if (size < 16 + VK_UUID_SIZE)
+    return false;
+  uint32_t header_size, header_version, vendor_id, device_id;
+  memcpy(&header_size, blob + 0, 4);
+  memcpy(&header_version, blob + 4, 4);
+  memcpy(&vendor_id, blob + 8, 4);
+  memcpy(&device_id, blob + 12, 4);
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physical_device, &properties);
+  if (header_size < 16 + VK_UUID_SIZE || header_size > size)
+    return false;
+  if (header_version != VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+    return false;
+  if (vendor_id != properties.vendorID || device_id != properties.deviceID)
+    return false;
+  return memcmp(blob + 16, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+} // namespace
+
+PipelineCacheInfo
+setup_pipeline_cache(VkPhysicalDevice physical_device, VkDevice device, const std::string& path, VkAllocationCallbacks* allocator, VkPipelineCache& pipeline_cache)
+{
+  PipelineCacheInfo result;
+
+  std::vector<uint8_t> file;
+  const uint8_t* blob = nullptr;
+  size_t blob_size = 0;
+  if (!path.empty() && read_file(path, file)) {
+    PipelineCacheFileHeader header;
+    const char* reason = nullptr;
+    if (file.size() < sizeof(header))
+      reason = "truncated";
+    else {
+      memcpy(&header, file.data(), sizeof(header));
+      const uint8_t* data = file.data() + sizeof(header);
+      if (header.magic != pipeline_cache_magic || header.version != pipeline_cache_version)
+        reason = "unknown format";
+      else if (header.data_size != file.size() - sizeof(header) || header.data_hash != fnv1a(data, header.data_size))
+        reason = "corrupt";
+      else if (!is_compatible(physical_device, data, header.data_size))
+        reason = "different device or driver";
+      else {
+        blob = data;
+        blob_size = header.data_size;
+        result.cold_create_ms = header.cold_create_ms;
+      }
+    }
+    if (reason)
+      printf("[vulkan] Discarding pipeline cache %s: %s\n", path.c_str(), reason);
+  }
+
+  VkPipelineCacheCreateInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  info.initialDataSize = blob_size;
+  info.pInitialData = blob;
+  VkResult err = vkCreatePipelineCache(device, &info, allocator, &pipeline_cache);
+  if (err != VK_SUCCESS && blob) {
+    // The driver may still reject data that passed our checks, start cold instead
+    printf("[vulkan] Pipeline cache rejected by driver, starting empty\n");
+    info.initialDataSize = 0;
+    info.pInitialData = nullptr;
+    blob_size = 0;
+    err = vkCreatePipelineCache(device, &info, allocator, &pipeline_cache);
+  }
+  check_vk_result(err);
+
+  result.warm = blob_size > 0;
+  result.loaded_bytes = blob_size;
+  return result;
+}
+
+bool
+save_pipeline_cache(VkDevice device, VkPipelineCache pipeline_cache, const std::string& path, float cold_create_ms)
+{
+  if (path.empty() || pipeline_cache == VK_NULL_HANDLE)
+    return false;
+
+  size_t size = 0;
+  VkResult err = vkGetPipelineCacheData(device, pipeline_cache, &size, nullptr);
+  check_vk_result(err);
+  std::vector<uint8_t> data(sizeof(PipelineCacheFileHeader) + size);
+  err = vkGetPipelineCacheData(device, pipeline_cache, &size, data.data() + sizeof(PipelineCacheFileHeader));
+  check_vk_result(err);
+  data.resize(sizeof(PipelineCacheFileHeader) + size);
+
+  PipelineCacheFileHeader header = {};
+  header.magic = pipeline_cache_magic;
+  header.version = pipeline_cache_version;
+  header.data_size = size;
+  header.data_hash = fnv1a(data.data() + sizeof(header), size);
+  header.cold_create_ms = cold_create_ms;
+  memcpy(data.data(), &header, sizeof(header));
+
+  const std::string tmp_path = path + ".tmp";
+  FILE* f = fopen(tmp_path.c_str(), "wb");
+  if (!f) {
+    fprintf(stderr, "[vulkan] Failed to write pipeline cache %s\n", tmp_path.c_str());
+    return false;
+  }
+  const bool written = fwrite(data.data(), 1, data.size(), f) == data.size();
+  const bool closed = fclose(f) == 0;
+  std::error_code ec;
+  if (written && closed)
+    std::filesystem::rename(tmp_path, path, ec);
+  if (!written || !closed || ec) {
+    fprintf(stderr, "[vulkan] Failed to write pipeline cache %s\n", path.c_str());
+    std::filesystem::remove(tmp_path, ec);
+    return false;
+  }
+
+  printf("[vulkan] Saved pipeline cache %s (%zu bytes)\n", path.c_str(), size);
+  return true;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+
+// On-disk VkPipelineCache.
+// The file is a small header (magic, size, hash, cold-start pipeline time) followed by the driver blob.
+// The blob's own header (vendorID, deviceID, pipelineCacheUUID) is checked against the current device,
+// anything stale or corrupt is discarded and the cache starts empty.
+struct PipelineCacheInfo
+{
+  bool warm = false; // valid data was loaded
+  size_t loaded_bytes = 0;
+  float cold_create_ms = 0.0f; // pipeline creation time recorded when the cache was last built from scratch
+};
+
+PipelineCacheInfo
+setup_pipeline_cache(VkPhysicalDevice physical_device, VkDevice device, const std::string& path, VkAllocationCallbacks* allocator, VkPipelineCache& pipeline_cache);
+
+// Written to a temporary file then renamed over path, so a crash never leaves a half-written cache.
+bool
+save_pipeline_cache(VkDevice device, VkPipelineCache pipeline_cache, const std::string& path, float cold_create_ms);
@@ -0,0 +1,135 @@
+#include "redraw.hpp"
+
+#include <algorithm>
+#include <string.h> // memcpy
+
+namespace {
+
+// Upper bound for a single wait, keeps the loop responsive to --frames and the keep-alive toggle
+constexpr int max_wait_ms = 250;
+// An active text field blinks its cursor
+constexpr int text_input_wait_ms = 100;
+
+uint64_t
+hash_bytes(uint64_t h, const void* data, size_t size)
+{
+  // Word at a time multiply-xorshift: draw lists are megabytes, a byte-wise hash would show up in the frame
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  while (size >= 8) {
+    uint64_t word;
+    memcpy(&word, bytes, 8);
+    h = (h ^ word) * 0x9E3779B97F4A7C15ull;
+    h ^= h >> 32;
+    bytes += 8;
+    size -= 8;
+  }
+  uint64_t tail = size;
+  memcpy(&tail, bytes, size);
+  h = (h ^ tail) * 0x9E3779B97F4A7C15ull;
+  return h ^ (h >> 29);
+}
+
+} // namespace
+
+uint64_t
+hash_draw_list(const ImDrawList* list)
+{
+  uint64_t h = 0xCBF29CE484222325ull;
+  h = hash_bytes(h, list->VtxBuffer.Data, list->VtxBuffer.Size * sizeof(ImDrawVert));
+  h = hash_bytes(h, list->IdxBuffer.Data, list->IdxBuffer.Size * sizeof(ImDrawIdx));
+  for (const ImDrawCmd& cmd : list->CmdBuffer) {
+    h = hash_bytes(h, &cmd.ClipRect, sizeof(cmd.ClipRect));
+    h = hash_bytes(h, &cmd.TextureId, sizeof(cmd.TextureId));
+    const uint32_t offsets[3] = { cmd.VtxOffset, cmd.IdxOffset, cmd.ElemCount };
+    h = hash_bytes(h, offsets, sizeof(offsets));
+    h = hash_bytes(h, &cmd.UserCallback, sizeof(cmd.UserCallback));
+  }
+  return h;
+}
+
+uint64_t
+hash_draw_data(const ImDrawData* draw_data)
+{
+  uint64_t h = 0xCBF29CE484222325ull;
+  if (draw_data == nullptr || !draw_data->Valid)
+    return h;
+  const float frame[6] = { draw_data->DisplayPos.x, draw_data->DisplayPos.y, draw_data->DisplaySize.x, draw_data->DisplaySize.y, draw_data->FramebufferScale.x, draw_data->FramebufferScale.y };
+  h = hash_bytes(h, frame, sizeof(frame));
+  for (int i = 0; i < draw_data->CmdListsCount; i++) {
+    const uint64_t list = hash_draw_list(draw_data->CmdLists[i]);
+    h = hash_bytes(h, &list, sizeof(list));
+  }
+  return h;
+}
+
+void
+redraw_mark_dirty(RedrawState& redraw, bool force_render)
+{
+  redraw.pending = std::max(redraw.pending, redraw.settle_frames);
+  redraw.force = redraw.force || force_render;
+}
+
+int
+redraw_wait_timeout_ms(const RedrawState& redraw)
+{
+  if (!redraw.on_demand || redraw.animating || redraw.pending > 0 || redraw.force)
+    return -1;
+  int timeout_ms = ImGui::GetIO().WantTextInput ? text_input_wait_ms : max_wait_ms;
+  if (redraw.keep_alive_s > 0.0f) {
+    const auto due = redraw.last_render + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(redraw.keep_alive_s));
+    const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(due - std::chrono::steady_clock::now()).count();
+    timeout_ms = std::clamp(static_cast<int>(remaining), 0, timeout_ms);
+  }
+  return timeout_ms;
+}
+
+bool
+redraw_should_render(RedrawState& redraw)
+{
+  const auto now = std::chrono::steady_clock::now();
+  if (!redraw.on_demand) {
+    redraw.rendered = true;
+    redraw.last_render = now;
+    redraw.frames_rendered++;
+    return true;
+  }
+
+  // Every viewport: a change in a platform window needs a frame as much as one in the main window
+  uint64_t hash = 0xCBF29CE484222325ull;
+  const ImGuiPlatformIO& platform_io = ImGui::GetPlatformIO();
+  for (int i = 0; i < platform_io.Viewports.Size; i++) {
+    const uint64_t viewport = hash_draw_data(platform_io.Viewports[i]->DrawData);
+    hash = (hash ^ viewport) * 0x100000001B3ull;
+  }
+  const bool changed = hash != redraw.last_hash;
+  redraw.last_hash = hash;
+
+  const bool keep_alive = redraw.keep_alive_s > 0.0f && std::chrono::duration<float>(now - redraw.last_render).count() >= redraw.keep_alive_s;
+  redraw.rendered = redraw.force || redraw.animating || changed || keep_alive;
+  // Something moved: look at the next frame too before blocking
+  if (changed)
+    redraw.pending = std::max(redraw.pending, 1u);
+  else if (redraw.pending > 0)
+    redraw.pending--;
+  redraw.force = false;
+
+  if (redraw.rendered) {
+    redraw.last_render = now;
+    redraw.frames_rendered++;
+  } else
+    redraw.frames_skipped++;
+  return redraw.rendered;
+}
+
+void
+redraw_draw_settings(RedrawState& redraw, bool* open)
+{
+  if (!ImGui::Begin("Redraw", open)) {
+    ImGui::End();
+    return;
+  }
+  ImGui::Checkbox("on demand", &redraw.on_demand);
+  ImGui::SliderFloat("keep alive", &redraw.keep_alive_s, 0.0f, 10.0f, redraw.keep_alive_s > 0.0f ? "%.1f s" : "off");
+  // No counters here: text that changes every frame would keep the window dirty
+  ImGui::End();
+}
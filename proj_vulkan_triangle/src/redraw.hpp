@@ -0,0 +1,52 @@
+#pragma once
+
+#include "imgui.h"
+
+#include <chrono>
+#include <cstdint>
+
+// On-demand redraw.
+// In on-demand mode the main loop blocks on the event queue while nothing changes. Every ImGui frame
+// is still built after an event (or keep-alive), but only rendered and presented when the draw data
+// of any viewport hashes differently from the last rendered frame, so hover effects, animations and
+// plots are picked up without tracking them individually. Idle therefore costs one wakeup per
+// timeout and no GPU work. Content that changes outside ImGui (the animated mesh scene) sets
+// animating, which renders every frame like continuous mode.
+
+struct RedrawState
+{
+  bool on_demand = false;
+  float keep_alive_s = 0.0f;  // render at least this often while idle (0 = only on change)
+  uint32_t settle_frames = 2; // frames built after an event, layout changes can take a frame to show
+  uint32_t pending = 1;       // frames to build before blocking again
+  bool force = true;          // render the next frame even if unchanged (expose, resize)
+  bool animating = false;     // set by the caller every frame while the scene animates
+  uint64_t last_hash = 0;
+  std::chrono::steady_clock::time_point last_render;
+
+  // stats
+  uint64_t frames_rendered = 0;
+  uint64_t frames_skipped = 0;
+  bool rendered = true; // last frame
+};
+
+uint64_t
+hash_draw_list(const ImDrawList* list);
+
+uint64_t
+hash_draw_data(const ImDrawData* draw_data);
+
+// Input arrived; force_render for events that invalidate the window contents.
+void
+redraw_mark_dirty(RedrawState& redraw, bool force_render);
+
+// How long the event wait may block, -1 when the next frame must be built right away.
+int
+redraw_wait_timeout_ms(const RedrawState& redraw);
+
+// Call after ImGui::Render(). Returns whether this frame has to be rendered and presented.
+bool
+redraw_should_render(RedrawState& redraw);
+
+void
+redraw_draw_settings(RedrawState& redraw, bool* open);
@@ -0,0 +1,101 @@
+#include "render_thread.hpp"
+
+#include <string.h> // memcpy
+
+namespace {
+
+constexpr uint32_t fresh_bit = 4;
+constexpr uint32_t slot_mask = 3;
+
+// Keeps dst's capacity, unlike ImVector's assignment
+template<typename T>
+void
+copy_vector(ImVector<T>& dst, const ImVector<T>& src)
+{
+  dst.resize(src.Size);
+  if (src.Size > 0)
+    memcpy(dst.Data, src.Data, src.size_in_bytes());
+}
+
+void
+render_loop(RenderThread& rt, const std::function<void(DrawSnapshot&)>& render)
+{
+  uint64_t seen = 0;
+  for (;;) {
+    rt.published.wait(seen, std::memory_order_acquire);
+    seen = rt.published.load(std::memory_order_acquire);
+    if (rt.stop.load(std::memory_order_acquire))
+      return;
+    if ((rt.middle.load(std::memory_order_acquire) & fresh_bit) == 0)
+      continue;
+    rt.front = rt.middle.exchange(rt.front, std::memory_order_acq_rel) & slot_mask;
+    render(rt.slots[rt.front]);
+    rt.frames_rendered.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+} // namespace
+
+void
+start_render_thread(RenderThread& rt, std::function<void(DrawSnapshot&)> render)
+{
+  rt.stop.store(false);
+  rt.thread = std::thread([&rt, render = std::move(render)] { render_loop(rt, render); });
+}
+
+void
+stop_render_thread(RenderThread& rt)
+{
+  if (!rt.thread.joinable())
+    return;
+  rt.stop.store(true, std::memory_order_release);
+  rt.published.fetch_add(1, std::memory_order_release);
+  rt.published.notify_one();
+  rt.thread.join();
+}
+
+void
+cleanup_render_thread(RenderThread& rt)
+{
+  stop_render_thread(rt);
+  for (DrawSnapshot& snapshot : rt.slots) {
+    for (ImDrawList* list : snapshot.lists)
+      IM_DELETE(list);
+    snapshot.lists.clear();
+    snapshot.draw_data = ImDrawData();
+  }
+}
+
+DrawSnapshot&
+render_thread_back(RenderThread& rt)
+{
+  return rt.slots[rt.back];
+}
+
+void
+render_thread_publish(RenderThread& rt)
+{
+  const uint32_t previous = rt.middle.exchange(rt.back | fresh_bit, std::memory_order_acq_rel);
+  if (previous & fresh_bit)
+    rt.frames_dropped.fetch_add(1, std::memory_order_relaxed);
+  rt.back = previous & slot_mask;
+  rt.published.fetch_add(1, std::memory_order_release);
+  rt.published.notify_one();
+}
+
+void
+draw_snapshot_copy(DrawSnapshot& snapshot, const ImDrawData* draw_data)
+{
+  while (snapshot.lists.size() < static_cast<size_t>(draw_data->CmdListsCount))
+    snapshot.lists.push_back(IM_NEW(ImDrawList)(ImGui::GetDrawListSharedData()));
+  for (int i = 0; i < draw_data->CmdListsCount; i++) {
+    const ImDrawList* src = draw_data->CmdLists[i];
+    ImDrawList* dst = snapshot.lists[i];
+    copy_vector(dst->CmdBuffer, src->CmdBuffer);
+    copy_vector(dst->IdxBuffer, src->IdxBuffer);
+    copy_vector(dst->VtxBuffer, src->VtxBuffer);
+    dst->Flags = src->Flags;
+  }
+  snapshot.draw_data = *draw_data;
+  snapshot.draw_data.CmdLists = snapshot.lists.data();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "imgui.h"
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Render/submit thread decoupled from the UI thread.
+//
+// The UI thread builds a frame, deep copies its ImDrawData into the back slot of a triple buffer and
+// publishes it; the render thread renders whichever slot was published last. Neither side ever
+// waits for the other: publishing swaps the back slot with the shared middle one, taking the latest
+// swaps the front slot with it, a single atomic exchange each. A frame published before the render
+// thread got to the previous one replaces it (counted as dropped), so GPU back-pressure slows down
+// rendering but never input handling or UI building.
+//
+// Snapshots own their ImDrawLists and keep the buffers' capacity, a steady UI copies without allocating.
+
+struct DrawSnapshot
+{
+  ImDrawData draw_data;           // CmdLists points into lists
+  std::vector<ImDrawList*> lists; // owned, at least draw_data.CmdListsCount
+  uint64_t frame = 0;             // UI frame that built it
+  uint32_t width = 0;             // window size when it was built, the swapchain follows it
+  uint32_t height = 0;
+  VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
+  VkClearValue clear_value = {};
+};
+
+struct RenderThread
+{
+  std::array<DrawSnapshot, 3> slots;
+  std::atomic<uint32_t> middle{ 1 }; // slot index | fresh_bit while not taken yet
+  uint32_t back = 0;                 // UI thread
+  uint32_t front = 2;                // render thread
+
+  std::atomic<uint64_t> published{ 0 }; // waited on by an idle render thread
+  std::atomic<bool> stop{ false };
+  std::thread thread;
+
+  std::atomic<uint64_t> frames_rendered{ 0 };
+  std::atomic<uint64_t> frames_dropped{ 0 };
+};
+
+// Starts the thread, render is called on it for every snapshot taken.
+void
+start_render_thread(RenderThread& rt, std::function<void(DrawSnapshot&)> render);
+
+// Renders nothing more, returns once the current frame is done and the thread has exited.
+void
+stop_render_thread(RenderThread& rt);
+
+void
+cleanup_render_thread(RenderThread& rt);
+
+// The UI thread's slot, fill it with draw_snapshot_copy and the frame's parameters, then publish.
+DrawSnapshot&
+render_thread_back(RenderThread& rt);
+
+void
+render_thread_publish(RenderThread& rt);
+
+// Deep copies draw_data, reusing the snapshot's lists and buffers.
+void
+draw_snapshot_copy(DrawSnapshot& snapshot, const ImDrawData* draw_data);
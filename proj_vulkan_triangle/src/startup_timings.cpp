@@ -0,0 +1,101 @@
+#include "startup_timings.hpp"
+
+#include <algorithm>
+#include <stdio.h> // printf, fprintf
+
+namespace {
+
+uint32_t
+thread_number(StartupTimings& st, std::thread::id id)
+{
+  if (id == st.main_thread)
+    return 0;
+  const auto it = std::find(st.threads.begin(), st.threads.end(), id);
+  if (it != st.threads.end())
+    return static_cast<uint32_t>(it - st.threads.begin()) + 1;
+  st.threads.push_back(id);
+  return static_cast<uint32_t>(st.threads.size());
+}
+
+} // namespace
+
+void
+setup_startup_timings(StartupTimings& st)
+{
+  st.epoch = std::chrono::steady_clock::now();
+  st.main_thread = std::this_thread::get_id();
+  st.phases.reserve(32);
+}
+
+double
+startup_timings_now_ms(const StartupTimings& st)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - st.epoch).count();
+}
+
+void
+startup_timings_add(StartupTimings& st, const char* name, double begin_ms, double end_ms)
+{
+  std::lock_guard<std::mutex> lock(st.mutex);
+  StartupPhase phase;
+  phase.name = name;
+  phase.thread = thread_number(st, std::this_thread::get_id());
+  phase.begin_ms = begin_ms;
+  phase.duration_ms = end_ms - begin_ms;
+  st.phases.push_back(phase);
+}
+
+StartupTimingScope::StartupTimingScope(StartupTimings& st, const char* name)
+  : st(st)
+  , name(name)
+  , begin_ms(startup_timings_now_ms(st))
+{
+}
+
+StartupTimingScope::~StartupTimingScope()
+{
+  startup_timings_add(st, name, begin_ms, startup_timings_now_ms(st));
+}
+
+void
+startup_timings_first_frame(StartupTimings& st)
+{
+  if (st.first_frame_ms > 0.0)
+    return;
+  st.first_frame_ms = startup_timings_now_ms(st);
+
+  std::lock_guard<std::mutex> lock(st.mutex);
+  std::sort(st.phases.begin(), st.phases.end(), [](const StartupPhase& a, const StartupPhase& b) { return a.begin_ms < b.begin_ms; });
+  double worker_ms = 0.0;
+  printf("[startup] %-24s %6s %10s %10s\n", "phase", "thread", "begin ms", "ms");
+  for (const StartupPhase& phase : st.phases) {
+    printf("[startup] %-24s %6u %10.2f %10.2f\n", phase.name, phase.thread, phase.begin_ms, phase.duration_ms);
+    if (phase.thread != 0)
+      worker_ms += phase.duration_ms;
+  }
+  printf("[startup] first frame submitted at %.2f ms, %.2f ms of it ran on worker threads\n", st.first_frame_ms, worker_ms);
+}
+
+bool
+startup_timings_export_trace(StartupTimings& st, const char* path)
+{
+  FILE* f = fopen(path, "wb");
+  if (!f) {
+    fprintf(stderr, "[startup] failed to open %s\n", path);
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(st.mutex);
+  fprintf(f, "{\"traceEvents\":[");
+  fprintf(f, "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"main\"}}");
+  for (uint32_t i = 1; i <= st.threads.size(); i++)
+    fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"worker %u\"}}", i, i);
+  for (const StartupPhase& phase : st.phases)
+    fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", phase.name, phase.thread, phase.begin_ms * 1000.0, phase.duration_ms * 1000.0);
+  if (st.first_frame_ms > 0.0)
+    fprintf(f, ",\n{\"name\":\"first_frame\",\"ph\":\"i\",\"s\":\"g\",\"pid\":0,\"tid\":0,\"ts\":%.3f}", st.first_frame_ms * 1000.0);
+  fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+  fclose(f);
+
+  printf("[startup] wrote %s\n", path);
+  return true;
+}
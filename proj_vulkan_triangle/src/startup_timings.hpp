@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Startup phases, timed on whichever thread ran them.
+// Printed once the first frame has been submitted, with how much of the work overlapped;
+// --startup-trace also writes them as a Chrome trace.
+
+struct StartupPhase
+{
+  const char* name = nullptr;
+  uint32_t thread = 0; // 0 is the thread that called setup_startup_timings
+  double begin_ms = 0.0;
+  double duration_ms = 0.0;
+};
+
+struct StartupTimings
+{
+  std::chrono::steady_clock::time_point epoch;
+  std::thread::id main_thread;
+  std::mutex mutex;
+  std::vector<std::thread::id> threads; // index + 1 of a worker is its thread number
+  std::vector<StartupPhase> phases;
+  double first_frame_ms = 0.0; // 0 until startup_timings_first_frame
+};
+
+// Call first thing in main(), the epoch of every phase.
+void
+setup_startup_timings(StartupTimings& st);
+
+double
+startup_timings_now_ms(const StartupTimings& st);
+
+// Thread-safe.
+void
+startup_timings_add(StartupTimings& st, const char* name, double begin_ms, double end_ms);
+
+struct StartupTimingScope
+{
+  StartupTimingScope(StartupTimings& st, const char* name);
+  ~StartupTimingScope();
+
+  StartupTimings& st;
+  const char* name;
+  double begin_ms;
+};
+
+// Marks time to first frame and prints the phases: call after each submit, from the thread that submits.
+// Only the first call does anything.
+void
+startup_timings_first_frame(StartupTimings& st);
+
+bool
+startup_timings_export_trace(StartupTimings& st, const char* path);
@@ -0,0 +1,189 @@
+#include "swapchain.hpp"
+
+#include "vulkan_utils.hpp"
+
+#include <algorithm>
+#include <stdio.h>
+#include <vector>
+
+namespace {
+
+void
+create_render_pass(ImGui_ImplVulkanH_Window* wd, VkDevice device, VkAllocationCallbacks* allocator)
+{
+  VkAttachmentDescription attachment = {};
+  attachment.format = wd->SurfaceFormat.format;
+  attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  attachment.loadOp = wd->ClearEnable ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  VkAttachmentReference color_attachment = {};
+  color_attachment.attachment = 0;
+  color_attachment.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  VkSubpassDescription subpass = {};
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = 1;
+  subpass.pColorAttachments = &color_attachment;
+  VkSubpassDependency dependency = {};
+  dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependency.dstSubpass = 0;
+  dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependency.srcAccessMask = 0;
+  dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  VkRenderPassCreateInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  info.attachmentCount = 1;
+  info.pAttachments = &attachment;
+  info.subpassCount = 1;
+  info.pSubpasses = &subpass;
+  info.dependencyCount = 1;
+  info.pDependencies = &dependency;
+  VkResult err = vkCreateRenderPass(device, &info, allocator, &wd->RenderPass);
+  check_vk_result(err);
+}
+
+// Moves the image views, framebuffers and swapchain out of wd
+void
+retire_swapchain(ImGui_ImplVulkanH_Window* wd, VkDevice device, VkAllocationCallbacks* allocator, DeletionQueue& deletions, uint64_t retire_value)
+{
+  std::vector<VkImageView> views;
+  std::vector<VkFramebuffer> framebuffers;
+  for (uint32_t i = 0; i < wd->ImageCount; i++) {
+    views.push_back(wd->Frames[i].BackbufferView);
+    framebuffers.push_back(wd->Frames[i].Framebuffer);
+  }
+  const VkSwapchainKHR swapchain = wd->Swapchain;
+  deletion_queue_push(deletions, retire_value, [device, allocator, views, framebuffers, swapchain] {
+    for (VkFramebuffer framebuffer : framebuffers)
+      vkDestroyFramebuffer(device, framebuffer, allocator);
+    for (VkImageView view : views)
+      vkDestroyImageView(device, view, allocator);
+    vkDestroySwapchainKHR(device, swapchain, allocator);
+  });
+  delete[] wd->Frames;
+  wd->Frames = NULL;
+  wd->ImageCount = 0;
+  wd->Swapchain = VK_NULL_HANDLE;
+}
+
+} // namespace
+
+bool
+resize_vulkan_swapchain(ImGui_ImplVulkanH_Window* wd,
+                        VkPhysicalDevice physical_device,
+                        VkDevice device,
+                        uint32_t width,
+                        uint32_t height,
+                        uint32_t min_image_count,
+                        VkAllocationCallbacks* allocator,
+                        DeletionQueue& deletions,
+                        uint64_t retire_value)
+{
+  VkResult err;
+
+  VkSurfaceCapabilitiesKHR cap;
+  err = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, wd->Surface, &cap);
+  check_vk_result(err);
+  VkExtent2D extent = { width, height };
+  if (cap.currentExtent.width != 0xffffffff)
+    extent = cap.currentExtent;
+  else {
+    extent.width = std::clamp(extent.width, cap.minImageExtent.width, cap.maxImageExtent.width);
+    extent.height = std::clamp(extent.height, cap.minImageExtent.height, cap.maxImageExtent.height);
+  }
+  if (extent.width == 0 || extent.height == 0)
+    return false;
+
+  uint32_t image_count = std::max(min_image_count, cap.minImageCount);
+  if (cap.maxImageCount != 0)
+    image_count = std::min(image_count, cap.maxImageCount);
+
+  if (wd->RenderPass == VK_NULL_HANDLE)
+    create_render_pass(wd, device, allocator);
+
+  // The old swapchain is retired by this call, but its images may still be in use by frames in flight
+  VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+  {
+    VkSwapchainCreateInfoKHR info = {};
+    info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+    info.surface = wd->Surface;
+    info.minImageCount = image_count;
+    info.imageFormat = wd->SurfaceFormat.format;
+    info.imageColorSpace = wd->SurfaceFormat.colorSpace;
+    info.imageExtent = extent;
+    info.imageArrayLayers = 1;
+    // Transfer source where allowed, for frame recording
+    info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | (cap.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+    info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    info.preTransform = (cap.supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR) ? VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR : cap.currentTransform;
+    info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+    info.presentMode = wd->PresentMode;
+    info.clipped = VK_TRUE;
+    info.oldSwapchain = wd->Swapchain;
+    err = vkCreateSwapchainKHR(device, &info, allocator, &swapchain);
+    check_vk_result(err);
+  }
+  if (wd->Swapchain != VK_NULL_HANDLE)
+    retire_swapchain(wd, device, allocator, deletions, retire_value);
+
+  wd->Swapchain = swapchain;
+  wd->Width = static_cast<int>(extent.width);
+  wd->Height = static_cast<int>(extent.height);
+  err = vkGetSwapchainImagesKHR(device, swapchain, &wd->ImageCount, NULL);
+  check_vk_result(err);
+  std::vector<VkImage> images(wd->ImageCount);
+  err = vkGetSwapchainImagesKHR(device, swapchain, &wd->ImageCount, images.data());
+  check_vk_result(err);
+  // Not IM_ALLOC: a render thread rebuilds the swapchain while the UI thread uses the ImGui context
+  wd->Frames = new ImGui_ImplVulkanH_Frame[wd->ImageCount]();
+
+  for (uint32_t i = 0; i < wd->ImageCount; i++) {
+    ImGui_ImplVulkanH_Frame* fd = &wd->Frames[i];
+    fd->Backbuffer = images[i];
+    {
+      VkImageViewCreateInfo info = {};
+      info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+      info.image = fd->Backbuffer;
+      info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+      info.format = wd->SurfaceFormat.format;
+      info.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+      info.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+      err = vkCreateImageView(device, &info, allocator, &fd->BackbufferView);
+      check_vk_result(err);
+    }
+    {
+      VkFramebufferCreateInfo info = {};
+      info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+      info.renderPass = wd->RenderPass;
+      info.attachmentCount = 1;
+      info.pAttachments = &fd->BackbufferView;
+      info.width = extent.width;
+      info.height = extent.height;
+      info.layers = 1;
+      err = vkCreateFramebuffer(device, &info, allocator, &fd->Framebuffer);
+      check_vk_result(err);
+    }
+  }
+  return true;
+}
+
+void
+cleanup_vulkan_swapchain(VkDevice device, ImGui_ImplVulkanH_Window& wd, VkAllocationCallbacks* allocator)
+{
+  for (uint32_t i = 0; i < wd.ImageCount; i++) {
+    ImGui_ImplVulkanH_Frame* fd = &wd.Frames[i];
+    vkDestroyFramebuffer(device, fd->Framebuffer, allocator);
+    vkDestroyImageView(device, fd->BackbufferView, allocator);
+  }
+  delete[] wd.Frames;
+  wd.Frames = NULL;
+  wd.ImageCount = 0;
+  vkDestroySwapchainKHR(device, wd.Swapchain, allocator);
+  wd.Swapchain = VK_NULL_HANDLE;
+  vkDestroyRenderPass(device, wd.RenderPass, allocator);
+  wd.RenderPass = VK_NULL_HANDLE;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "backends/imgui_impl_vulkan.h"
+#include "deletion_queue.hpp"
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+
+// Swapchain for the main window, replacing ImGui_ImplVulkanH_CreateOrResizeWindow.
+// Resizing passes the current swapchain as oldSwapchain and hands the old swapchain, image views
+// and framebuffers to a DeletionQueue instead of idling the device. The render pass is created once
+// and kept, so pipelines built against it stay valid; per-frame command pools and sync objects live
+// in the FrameScheduler and are untouched.
+// Only Backbuffer, BackbufferView and Framebuffer of wd->Frames are filled in. Images can also be
+// copied from (VK_IMAGE_USAGE_TRANSFER_SRC_BIT) when the surface supports it.
+
+// wd->Surface, SurfaceFormat and PresentMode must be set. Old objects are destroyed once the frame
+// scheduler's timeline reaches retire_value. Returns false while the surface has no area (minimized).
+bool
+resize_vulkan_swapchain(ImGui_ImplVulkanH_Window* wd,
+                        VkPhysicalDevice physical_device,
+                        VkDevice device,
+                        uint32_t width,
+                        uint32_t height,
+                        uint32_t min_image_count,
+                        VkAllocationCallbacks* allocator,
+                        DeletionQueue& deletions,
+                        uint64_t retire_value);
+
+// Destroys the swapchain, its framebuffers and the render pass (not the surface). The device must be idle.
+void
+cleanup_vulkan_swapchain(VkDevice device, ImGui_ImplVulkanH_Window& wd, VkAllocationCallbacks* allocator);
@@ -0,0 +1,493 @@
+#include "ui_renderer.hpp"
+
+#include "redraw.hpp"
+#include "vulkan_utils.hpp"
+
+#include <algorithm>
+#include <stddef.h> // offsetof
+#include <stdio.h>
+#include <stdlib.h> // exit
+#include <string.h> // memcpy
+
+namespace {
+
+// SPIR-V generated from shaders/ at build time (glslc -mfmt=c)
+const uint32_t imgui_vert_spv[] =
+#include "imgui.vert.h"
+  ;
+const uint32_t imgui_frag_spv[] =
+#include "imgui.frag.h"
+  ;
+
+constexpr VkDeviceSize initial_ring_size = 1024 * 1024;
+constexpr VkDeviceSize region_alignment = 16;
+// Lists not drawn for this many frames are forgotten (closed windows)
+constexpr uint64_t list_cache_frames = 120;
+
+struct PushConstants
+{
+  float scale[2];
+  float translate[2];
+};
+
+VkDeviceSize
+align_up(VkDeviceSize value, VkDeviceSize alignment)
+{
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+uint64_t
+mix(uint64_t h, uint64_t value)
+{
+  h = (h ^ value) * 0x9E3779B97F4A7C15ull;
+  return h ^ (h >> 32);
+}
+
+VkDeviceSize
+list_bytes(const ImDrawList* list)
+{
+  return align_up(list->VtxBuffer.Size * sizeof(ImDrawVert), region_alignment) + align_up(list->IdxBuffer.Size * sizeof(ImDrawIdx), region_alignment);
+}
+
+void
+create_pipeline(UiRenderer& ui, VkRenderPass render_pass, VkPipelineCache pipeline_cache)
+{
+  VkResult err;
+  VkShaderModule vert = create_shader_module(ui.device, imgui_vert_spv, sizeof(imgui_vert_spv), ui.allocator);
+  VkShaderModule frag = create_shader_module(ui.device, imgui_frag_spv, sizeof(imgui_frag_spv), ui.allocator);
+
+  VkPipelineShaderStageCreateInfo stages[2] = {};
+  stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+  stages[0].module = vert;
+  stages[0].pName = "main";
+  stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  stages[1].module = frag;
+  stages[1].pName = "main";
+
+  VkVertexInputBindingDescription binding = {};
+  binding.binding = 0;
+  binding.stride = sizeof(ImDrawVert);
+  binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+  VkVertexInputAttributeDescription attributes[3] = {};
+  attributes[0] = { 0, 0, VK_FORMAT_R32G32_SFLOAT, static_cast<uint32_t>(offsetof(ImDrawVert, pos)) };
+  attributes[1] = { 1, 0, VK_FORMAT_R32G32_SFLOAT, static_cast<uint32_t>(offsetof(ImDrawVert, uv)) };
+  attributes[2] = { 2, 0, VK_FORMAT_R8G8B8A8_UNORM, static_cast<uint32_t>(offsetof(ImDrawVert, col)) };
+  VkPipelineVertexInputStateCreateInfo vertex_info = {};
+  vertex_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  vertex_info.vertexBindingDescriptionCount = 1;
+  vertex_info.pVertexBindingDescriptions = &binding;
+  vertex_info.vertexAttributeDescriptionCount = 3;
+  vertex_info.pVertexAttributeDescriptions = attributes;
+
+  VkPipelineInputAssemblyStateCreateInfo ia_info = {};
+  ia_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  ia_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+  VkPipelineViewportStateCreateInfo viewport_info = {};
+  viewport_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  viewport_info.viewportCount = 1;
+  viewport_info.scissorCount = 1;
+
+  VkPipelineRasterizationStateCreateInfo raster_info = {};
+  raster_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  raster_info.polygonMode = VK_POLYGON_MODE_FILL;
+  raster_info.cullMode = VK_CULL_MODE_NONE;
+  raster_info.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+  raster_info.lineWidth = 1.0f;
+
+  VkPipelineMultisampleStateCreateInfo ms_info = {};
+  ms_info.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  ms_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+  // Premultiplied by the shader's alpha, same blending as the backend
+  VkPipelineColorBlendAttachmentState color_attachment = {};
+  color_attachment.blendEnable = VK_TRUE;
+  color_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+  color_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+  color_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+  color_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+  color_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+  color_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+  color_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+  VkPipelineColorBlendStateCreateInfo blend_info = {};
+  blend_info.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+  blend_info.attachmentCount = 1;
+  blend_info.pAttachments = &color_attachment;
+
+  VkPipelineDepthStencilStateCreateInfo depth_info = {};
+  depth_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+
+  const VkDynamicState dynamic_states[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+  VkPipelineDynamicStateCreateInfo dynamic_state = {};
+  dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamic_state.dynamicStateCount = IM_ARRAYSIZE(dynamic_states);
+  dynamic_state.pDynamicStates = dynamic_states;
+
+  VkGraphicsPipelineCreateInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  info.stageCount = 2;
+  info.pStages = stages;
+  info.pVertexInputState = &vertex_info;
+  info.pInputAssemblyState = &ia_info;
+  info.pViewportState = &viewport_info;
+  info.pRasterizationState = &raster_info;
+  info.pMultisampleState = &ms_info;
+  info.pDepthStencilState = &depth_info;
+  info.pColorBlendState = &blend_info;
+  info.pDynamicState = &dynamic_state;
+  info.layout = ui.pipeline_layout;
+  info.renderPass = render_pass;
+  info.subpass = 0;
+  err = vkCreateGraphicsPipelines(ui.device, pipeline_cache, 1, &info, ui.allocator, &ui.pipeline);
+  check_vk_result(err);
+
+  vkDestroyShaderModule(ui.device, vert, ui.allocator);
+  vkDestroyShaderModule(ui.device, frag, ui.allocator);
+}
+
+bool
+create_ring(UiRenderer& ui, VkDeviceSize size)
+{
+  // Written by the CPU every frame and read once by the GPU: device local when it is also mappable (ReBAR / UMA)
+  return gpu_create_buffer(*ui.gpu,
+                           size,
+                           VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                           ui.ring);
+}
+
+// Replaces the ring, every cached region and recorded secondary becomes invalid
+bool
+grow_ring(UiRenderer& ui, VkDeviceSize required, uint64_t retire_value)
+{
+  VkDeviceSize size = ui.ring.size * 2;
+  while (size < required * 2)
+    size *= 2;
+  deletion_queue_push(*ui.deletions, retire_value, [gpu = ui.gpu, ring = ui.ring]() mutable { gpu_destroy_buffer(*gpu, ring); });
+  ui.ring = GpuBuffer{};
+  ui.head = 0;
+  ui.generation++;
+  ui.ring_grows++;
+  for (UiFrame& frame : ui.frames)
+    frame.low = UINT64_MAX;
+  if (!create_ring(ui, size)) {
+    fprintf(stderr, "[ui] failed to allocate a %llu byte vertex ring\n", (unsigned long long)size);
+    return false;
+  }
+  return true;
+}
+
+bool
+ring_allocate(UiRenderer& ui, UiFrame& frame, VkDeviceSize size, uint64_t& position)
+{
+  const VkDeviceSize capacity = ui.ring.size;
+  if (size > capacity)
+    return false;
+  // Regions never wrap: skip to the start of the ring instead
+  uint64_t start = ui.head;
+  const VkDeviceSize physical = start % capacity;
+  if (physical + size > capacity)
+    start += capacity - physical;
+  uint64_t oldest = UINT64_MAX;
+  for (uint32_t i = 0; i < ui.frames_in_flight; i++)
+    oldest = std::min(oldest, ui.frames[i].low);
+  if (oldest != UINT64_MAX && start + size > oldest + capacity)
+    return false;
+  ui.head = start + size;
+  frame.low = std::min(frame.low, start);
+  position = start;
+  return true;
+}
+
+// Reuses the regions of unchanged lists and uploads the others, false if the ring is full
+bool
+place_lists(UiRenderer& ui, UiFrame& frame, const ImDrawData* draw_data)
+{
+  ui.uploaded_bytes = 0;
+  ui.reused_bytes = 0;
+  ui.uploaded_lists = 0;
+  ui.reused_lists = 0;
+
+  // Pin reused regions first so that this frame's uploads cannot overwrite them
+  const std::vector<uint64_t>& hashes = ui.hashes;
+  std::vector<bool>& reuse = ui.reuse;
+  reuse.assign(draw_data->CmdListsCount, false);
+  for (int i = 0; i < draw_data->CmdListsCount; i++) {
+    const auto it = ui.lists.find(draw_data->CmdLists[i]);
+    if (it == ui.lists.end())
+      continue;
+    const UiListCache& cache = it->second;
+    reuse[i] = cache.generation == ui.generation && cache.hash == hashes[i] && ui.head - cache.position <= ui.ring.size / 2;
+    if (reuse[i])
+      frame.low = std::min(frame.low, cache.position);
+  }
+
+  uint8_t* mapped = static_cast<uint8_t*>(ui.ring.allocation.mapped);
+  for (int i = 0; i < draw_data->CmdListsCount; i++) {
+    const ImDrawList* list = draw_data->CmdLists[i];
+    UiListCache& cache = ui.lists[list];
+    cache.last_frame = ui.frame;
+    if (reuse[i]) {
+      ui.reused_bytes += list_bytes(list);
+      ui.reused_lists++;
+      continue;
+    }
+    uint64_t position;
+    if (!ring_allocate(ui, frame, list_bytes(list), position))
+      return false;
+    const VkDeviceSize vertex_bytes = list->VtxBuffer.Size * sizeof(ImDrawVert);
+    cache.hash = hashes[i];
+    cache.position = position;
+    cache.generation = ui.generation;
+    cache.vertex_offset = position % ui.ring.size;
+    cache.index_offset = cache.vertex_offset + align_up(vertex_bytes, region_alignment);
+    memcpy(mapped + cache.vertex_offset, list->VtxBuffer.Data, vertex_bytes);
+    memcpy(mapped + cache.index_offset, list->IdxBuffer.Data, list->IdxBuffer.Size * sizeof(ImDrawIdx));
+    ui.uploaded_bytes += list_bytes(list);
+    ui.uploaded_lists++;
+  }
+  return true;
+}
+
+void
+setup_render_state(UiRenderer& ui, VkCommandBuffer command_buffer, const ImDrawData* draw_data, int fb_width, int fb_height)
+{
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, ui.pipeline);
+  VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(fb_width), static_cast<float>(fb_height), 0.0f, 1.0f };
+  vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+  PushConstants constants;
+  constants.scale[0] = 2.0f / draw_data->DisplaySize.x;
+  constants.scale[1] = 2.0f / draw_data->DisplaySize.y;
+  constants.translate[0] = -1.0f - draw_data->DisplayPos.x * constants.scale[0];
+  constants.translate[1] = -1.0f - draw_data->DisplayPos.y * constants.scale[1];
+  vkCmdPushConstants(command_buffer, ui.pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+}
+
+void
+record_draws(UiRenderer& ui, VkCommandBuffer command_buffer, const ImDrawData* draw_data, int fb_width, int fb_height)
+{
+  setup_render_state(ui, command_buffer, draw_data, fb_width, fb_height);
+  const ImVec2 clip_off = draw_data->DisplayPos;
+  const ImVec2 clip_scale = draw_data->FramebufferScale;
+  const VkIndexType index_type = sizeof(ImDrawIdx) == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+  ImTextureID bound_texture = ImTextureID();
+  for (int i = 0; i < draw_data->CmdListsCount; i++) {
+    const ImDrawList* list = draw_data->CmdLists[i];
+    const UiListCache& cache = ui.lists[list];
+    vkCmdBindVertexBuffers(command_buffer, 0, 1, &ui.ring.buffer, &cache.vertex_offset);
+    vkCmdBindIndexBuffer(command_buffer, ui.ring.buffer, cache.index_offset, index_type);
+    for (const ImDrawCmd& cmd : list->CmdBuffer) {
+      if (cmd.UserCallback != nullptr) {
+        if (cmd.UserCallback == ImDrawCallback_ResetRenderState) {
+          setup_render_state(ui, command_buffer, draw_data, fb_width, fb_height);
+          bound_texture = ImTextureID();
+        } else
+          cmd.UserCallback(list, &cmd);
+        continue;
+      }
+      ImVec2 clip_min((cmd.ClipRect.x - clip_off.x) * clip_scale.x, (cmd.ClipRect.y - clip_off.y) * clip_scale.y);
+      ImVec2 clip_max((cmd.ClipRect.z - clip_off.x) * clip_scale.x, (cmd.ClipRect.w - clip_off.y) * clip_scale.y);
+      clip_min.x = std::max(clip_min.x, 0.0f);
+      clip_min.y = std::max(clip_min.y, 0.0f);
+      clip_max.x = std::min(clip_max.x, static_cast<float>(fb_width));
+      clip_max.y = std::min(clip_max.y, static_cast<float>(fb_height));
+      if (clip_max.x <= clip_min.x || clip_max.y <= clip_min.y)
+        continue;
+      VkRect2D scissor = { { static_cast<int32_t>(clip_min.x), static_cast<int32_t>(clip_min.y) },
+                           { static_cast<uint32_t>(clip_max.x - clip_min.x), static_cast<uint32_t>(clip_max.y - clip_min.y) } };
+      vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+      if (cmd.TextureId != bound_texture) {
+        VkDescriptorSet set = (VkDescriptorSet)cmd.TextureId;
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, ui.pipeline_layout, 0, 1, &set, 0, NULL);
+        bound_texture = cmd.TextureId;
+      }
+      vkCmdDrawIndexed(command_buffer, cmd.ElemCount, 1, cmd.IdxOffset, static_cast<int32_t>(cmd.VtxOffset), 0);
+    }
+  }
+}
+
+} // namespace
+
+bool
+setup_ui_renderer(UiRenderer& ui,
+                  VkDevice device,
+                  GpuAllocator& gpu,
+                  DeletionQueue& deletions,
+                  VkRenderPass render_pass,
+                  VkPipelineCache pipeline_cache,
+                  uint32_t queue_family,
+                  uint32_t frames_in_flight,
+                  VkAllocationCallbacks* allocator)
+{
+  VkResult err;
+  ui.device = device;
+  ui.allocator = allocator;
+  ui.gpu = &gpu;
+  ui.deletions = &deletions;
+  ui.frames_in_flight = frames_in_flight;
+
+  // Identical to the backend's layout, so its ImTextureID descriptor sets can be bound here
+  {
+    VkDescriptorSetLayoutBinding binding = {};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    VkDescriptorSetLayoutCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    info.bindingCount = 1;
+    info.pBindings = &binding;
+    err = vkCreateDescriptorSetLayout(device, &info, allocator, &ui.set_layout);
+    check_vk_result(err);
+  }
+  {
+    VkPushConstantRange range = { VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstants) };
+    VkPipelineLayoutCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    info.setLayoutCount = 1;
+    info.pSetLayouts = &ui.set_layout;
+    info.pushConstantRangeCount = 1;
+    info.pPushConstantRanges = &range;
+    err = vkCreatePipelineLayout(device, &info, allocator, &ui.pipeline_layout);
+    check_vk_result(err);
+  }
+  create_pipeline(ui, render_pass, pipeline_cache);
+
+  // Secondaries outlive a frame, so they are reset one by one rather than with the pool
+  {
+    VkCommandPoolCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    info.queueFamilyIndex = queue_family;
+    err = vkCreateCommandPool(device, &info, allocator, &ui.command_pool);
+    check_vk_result(err);
+  }
+  for (uint32_t i = 0; i < frames_in_flight; i++) {
+    VkCommandBufferAllocateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    info.commandPool = ui.command_pool;
+    info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    info.commandBufferCount = 1;
+    err = vkAllocateCommandBuffers(device, &info, &ui.frames[i].secondary);
+    check_vk_result(err);
+  }
+
+  if (!create_ring(ui, initial_ring_size)) {
+    fprintf(stderr, "[ui] failed to allocate the vertex ring\n");
+    return false;
+  }
+  return true;
+}
+
+void
+cleanup_ui_renderer(UiRenderer& ui)
+{
+  gpu_destroy_buffer(*ui.gpu, ui.ring);
+  vkDestroyCommandPool(ui.device, ui.command_pool, ui.allocator);
+  vkDestroyPipeline(ui.device, ui.pipeline, ui.allocator);
+  vkDestroyPipelineLayout(ui.device, ui.pipeline_layout, ui.allocator);
+  vkDestroyDescriptorSetLayout(ui.device, ui.set_layout, ui.allocator);
+  ui.command_pool = VK_NULL_HANDLE;
+  ui.pipeline = VK_NULL_HANDLE;
+  ui.pipeline_layout = VK_NULL_HANDLE;
+  ui.set_layout = VK_NULL_HANDLE;
+  ui.frames = {};
+  ui.lists.clear();
+}
+
+VkCommandBuffer
+ui_renderer_record(UiRenderer& ui, const ImDrawData* draw_data, uint32_t frame_slot, const VkCommandBufferInheritanceInfo& inheritance, uint64_t retire_value)
+{
+  UiFrame& frame = ui.frames[frame_slot];
+  frame.low = UINT64_MAX; // the slot's previous frame has completed
+  ui.frame++;
+
+  const int fb_width = static_cast<int>(draw_data->DisplaySize.x * draw_data->FramebufferScale.x);
+  const int fb_height = static_cast<int>(draw_data->DisplaySize.y * draw_data->FramebufferScale.y);
+
+  std::vector<uint64_t>& hashes = ui.hashes;
+  hashes.resize(draw_data->CmdListsCount);
+  VkDeviceSize total_bytes = 0;
+  bool has_callbacks = false;
+  const float display[6] = { draw_data->DisplayPos.x, draw_data->DisplayPos.y, draw_data->DisplaySize.x, draw_data->DisplaySize.y, draw_data->FramebufferScale.x, draw_data->FramebufferScale.y };
+  uint64_t data_hash = 0;
+  for (float value : display) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    data_hash = mix(data_hash, bits);
+  }
+  for (int i = 0; i < draw_data->CmdListsCount; i++) {
+    const ImDrawList* list = draw_data->CmdLists[i];
+    hashes[i] = hash_draw_list(list);
+    data_hash = mix(data_hash, hashes[i]);
+    total_bytes += list_bytes(list);
+    for (const ImDrawCmd& cmd : list->CmdBuffer)
+      has_callbacks = has_callbacks || (cmd.UserCallback != nullptr && cmd.UserCallback != ImDrawCallback_ResetRenderState);
+  }
+
+  if (!place_lists(ui, frame, draw_data)) {
+    if (!grow_ring(ui, total_bytes, retire_value))
+      exit(-1);
+    frame.low = UINT64_MAX;
+    const bool placed = place_lists(ui, frame, draw_data);
+    IM_ASSERT(placed);
+    (void)placed;
+  }
+
+  // Forget lists that stopped being drawn
+  for (auto it = ui.lists.begin(); it != ui.lists.end();) {
+    if (ui.frame - it->second.last_frame > list_cache_frames)
+      it = ui.lists.erase(it);
+    else
+      ++it;
+  }
+
+  uint64_t layout_hash = ui.generation;
+  for (int i = 0; i < draw_data->CmdListsCount; i++)
+    layout_hash = mix(layout_hash, ui.lists[draw_data->CmdLists[i]].position);
+
+  // Same draws from the same regions: the slot's secondary is still correct. Callbacks must run every frame.
+  ui.reused_secondary = frame.recorded && !has_callbacks && frame.data_hash == data_hash && frame.layout_hash == layout_hash;
+  if (ui.reused_secondary) {
+    ui.reused_secondaries++;
+    return frame.secondary;
+  }
+
+  VkResult err = vkResetCommandBuffer(frame.secondary, 0);
+  check_vk_result(err);
+  // No framebuffer: the secondary is replayed into whichever swapchain image comes next
+  VkCommandBufferInheritanceInfo any_framebuffer = inheritance;
+  any_framebuffer.framebuffer = VK_NULL_HANDLE;
+  VkCommandBufferBeginInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  info.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+  info.pInheritanceInfo = &any_framebuffer;
+  err = vkBeginCommandBuffer(frame.secondary, &info);
+  check_vk_result(err);
+  if (fb_width > 0 && fb_height > 0 && draw_data->TotalVtxCount > 0)
+    record_draws(ui, frame.secondary, draw_data, fb_width, fb_height);
+  err = vkEndCommandBuffer(frame.secondary);
+  check_vk_result(err);
+
+  frame.recorded = true;
+  frame.data_hash = data_hash;
+  frame.layout_hash = layout_hash;
+  return frame.secondary;
+}
+
+void
+ui_renderer_draw_stats(UiRenderer& ui, bool* open)
+{
+  if (!ImGui::Begin("UI renderer", open)) {
+    ImGui::End();
+    return;
+  }
+  ImGui::Text("ring %.2f MB (grown %llu times)", ui.ring.size / (1024.0 * 1024.0), (unsigned long long)ui.ring_grows);
+  ImGui::Text("uploaded %u lists, %.1f KB", ui.uploaded_lists, ui.uploaded_bytes / 1024.0);
+  ImGui::Text("reused %u lists, %.1f KB", ui.reused_lists, ui.reused_bytes / 1024.0);
+  ImGui::Text("secondary %s (%llu reused)", ui.reused_secondary ? "reused" : "recorded", (unsigned long long)ui.reused_secondaries);
+  ImGui::End();
+}
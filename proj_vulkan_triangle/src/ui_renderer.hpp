@@ -0,0 +1,103 @@
+#pragma once
+
+#include "deletion_queue.hpp"
+#include "frame_scheduler.hpp"
+#include "gpu_allocator.hpp"
+#include "imgui.h"
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Retained renderer for the main viewport's ImDrawData, replacing ImGui_ImplVulkan_RenderDrawData.
+//
+// Vertices and indices go to one persistently mapped ring buffer. Every ImDrawList is hashed and
+// an unchanged list keeps the region it was uploaded to, so only lists that changed are copied.
+// Regions are addressed by a monotonic ring position: a region stays intact while nothing newer
+// than one capacity has been written, in-flight frames pin the oldest position they reference,
+// and a list older than half the ring is uploaded again so that static lists do not pin it forever.
+// When the ring cannot fit a frame it is replaced by one twice the size.
+//
+// Each frame slot keeps its secondary command buffer. When the whole draw data and the regions it
+// refers to are identical to what the slot last recorded, the secondary is executed again as is.
+// Textures are the backend's descriptor sets (ImTextureID), bound through a compatible layout.
+
+struct UiListCache
+{
+  uint64_t hash = 0;
+  uint64_t position = 0; // ring position of the vertices, indices follow
+  uint32_t generation = 0;
+  VkDeviceSize vertex_offset = 0;
+  VkDeviceSize index_offset = 0;
+  uint64_t last_frame = 0;
+};
+
+struct UiFrame
+{
+  VkCommandBuffer secondary = VK_NULL_HANDLE;
+  bool recorded = false;
+  uint64_t data_hash = 0;
+  uint64_t layout_hash = 0;
+  uint64_t low = UINT64_MAX; // oldest ring position this slot's frame references
+};
+
+struct UiRenderer
+{
+  VkDevice device = VK_NULL_HANDLE;
+  VkAllocationCallbacks* allocator = nullptr;
+  GpuAllocator* gpu = nullptr;
+  DeletionQueue* deletions = nullptr;
+
+  VkDescriptorSetLayout set_layout = VK_NULL_HANDLE;
+  VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  VkCommandPool command_pool = VK_NULL_HANDLE;
+  uint32_t frames_in_flight = 0;
+  std::array<UiFrame, max_frames_in_flight> frames;
+
+  GpuBuffer ring;
+  uint64_t head = 0; // ring position of the next allocation
+  uint32_t generation = 0;
+  std::unordered_map<const ImDrawList*, UiListCache> lists;
+  uint64_t frame = 0;
+
+  // Per list of the frame being recorded, kept so a steady UI does not allocate
+  std::vector<uint64_t> hashes;
+  std::vector<bool> reuse;
+
+  // last frame
+  VkDeviceSize uploaded_bytes = 0;
+  VkDeviceSize reused_bytes = 0;
+  uint32_t uploaded_lists = 0;
+  uint32_t reused_lists = 0;
+  bool reused_secondary = false;
+  // totals
+  uint64_t ring_grows = 0;
+  uint64_t reused_secondaries = 0;
+};
+
+bool
+setup_ui_renderer(UiRenderer& ui,
+                  VkDevice device,
+                  GpuAllocator& gpu,
+                  DeletionQueue& deletions,
+                  VkRenderPass render_pass,
+                  VkPipelineCache pipeline_cache,
+                  uint32_t queue_family,
+                  uint32_t frames_in_flight,
+                  VkAllocationCallbacks* allocator);
+
+// The device must be idle.
+void
+cleanup_ui_renderer(UiRenderer& ui);
+
+// Returns a secondary continuing the render pass in inheritance (any framebuffer) that draws
+// draw_data. The slot's previous frame must have completed; a replaced ring is destroyed once the
+// frame scheduler's timeline reaches retire_value.
+VkCommandBuffer
+ui_renderer_record(UiRenderer& ui, const ImDrawData* draw_data, uint32_t frame_slot, const VkCommandBufferInheritanceInfo& inheritance, uint64_t retire_value);
+
+void
+ui_renderer_draw_stats(UiRenderer& ui, bool* open);
@@ -0,0 +1,455 @@
+#include "upload_queue.hpp"
+
+#include "vulkan_utils.hpp"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+constexpr VkDeviceSize staging_alignment = 16;
+
+// All helpers below expect uq.mutex to be held
+
+bool
+separate_families(const UploadQueue& uq)
+{
+  return uq.queue_family != uq.graphics_family;
+}
+
+void
+begin_recording(UploadQueue& uq)
+{
+  if (uq.recording != VK_NULL_HANDLE)
+    return;
+  VkResult err;
+  if (!uq.free_command_buffers.empty()) {
+    uq.recording = uq.free_command_buffers.back();
+    uq.free_command_buffers.pop_back();
+  } else {
+    VkCommandBufferAllocateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    info.commandPool = uq.command_pool;
+    info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    info.commandBufferCount = 1;
+    err = vkAllocateCommandBuffers(uq.device, &info, &uq.recording);
+    check_vk_result(err);
+  }
+  VkCommandBufferBeginInfo begin_info = {};
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  err = vkBeginCommandBuffer(uq.recording, &begin_info);
+  check_vk_result(err);
+}
+
+void
+flush_locked(UploadQueue& uq)
+{
+  if (uq.recording == VK_NULL_HANDLE)
+    return;
+  VkResult err = vkEndCommandBuffer(uq.recording);
+  check_vk_result(err);
+
+  const uint64_t value = ++uq.submitted_value;
+  VkTimelineSemaphoreSubmitInfo timeline_info = {};
+  timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timeline_info.signalSemaphoreValueCount = 1;
+  timeline_info.pSignalSemaphoreValues = &value;
+  VkSubmitInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  info.pNext = &timeline_info;
+  info.commandBufferCount = 1;
+  info.pCommandBuffers = &uq.recording;
+  info.signalSemaphoreCount = 1;
+  info.pSignalSemaphores = &uq.timeline;
+  err = vkQueueSubmit(uq.queue, 1, &info, VK_NULL_HANDLE);
+  check_vk_result(err);
+
+  uq.in_flight.push_back({ uq.recording, value });
+  uq.recording = VK_NULL_HANDLE;
+  uq.recorded_bytes = 0;
+  uq.total_batches++;
+  gpu_ring_end_frame(uq.staging, value);
+
+  uq.pending_acquires.insert(uq.pending_acquires.end(), uq.recorded_acquires.begin(), uq.recorded_acquires.end());
+  uq.recorded_acquires.clear();
+  uq.pending_stages |= uq.recorded_stages;
+  uq.recorded_stages = 0;
+}
+
+void
+collect_locked(UploadQueue& uq)
+{
+  VkResult err = vkGetSemaphoreCounterValue(uq.device, uq.timeline, &uq.completed_value);
+  check_vk_result(err);
+
+  auto done = std::remove_if(uq.in_flight.begin(), uq.in_flight.end(), [&](const UploadQueue::Batch& batch) {
+    if (batch.value > uq.completed_value)
+      return false;
+    VkResult reset_err = vkResetCommandBuffer(batch.command_buffer, 0);
+    check_vk_result(reset_err);
+    uq.free_command_buffers.push_back(batch.command_buffer);
+    return true;
+  });
+  uq.in_flight.erase(done, uq.in_flight.end());
+  gpu_ring_retire(uq.staging, uq.completed_value);
+
+  auto staged = std::remove_if(uq.oversized.begin(), uq.oversized.end(), [&](UploadQueue::OversizedStaging& staging) {
+    if (staging.value > uq.completed_value)
+      return false;
+    gpu_destroy_buffer(*uq.gpu, staging.buffer);
+    return true;
+  });
+  uq.oversized.erase(staged, uq.oversized.end());
+}
+
+// Finished graphics work; own_only leaves other threads' work (and callbacks) to them
+void
+collect_graphics_locked(UploadQueue& uq, bool own_only)
+{
+  const std::thread::id self = std::this_thread::get_id();
+  auto done = std::remove_if(uq.graphics_in_flight.begin(), uq.graphics_in_flight.end(), [&](UploadQueue::GraphicsWork& work) {
+    if ((own_only && work.owner != self) || vkGetFenceStatus(uq.device, work.fence) != VK_SUCCESS)
+      return false;
+    if (work.on_complete)
+      work.on_complete();
+    vkDestroyFence(uq.device, work.fence, uq.allocator);
+    vkFreeCommandBuffers(uq.device, uq.graphics_command_pool, 1, &work.command_buffer);
+    return true;
+  });
+  uq.graphics_in_flight.erase(done, uq.graphics_in_flight.end());
+}
+
+// Copies data into staging memory, returning the buffer/offset to copy from
+void
+stage(UploadQueue& uq, const void* data, VkDeviceSize size, VkBuffer& src, VkDeviceSize& src_offset)
+{
+  GpuRingAllocation ring_allocation;
+  while (size <= uq.staging.buffer.size / 2) {
+    if (gpu_ring_allocate(uq.staging, size, staging_alignment, ring_allocation)) {
+      memcpy(ring_allocation.mapped, data, size);
+      src = ring_allocation.buffer;
+      src_offset = ring_allocation.offset;
+      return;
+    }
+    // Ring full: submit what we have and wait for the oldest batch to free space
+    uq.ring_stalls++;
+    flush_locked(uq);
+    if (uq.in_flight.empty())
+      break;
+    VkSemaphoreWaitInfo wait_info = {};
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &uq.timeline;
+    wait_info.pValues = &uq.in_flight.front().value;
+    VkResult err = vkWaitSemaphores(uq.device, &wait_info, UINT64_MAX);
+    check_vk_result(err);
+    collect_locked(uq);
+  }
+
+  UploadQueue::OversizedStaging staging;
+  const VkMemoryPropertyFlags host = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  if (!gpu_create_buffer(*uq.gpu, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, host, 0, staging.buffer)) {
+    fprintf(stderr, "[upload] failed to allocate %llu bytes of staging memory\n", (unsigned long long)size);
+    abort();
+  }
+  memcpy(staging.buffer.allocation.mapped, data, size);
+  staging.value = uq.submitted_value + 1;
+  src = staging.buffer.buffer;
+  src_offset = 0;
+  uq.oversized.push_back(staging);
+}
+
+} // namespace
+
+void
+setup_upload_queue(UploadQueue& uq,
+                   GpuAllocator& gpu,
+                   VkDevice device,
+                   VkQueue queue,
+                   uint32_t queue_family,
+                   VkQueue graphics_queue,
+                   uint32_t graphics_family,
+                   VkDeviceSize staging_size,
+                   VkAllocationCallbacks* allocator)
+{
+  VkResult err;
+  uq.device = device;
+  uq.allocator = allocator;
+  uq.gpu = &gpu;
+  uq.queue = queue;
+  uq.queue_family = queue_family;
+  uq.graphics_queue = graphics_queue;
+  uq.graphics_family = graphics_family;
+
+  {
+    VkSemaphoreTypeCreateInfo type_info = {};
+    type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    VkSemaphoreCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    info.pNext = &type_info;
+    err = vkCreateSemaphore(device, &info, allocator, &uq.timeline);
+    check_vk_result(err);
+  }
+  {
+    VkCommandPoolCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    info.queueFamilyIndex = queue_family;
+    err = vkCreateCommandPool(device, &info, allocator, &uq.command_pool);
+    check_vk_result(err);
+    info.queueFamilyIndex = graphics_family;
+    err = vkCreateCommandPool(device, &info, allocator, &uq.graphics_command_pool);
+    check_vk_result(err);
+  }
+
+  if (!gpu_create_ring(gpu, staging_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, uq.staging)) {
+    fprintf(stderr, "Error failed to allocate upload staging ring\n");
+    exit(-1);
+  }
+}
+
+void
+cleanup_upload_queue(UploadQueue& uq)
+{
+  {
+    std::lock_guard<std::mutex> lock(uq.mutex);
+    flush_locked(uq);
+  }
+  VkResult err;
+  if (uq.submitted_value > 0) {
+    VkSemaphoreWaitInfo wait_info = {};
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &uq.timeline;
+    wait_info.pValues = &uq.submitted_value;
+    err = vkWaitSemaphores(uq.device, &wait_info, UINT64_MAX);
+    check_vk_result(err);
+  }
+  for (UploadQueue::GraphicsWork& work : uq.graphics_in_flight) {
+    err = vkWaitForFences(uq.device, 1, &work.fence, VK_TRUE, UINT64_MAX);
+    check_vk_result(err);
+  }
+  {
+    // Every other thread is done by now: run all callbacks
+    std::lock_guard<std::mutex> lock(uq.mutex);
+    collect_locked(uq);
+    collect_graphics_locked(uq, false);
+  }
+
+  gpu_destroy_ring(*uq.gpu, uq.staging);
+  vkDestroyCommandPool(uq.device, uq.command_pool, uq.allocator);
+  vkDestroyCommandPool(uq.device, uq.graphics_command_pool, uq.allocator);
+  vkDestroySemaphore(uq.device, uq.timeline, uq.allocator);
+  uq.free_command_buffers.clear();
+  uq.command_pool = VK_NULL_HANDLE;
+  uq.graphics_command_pool = VK_NULL_HANDLE;
+  uq.timeline = VK_NULL_HANDLE;
+}
+
+uint64_t
+upload_buffer(UploadQueue& uq, VkBuffer dst, VkDeviceSize dst_offset, const void* data, VkDeviceSize size, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access)
+{
+  std::lock_guard<std::mutex> lock(uq.mutex);
+  VkBuffer src;
+  VkDeviceSize src_offset;
+  stage(uq, data, size, src, src_offset);
+  begin_recording(uq);
+
+  VkBufferCopy region = {};
+  region.srcOffset = src_offset;
+  region.dstOffset = dst_offset;
+  region.size = size;
+  vkCmdCopyBuffer(uq.recording, src, dst, 1, &region);
+
+  if (separate_families(uq)) {
+    // Release on the transfer queue, the frame that waits for this batch records the matching acquire
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    barrier.srcQueueFamilyIndex = uq.queue_family;
+    barrier.dstQueueFamilyIndex = uq.graphics_family;
+    barrier.buffer = dst;
+    barrier.offset = dst_offset;
+    barrier.size = size;
+    vkCmdPipelineBarrier(uq.recording, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 1, &barrier, 0, NULL);
+
+    UploadQueue::Acquire acquire = {};
+    acquire.buffer = barrier;
+    acquire.buffer.srcAccessMask = 0;
+    acquire.buffer.dstAccessMask = dst_access;
+    acquire.is_image = false;
+    acquire.dst_stage = dst_stage;
+    acquire.value = uq.submitted_value + 1;
+    uq.recorded_acquires.push_back(acquire);
+  }
+  // Same family: the semaphore wait alone makes the writes visible
+  uq.recorded_stages |= dst_stage;
+  uq.recorded_bytes += size;
+  uq.total_bytes += size;
+  return uq.submitted_value + 1;
+}
+
+uint64_t
+upload_image(UploadQueue& uq, VkImage dst, VkExtent3D extent, VkDeviceSize texel_size, const void* data, VkImageLayout final_layout, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access)
+{
+  std::lock_guard<std::mutex> lock(uq.mutex);
+  const VkDeviceSize size = static_cast<VkDeviceSize>(extent.width) * extent.height * extent.depth * texel_size;
+  VkBuffer src;
+  VkDeviceSize src_offset;
+  stage(uq, data, size, src, src_offset);
+  begin_recording(uq);
+
+  VkImageMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = dst;
+  barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+  vkCmdPipelineBarrier(uq.recording, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+  VkBufferImageCopy region = {};
+  region.bufferOffset = src_offset;
+  region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+  region.imageExtent = extent;
+  vkCmdCopyBufferToImage(uq.recording, src, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+  // Layout transition to final_layout: as a release/acquire pair across families, or finished here
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = 0;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = final_layout;
+  if (separate_families(uq)) {
+    barrier.srcQueueFamilyIndex = uq.queue_family;
+    barrier.dstQueueFamilyIndex = uq.graphics_family;
+  }
+  vkCmdPipelineBarrier(uq.recording, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+  if (separate_families(uq)) {
+    UploadQueue::Acquire acquire = {};
+    acquire.image = barrier;
+    acquire.image.srcAccessMask = 0;
+    acquire.image.dstAccessMask = dst_access;
+    acquire.is_image = true;
+    acquire.dst_stage = dst_stage;
+    acquire.value = uq.submitted_value + 1;
+    uq.recorded_acquires.push_back(acquire);
+  }
+  uq.recorded_stages |= dst_stage;
+  uq.recorded_bytes += size;
+  uq.total_bytes += size;
+  return uq.submitted_value + 1;
+}
+
+void
+upload_queue_flush(UploadQueue& uq)
+{
+  std::lock_guard<std::mutex> lock(uq.mutex);
+  flush_locked(uq);
+}
+
+uint64_t
+upload_queue_record_acquires(UploadQueue& uq, VkCommandBuffer command_buffer, VkPipelineStageFlags& wait_stage)
+{
+  std::lock_guard<std::mutex> lock(uq.mutex);
+  wait_stage = 0;
+  if (uq.waited_value == uq.submitted_value)
+    return 0;
+
+  if (!uq.pending_acquires.empty()) {
+    std::vector<VkBufferMemoryBarrier> buffers;
+    std::vector<VkImageMemoryBarrier> images;
+    for (const UploadQueue::Acquire& acquire : uq.pending_acquires) {
+      if (acquire.is_image)
+        images.push_back(acquire.image);
+      else
+        buffers.push_back(acquire.buffer);
+    }
+    vkCmdPipelineBarrier(command_buffer,
+                         VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         uq.pending_stages,
+                         0,
+                         0,
+                         NULL,
+                         static_cast<uint32_t>(buffers.size()),
+                         buffers.data(),
+                         static_cast<uint32_t>(images.size()),
+                         images.data());
+    uq.pending_acquires.clear();
+  }
+
+  wait_stage = uq.pending_stages ? uq.pending_stages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+  uq.pending_stages = 0;
+  uq.waited_value = uq.submitted_value;
+  return uq.waited_value;
+}
+
+void
+upload_queue_collect(UploadQueue& uq)
+{
+  std::lock_guard<std::mutex> lock(uq.mutex);
+  collect_locked(uq);
+  collect_graphics_locked(uq, true);
+}
+
+bool
+upload_queue_is_complete(UploadQueue& uq, uint64_t value)
+{
+  std::lock_guard<std::mutex> lock(uq.mutex);
+  if (value > uq.completed_value) {
+    VkResult err = vkGetSemaphoreCounterValue(uq.device, uq.timeline, &uq.completed_value);
+    check_vk_result(err);
+  }
+  return value <= uq.completed_value;
+}
+
+void
+upload_queue_submit_graphics(UploadQueue& uq, const std::function<void(VkCommandBuffer)>& record, std::function<void()> on_complete)
+{
+  std::lock_guard<std::mutex> lock(uq.mutex);
+  VkResult err;
+  UploadQueue::GraphicsWork work = {};
+  work.on_complete = std::move(on_complete);
+  work.owner = std::this_thread::get_id();
+  {
+    VkCommandBufferAllocateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    info.commandPool = uq.graphics_command_pool;
+    info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    info.commandBufferCount = 1;
+    err = vkAllocateCommandBuffers(uq.device, &info, &work.command_buffer);
+    check_vk_result(err);
+  }
+  {
+    VkFenceCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    err = vkCreateFence(uq.device, &info, uq.allocator, &work.fence);
+    check_vk_result(err);
+  }
+
+  VkCommandBufferBeginInfo begin_info = {};
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  err = vkBeginCommandBuffer(work.command_buffer, &begin_info);
+  check_vk_result(err);
+  record(work.command_buffer);
+  err = vkEndCommandBuffer(work.command_buffer);
+  check_vk_result(err);
+
+  // Later submissions on the graphics queue are ordered after the barriers recorded here
+  VkSubmitInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  info.commandBufferCount = 1;
+  info.pCommandBuffers = &work.command_buffer;
+  err = vkQueueSubmit(uq.graphics_queue, 1, &info, work.fence);
+  check_vk_result(err);
+  uq.graphics_in_flight.push_back(std::move(work));
+}
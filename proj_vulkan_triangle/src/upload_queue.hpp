@@ -0,0 +1,133 @@
+#pragma once
+
+#include "gpu_allocator.hpp"
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Streaming uploads that never idle the device.
+// Data is copied into a persistently mapped staging ring and the copies are recorded on the
+// transfer queue (a dedicated transfer family when the device has one). Each flush signals the
+// upload timeline semaphore; frames wait on it and record the matching queue-family acquire
+// barriers, so the CPU never blocks on an upload. Staging space is recycled once the timeline passes.
+//
+// Work that has to run on the graphics queue (e.g. ImGui_ImplVulkan_CreateFontsTexture, which
+// records graphics-stage barriers) goes through upload_queue_submit_graphics and is tracked by fence.
+// Its completion callback runs in upload_queue_collect on the thread that submitted it, so state the
+// callback touches stays with its owner when frames are rendered on another thread.
+
+struct UploadQueue
+{
+  VkDevice device = VK_NULL_HANDLE;
+  VkAllocationCallbacks* allocator = nullptr;
+  GpuAllocator* gpu = nullptr;
+
+  VkQueue queue = VK_NULL_HANDLE;
+  uint32_t queue_family = 0;
+  uint32_t graphics_family = 0;
+  VkQueue graphics_queue = VK_NULL_HANDLE;
+
+  std::mutex mutex;
+  VkSemaphore timeline = VK_NULL_HANDLE;
+  uint64_t submitted_value = 0; // last value a flush will signal
+  uint64_t completed_value = 0; // cached, refreshed by upload_queue_collect
+
+  GpuRingBuffer staging;
+  VkCommandPool command_pool = VK_NULL_HANDLE;
+  VkCommandPool graphics_command_pool = VK_NULL_HANDLE;
+  VkCommandBuffer recording = VK_NULL_HANDLE; // copies waiting for the next flush
+  VkDeviceSize recorded_bytes = 0;
+
+  struct Batch
+  {
+    VkCommandBuffer command_buffer;
+    uint64_t value;
+  };
+  std::vector<Batch> in_flight;
+  std::vector<VkCommandBuffer> free_command_buffers;
+
+  // Oversized uploads get their own staging buffer, freed with the batch
+  struct OversizedStaging
+  {
+    GpuBuffer buffer;
+    uint64_t value;
+  };
+  std::vector<OversizedStaging> oversized;
+
+  // Barriers the graphics queue must record before using the uploaded resources
+  struct Acquire
+  {
+    VkBufferMemoryBarrier buffer;
+    VkImageMemoryBarrier image;
+    bool is_image;
+    VkPipelineStageFlags dst_stage;
+    uint64_t value;
+  };
+  std::vector<Acquire> recorded_acquires; // not flushed yet
+  std::vector<Acquire> pending_acquires;  // flushed, not yet recorded by a frame
+  VkPipelineStageFlags recorded_stages = 0;
+  VkPipelineStageFlags pending_stages = 0;
+  uint64_t waited_value = 0; // last value handed to a frame to wait on
+
+  struct GraphicsWork
+  {
+    VkCommandBuffer command_buffer;
+    VkFence fence;
+    std::function<void()> on_complete;
+    std::thread::id owner; // the submitting thread, which runs on_complete
+  };
+  std::vector<GraphicsWork> graphics_in_flight;
+
+  // stats
+  uint64_t total_bytes = 0;
+  uint64_t total_batches = 0;
+  uint64_t ring_stalls = 0;
+};
+
+void
+setup_upload_queue(UploadQueue& uq,
+                   GpuAllocator& gpu,
+                   VkDevice device,
+                   VkQueue queue,
+                   uint32_t queue_family,
+                   VkQueue graphics_queue,
+                   uint32_t graphics_family,
+                   VkDeviceSize staging_size,
+                   VkAllocationCallbacks* allocator);
+
+// Waits for outstanding uploads (shutdown only).
+void
+cleanup_upload_queue(UploadQueue& uq);
+
+// Copy into a buffer; the data is consumed immediately. dst_stage/dst_access describe the first use on the graphics queue.
+// Returns the timeline value that marks completion (valid after the next flush).
+uint64_t
+upload_buffer(UploadQueue& uq, VkBuffer dst, VkDeviceSize dst_offset, const void* data, VkDeviceSize size, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access);
+
+// Copy tightly packed pixels into mip 0 / layer 0 of an image in UNDEFINED layout, ending in final_layout.
+uint64_t
+upload_image(UploadQueue& uq, VkImage dst, VkExtent3D extent, VkDeviceSize texel_size, const void* data, VkImageLayout final_layout, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access);
+
+// Submits everything recorded so far to the transfer queue.
+void
+upload_queue_flush(UploadQueue& uq);
+
+// Records acquire barriers for flushed uploads into a graphics command buffer (outside a render pass).
+// Returns the timeline value that submission must wait for, 0 if none.
+uint64_t
+upload_queue_record_acquires(UploadQueue& uq, VkCommandBuffer command_buffer, VkPipelineStageFlags& wait_stage);
+
+// Retires finished batches, recycles staging and runs completion callbacks of the graphics work this thread submitted.
+void
+upload_queue_collect(UploadQueue& uq);
+
+bool
+upload_queue_is_complete(UploadQueue& uq, uint64_t value);
+
+// Records work on a one-shot graphics command buffer and submits it right away, without waiting.
+void
+upload_queue_submit_graphics(UploadQueue& uq, const std::function<void(VkCommandBuffer)>& record, std::function<void()> on_complete);
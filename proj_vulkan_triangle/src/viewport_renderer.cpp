@@ -0,0 +1,303 @@
+#include "viewport_renderer.hpp"
+
+#include "swapchain.hpp"
+#include "vulkan_utils.hpp"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h> // exit
+
+namespace {
+
+// Renderer_* callbacks carry no user pointer, and io.BackendRendererUserData belongs to the vulkan backend
+ViewportRenderer* active_viewports = nullptr;
+
+void
+create_semaphores(VkDevice device, VkAllocationCallbacks* allocator, VkSemaphore* semaphores, uint32_t count)
+{
+  VkSemaphoreCreateInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  for (uint32_t i = 0; i < count; i++) {
+    VkResult err = vkCreateSemaphore(device, &info, allocator, &semaphores[i]);
+    check_vk_result(err);
+  }
+}
+
+// Follows the main window, FIFO when the surface does not support its mode
+VkPresentModeKHR
+select_present_mode(const ViewportRenderer& viewports, VkSurfaceKHR surface)
+{
+  const VkPresentModeKHR modes[] = { viewports.main_window->PresentMode, VK_PRESENT_MODE_FIFO_KHR };
+  return ImGui_ImplVulkanH_SelectPresentMode(viewports.physical_device, surface, modes, IM_ARRAYSIZE(modes));
+}
+
+// The device must be done with the window
+void
+destroy_window(ViewportRenderer& viewports, ViewportWindow* window)
+{
+  if (window->ui_ready)
+    cleanup_ui_renderer(window->ui);
+  for (VkSemaphore semaphore : window->render_complete)
+    vkDestroySemaphore(viewports.device, semaphore, viewports.allocator);
+  for (VkSemaphore semaphore : window->image_acquired)
+    vkDestroySemaphore(viewports.device, semaphore, viewports.allocator);
+  cleanup_vulkan_swapchain(viewports.device, window->wd, viewports.allocator);
+  // Created by the platform backend without our allocator
+  vkDestroySurfaceKHR(viewports.instance, window->wd.Surface, nullptr);
+  delete window;
+}
+
+bool
+rebuild_window(ViewportRenderer& viewports, ViewportWindow& window, const ImGuiViewport* viewport, uint64_t retire_value)
+{
+  const uint32_t width = static_cast<uint32_t>(viewport->Size.x);
+  const uint32_t height = static_cast<uint32_t>(viewport->Size.y);
+  if (width == 0 || height == 0)
+    return false;
+  window.wd.PresentMode = select_present_mode(viewports, window.wd.Surface);
+  if (!resize_vulkan_swapchain(&window.wd, viewports.physical_device, viewports.device, width, height, viewports.min_image_count, viewports.allocator, *viewports.deletions, retire_value))
+    return false;
+
+  // A pending present may still wait on the old semaphores
+  std::vector<VkSemaphore> retired = std::move(window.render_complete);
+  VkDevice device = viewports.device;
+  VkAllocationCallbacks* allocator = viewports.allocator;
+  deletion_queue_push(*viewports.deletions, retire_value, [device, allocator, retired] {
+    for (VkSemaphore semaphore : retired)
+      vkDestroySemaphore(device, semaphore, allocator);
+  });
+  window.render_complete.assign(window.wd.ImageCount, VK_NULL_HANDLE);
+  create_semaphores(device, allocator, window.render_complete.data(), window.wd.ImageCount);
+
+  // The render pass is created with the first swapchain and kept, so is the pipeline built against it
+  if (!window.ui_ready) {
+    window.ui_ready = setup_ui_renderer(
+      window.ui, device, *viewports.gpu, *viewports.deletions, window.wd.RenderPass, viewports.pipeline_cache, viewports.queue_family, viewports.scheduler->frames_in_flight, allocator);
+    if (!window.ui_ready) {
+      fprintf(stderr, "[viewports] Failed to create the UI renderer of a platform window\n");
+      return false;
+    }
+  }
+  window.rebuild = false;
+  return true;
+}
+
+void
+create_window_callback(ImGuiViewport* viewport)
+{
+  ViewportRenderer& viewports = *active_viewports;
+  ViewportWindow* window = new ViewportWindow();
+  ImGui_ImplVulkanH_Window& wd = window->wd;
+
+  ImGuiPlatformIO& platform_io = ImGui::GetPlatformIO();
+  VkResult err = (VkResult)platform_io.Platform_CreateVkSurface(viewport, (ImU64)viewports.instance, nullptr, (ImU64*)&wd.Surface);
+  check_vk_result(err);
+
+  VkBool32 supported = VK_FALSE;
+  vkGetPhysicalDeviceSurfaceSupportKHR(viewports.physical_device, viewports.queue_family, wd.Surface, &supported);
+  if (supported != VK_TRUE) {
+    fprintf(stderr, "Error no WSI support for a platform window\n");
+    exit(-1);
+  }
+
+  // Same format as the main window when the surface allows it
+  const VkFormat image_format[] = { viewports.main_window->SurfaceFormat.format, VK_FORMAT_B8G8R8A8_UNORM, VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_B8G8R8_UNORM, VK_FORMAT_R8G8B8_UNORM };
+  wd.SurfaceFormat = ImGui_ImplVulkanH_SelectSurfaceFormat(viewports.physical_device, wd.Surface, image_format, (size_t)IM_ARRAYSIZE(image_format), viewports.main_window->SurfaceFormat.colorSpace);
+  wd.ClearEnable = (viewport->Flags & ImGuiViewportFlags_NoRendererClear) == 0;
+  wd.ClearValue.color.float32[3] = 1.0f;
+
+  create_semaphores(viewports.device, viewports.allocator, window->image_acquired.data(), viewports.scheduler->frames_in_flight);
+  viewport->RendererUserData = window;
+  viewports.windows.push_back(window);
+}
+
+void
+destroy_window_callback(ImGuiViewport* viewport)
+{
+  ViewportWindow* window = static_cast<ViewportWindow*>(viewport->RendererUserData);
+  // The main viewport's data is the vulkan backend's
+  if (viewport == ImGui::GetMainViewport() || window == nullptr || active_viewports == nullptr)
+    return;
+  ViewportRenderer& viewports = *active_viewports;
+  viewports.windows.erase(std::find(viewports.windows.begin(), viewports.windows.end(), window));
+
+  // Closing a window is rare: wait for the frames that drew it rather than defer, so the surface
+  // and swapchain go before the platform backend destroys the native window. Swapchains retired by
+  // its resizes sit in the deletion queue at the value of the frame that rebuilt them, which every
+  // submitted frame covers, and must be gone before the surface.
+  const uint64_t wait_value = std::max(window->last_value, viewports.scheduler->frame_number);
+  frame_scheduler_wait(*viewports.scheduler, viewports.device, wait_value);
+  deletion_queue_collect(*viewports.deletions, frame_scheduler_completed_value(*viewports.scheduler, viewports.device));
+  destroy_window(viewports, window);
+  viewport->RendererUserData = nullptr;
+}
+
+void
+set_window_size_callback(ImGuiViewport* viewport, ImVec2)
+{
+  if (ViewportWindow* window = static_cast<ViewportWindow*>(viewport->RendererUserData))
+    window->rebuild = true;
+}
+
+} // namespace
+
+void
+setup_viewport_renderer(ViewportRenderer& viewports,
+                        VkInstance instance,
+                        VkPhysicalDevice physical_device,
+                        VkDevice device,
+                        uint32_t queue_family,
+                        uint32_t min_image_count,
+                        VkPipelineCache pipeline_cache,
+                        GpuAllocator& gpu,
+                        DeletionQueue& deletions,
+                        const FrameScheduler& scheduler,
+                        const ImGui_ImplVulkanH_Window& main_window,
+                        VkAllocationCallbacks* allocator)
+{
+  viewports.instance = instance;
+  viewports.physical_device = physical_device;
+  viewports.device = device;
+  viewports.allocator = allocator;
+  viewports.queue_family = queue_family;
+  viewports.min_image_count = min_image_count;
+  viewports.pipeline_cache = pipeline_cache;
+  viewports.gpu = &gpu;
+  viewports.deletions = &deletions;
+  viewports.scheduler = &scheduler;
+  viewports.main_window = &main_window;
+  active_viewports = &viewports;
+
+  ImGuiPlatformIO& platform_io = ImGui::GetPlatformIO();
+  platform_io.Renderer_CreateWindow = create_window_callback;
+  platform_io.Renderer_DestroyWindow = destroy_window_callback;
+  platform_io.Renderer_SetWindowSize = set_window_size_callback;
+  platform_io.Renderer_RenderWindow = nullptr;
+  platform_io.Renderer_SwapBuffers = nullptr;
+}
+
+void
+cleanup_viewport_renderer(ViewportRenderer& viewports)
+{
+  ImGuiPlatformIO& platform_io = ImGui::GetPlatformIO();
+  for (int i = 1; i < platform_io.Viewports.Size; i++)
+    platform_io.Viewports[i]->RendererUserData = nullptr;
+  for (ViewportWindow* window : viewports.windows)
+    destroy_window(viewports, window);
+  viewports.windows.clear();
+  viewports.acquired.clear();
+  active_viewports = nullptr;
+}
+
+void
+viewport_renderer_invalidate(ViewportRenderer& viewports)
+{
+  for (ViewportWindow* window : viewports.windows)
+    window->rebuild = true;
+}
+
+uint32_t
+viewport_renderer_acquire(ViewportRenderer& viewports, uint32_t frame_slot)
+{
+  // Objects replaced now may be used by frames up to the one being recorded
+  const uint64_t retire_value = frame_scheduler_signal_value(*viewports.scheduler);
+  viewports.acquired.clear();
+  ImGuiPlatformIO& platform_io = ImGui::GetPlatformIO();
+  for (int i = 1; i < platform_io.Viewports.Size; i++) {
+    ImGuiViewport* viewport = platform_io.Viewports[i];
+    ViewportWindow* window = static_cast<ViewportWindow*>(viewport->RendererUserData);
+    if (window == nullptr || viewport->DrawData == nullptr || (viewport->Flags & ImGuiViewportFlags_Minimized))
+      continue;
+    if (window->rebuild && !rebuild_window(viewports, *window, viewport, retire_value))
+      continue;
+
+    ImGui_ImplVulkanH_Window& wd = window->wd;
+    VkResult err = vkAcquireNextImageKHR(viewports.device, wd.Swapchain, UINT64_MAX, window->image_acquired[frame_slot], VK_NULL_HANDLE, &wd.FrameIndex);
+    if (err == VK_ERROR_OUT_OF_DATE_KHR) {
+      window->rebuild = true;
+      continue;
+    }
+    if (err != VK_SUBOPTIMAL_KHR)
+      check_vk_result(err);
+    viewports.acquired.push_back(viewport);
+  }
+  return static_cast<uint32_t>(viewports.acquired.size());
+}
+
+void
+viewport_renderer_record(ViewportRenderer& viewports, VkCommandBuffer command_buffer, FrameScheduler& scheduler)
+{
+  const uint32_t frame_slot = scheduler.frame_slot;
+  const uint64_t signal_value = frame_scheduler_signal_value(scheduler);
+  for (ImGuiViewport* viewport : viewports.acquired) {
+    ViewportWindow& window = *static_cast<ViewportWindow*>(viewport->RendererUserData);
+    ImGui_ImplVulkanH_Window& wd = window.wd;
+
+    VkCommandBufferInheritanceInfo inheritance = {};
+    inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance.renderPass = wd.RenderPass;
+    inheritance.subpass = 0;
+    VkCommandBuffer secondary = ui_renderer_record(window.ui, viewport->DrawData, frame_slot, inheritance, signal_value);
+    {
+      VkRenderPassBeginInfo info = {};
+      info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+      info.renderPass = wd.RenderPass;
+      info.framebuffer = wd.Frames[wd.FrameIndex].Framebuffer;
+      info.renderArea.extent.width = wd.Width;
+      info.renderArea.extent.height = wd.Height;
+      info.clearValueCount = 1;
+      info.pClearValues = &wd.ClearValue;
+      vkCmdBeginRenderPass(command_buffer, &info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    }
+    vkCmdExecuteCommands(command_buffer, 1, &secondary);
+    vkCmdEndRenderPass(command_buffer);
+
+    submit_semaphores_wait(scheduler.submit, window.image_acquired[frame_slot], 0, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+    submit_semaphores_signal(scheduler.submit, window.render_complete[wd.FrameIndex], 0);
+    window.last_value = signal_value;
+  }
+}
+
+VkResult
+viewport_renderer_present(ViewportRenderer& viewports, VkQueue queue, VkSwapchainKHR main_swapchain, uint32_t main_image, VkSemaphore main_render_complete)
+{
+  viewports.swapchains.clear();
+  viewports.image_indices.clear();
+  viewports.present_waits.clear();
+  if (main_swapchain != VK_NULL_HANDLE) {
+    viewports.swapchains.push_back(main_swapchain);
+    viewports.image_indices.push_back(main_image);
+    viewports.present_waits.push_back(main_render_complete);
+  }
+  for (ImGuiViewport* viewport : viewports.acquired) {
+    const ViewportWindow& window = *static_cast<ViewportWindow*>(viewport->RendererUserData);
+    viewports.swapchains.push_back(window.wd.Swapchain);
+    viewports.image_indices.push_back(window.wd.FrameIndex);
+    viewports.present_waits.push_back(window.render_complete[window.wd.FrameIndex]);
+  }
+  if (viewports.swapchains.empty())
+    return VK_SUCCESS;
+  viewports.present_results.assign(viewports.swapchains.size(), VK_SUCCESS);
+
+  VkPresentInfoKHR info = {};
+  info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+  info.waitSemaphoreCount = static_cast<uint32_t>(viewports.present_waits.size());
+  info.pWaitSemaphores = viewports.present_waits.data();
+  info.swapchainCount = static_cast<uint32_t>(viewports.swapchains.size());
+  info.pSwapchains = viewports.swapchains.data();
+  info.pImageIndices = viewports.image_indices.data();
+  info.pResults = viewports.present_results.data();
+  VkResult err = vkQueuePresentKHR(queue, &info);
+  if (err != VK_ERROR_OUT_OF_DATE_KHR && err != VK_SUBOPTIMAL_KHR)
+    check_vk_result(err);
+
+  // Every swapchain reports its own result
+  const size_t first_window = main_swapchain != VK_NULL_HANDLE ? 1 : 0;
+  for (size_t i = 0; i < viewports.acquired.size(); i++) {
+    const VkResult result = viewports.present_results[first_window + i];
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+      static_cast<ViewportWindow*>(viewports.acquired[i]->RendererUserData)->rebuild = true;
+  }
+  viewports.acquired.clear();
+  return first_window > 0 ? viewports.present_results[0] : VK_SUCCESS;
+}
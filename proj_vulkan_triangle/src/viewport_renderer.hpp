@@ -0,0 +1,100 @@
+#pragma once
+
+#include "backends/imgui_impl_vulkan.h"
+#include "deletion_queue.hpp"
+#include "frame_scheduler.hpp"
+#include "gpu_allocator.hpp"
+#include "imgui.h"
+#include "ui_renderer.hpp"
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Batched rendering of dear imgui's platform windows (multi-viewport), replacing the vulkan backend's
+// Renderer_* callbacks and ImGui::RenderPlatformWindowsDefault.
+//
+// The default path handles one window at a time: wait on its fence, acquire, record, submit, present.
+// Here every platform window acquires its image when the frame starts, its render pass is recorded
+// into the frame's command buffer after the main window's, and everything goes out in the frame's
+// single vkQueueSubmit and one vkQueuePresentKHR covering all swapchains.
+//
+// Each platform window owns a surface, a swapchain (swapchain.hpp, resized without idling), a
+// render_complete semaphore per image, an image_acquired semaphore per frame slot and a UiRenderer
+// built against its render pass. Windows are paced by the main FrameScheduler.
+
+struct ViewportWindow
+{
+  ImGui_ImplVulkanH_Window wd;
+  UiRenderer ui;
+  bool ui_ready = false;
+  std::array<VkSemaphore, max_frames_in_flight> image_acquired = {};
+  std::vector<VkSemaphore> render_complete; // per swapchain image
+  bool rebuild = true;     // created, resized or out of date
+  uint64_t last_value = 0; // timeline value of the last frame that drew this window
+};
+
+struct ViewportRenderer
+{
+  VkInstance instance = VK_NULL_HANDLE;
+  VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+  VkDevice device = VK_NULL_HANDLE;
+  VkAllocationCallbacks* allocator = nullptr;
+  uint32_t queue_family = 0;
+  uint32_t min_image_count = 2;
+  VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
+  GpuAllocator* gpu = nullptr;
+  DeletionQueue* deletions = nullptr;
+  const FrameScheduler* scheduler = nullptr;
+  const ImGui_ImplVulkanH_Window* main_window = nullptr; // formats and present mode are matched to it
+
+  std::vector<ViewportWindow*> windows;
+  std::vector<ImGuiViewport*> acquired; // drawn by the frame being recorded
+
+  // Present batch, reused across frames
+  std::vector<VkSwapchainKHR> swapchains;
+  std::vector<uint32_t> image_indices;
+  std::vector<VkSemaphore> present_waits;
+  std::vector<VkResult> present_results;
+};
+
+// Installs the Renderer_* callbacks, call after ImGui_ImplVulkan_Init. platform_io.Renderer_RenderWindow
+// and Renderer_SwapBuffers are cleared: platform windows are drawn by viewport_renderer_record only.
+void
+setup_viewport_renderer(ViewportRenderer& viewports,
+                        VkInstance instance,
+                        VkPhysicalDevice physical_device,
+                        VkDevice device,
+                        uint32_t queue_family,
+                        uint32_t min_image_count,
+                        VkPipelineCache pipeline_cache,
+                        GpuAllocator& gpu,
+                        DeletionQueue& deletions,
+                        const FrameScheduler& scheduler,
+                        const ImGui_ImplVulkanH_Window& main_window,
+                        VkAllocationCallbacks* allocator);
+
+// Destroys every platform window's renderer objects, the device must be idle. Call before
+// ImGui_ImplVulkan_Shutdown, which then only destroys the platform side of the windows.
+void
+cleanup_viewport_renderer(ViewportRenderer& viewports);
+
+// Rebuilds every platform window's swapchain before it is next drawn (e.g. the present mode changed).
+void
+viewport_renderer_invalidate(ViewportRenderer& viewports);
+
+// Acquires an image for every visible platform window, after ImGui::UpdatePlatformWindows and
+// frame_scheduler_begin. Returns the number of windows to draw this frame.
+uint32_t
+viewport_renderer_acquire(ViewportRenderer& viewports, uint32_t frame_slot);
+
+// Records the acquired windows' render passes and adds their semaphores to the scheduler's submit.
+void
+viewport_renderer_record(ViewportRenderer& viewports, VkCommandBuffer command_buffer, FrameScheduler& scheduler);
+
+// Presents the main window (unless main_swapchain is VK_NULL_HANDLE) and every window recorded this
+// frame with one vkQueuePresentKHR. Platform windows that are out of date are rebuilt before their
+// next frame; the main window's result is returned for the caller to handle.
+VkResult
+viewport_renderer_present(ViewportRenderer& viewports, VkQueue queue, VkSwapchainKHR main_swapchain, uint32_t main_image, VkSemaphore main_render_complete);
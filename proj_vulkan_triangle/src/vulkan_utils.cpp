@@ -0,0 +1,39 @@
+#include "vulkan_utils.hpp"
+
+#include <stdio.h>  // printf, fprintf
+#include <stdlib.h> // abort
+
+void
+check_vk_result(VkResult err)
+{
+  if (err == VK_SUCCESS)
+    return;
+  fprintf(stderr, "[vulkan] Error: VkResult = %d\n", err);
+  if (err < 0)
+    abort();
+}
+
+uint32_t
+find_memory_type(VkPhysicalDevice physical_device, uint32_t type_bits, VkMemoryPropertyFlags properties)
+{
+  VkPhysicalDeviceMemoryProperties memory_properties;
+  vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+  for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+    if ((type_bits & (1u << i)) && (memory_properties.memoryTypes[i].propertyFlags & properties) == properties)
+      return i;
+  }
+  return UINT32_MAX;
+}
+
+VkShaderModule
+create_shader_module(VkDevice device, const uint32_t* code, size_t size, VkAllocationCallbacks* allocator)
+{
+  VkShaderModuleCreateInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  info.codeSize = size;
+  info.pCode = code;
+  VkShaderModule module;
+  VkResult err = vkCreateShaderModule(device, &info, allocator, &module);
+  check_vk_result(err);
+  return module;
+}
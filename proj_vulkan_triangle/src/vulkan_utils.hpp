@@ -0,0 +1,16 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+
+void
+check_vk_result(VkResult err);
+
+// Returns UINT32_MAX if no memory type matches
+uint32_t
+find_memory_type(VkPhysicalDevice physical_device, uint32_t type_bits, VkMemoryPropertyFlags properties);
+
+VkShaderModule
+create_shader_module(VkDevice device, const uint32_t* code, size_t size, VkAllocationCallbacks* allocator);